@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <wallet/crypter.h>
 
 #include <vector>
@@ -84,4 +85,26 @@ static void CCoinsCaching(benchmark::State& state)
     }
 }
 
+// Random lookups in a cache much larger than the CPU caches, which is what
+// AccessCoin and SpendCoin face with a large -dbcache.
+static void CCoinsCachingLookup(benchmark::State& state)
+{
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    FastRandomContext rng(true);
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 200000; ++i) {
+        outpoints.emplace_back(rng.rand256(), rng.randrange(4));
+        coins.AddCoin(outpoints.back(), Coin(CTxOut(i, CScript() << OP_TRUE), 1, 0, false), false);
+    }
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const Coin& coin = coins.AccessCoin(outpoints[(i * 7919) % outpoints.size()]);
+        assert(!coin.IsSpent());
+        ++i;
+    }
+}
+
 BENCHMARK(CCoinsCaching, 170 * 1000);
+BENCHMARK(CCoinsCachingLookup, 5 * 1000 * 1000);
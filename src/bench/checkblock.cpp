@@ -8,6 +8,7 @@
 #include <validation.h>
 #include <streams.h>
 #include <consensus/validation.h>
+#include <support/allocators/arena.h>
 
 namespace block_bench {
 #include <bench/data/block413567.raw.h>
@@ -32,6 +33,27 @@ static void DeserializeBlockTest(benchmark::State& state)
     }
 }
 
+static void DeserializeBlockArenaTest(benchmark::State& state)
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        {
+            ArenaResource arena;
+            ArenaScope arena_scope(&arena);
+            stream >> block;
+            // One allocation per chunk instead of one per transaction.
+            assert(arena.NumAllocatedChunks() < block.vtx.size());
+        }
+        assert(stream.Rewind(sizeof(block_bench::block413567)));
+    }
+}
+
 static void DeserializeAndCheckBlockTest(benchmark::State& state)
 {
     CDataStream stream((const char*)block_bench::block413567,
@@ -53,4 +75,5 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
 }
 
 BENCHMARK(DeserializeBlockTest, 130);
+BENCHMARK(DeserializeBlockArenaTest, 130);
 BENCHMARK(DeserializeAndCheckBlockTest, 160);
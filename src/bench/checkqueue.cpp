@@ -6,7 +6,9 @@
 #include <util.h>
 #include <validation.h>
 #include <checkqueue.h>
+#include <crypto/sha256.h>
 #include <prevector.h>
+#include <uint256.h>
 #include <vector>
 #include <boost/thread/thread.hpp>
 #include <random.h>
@@ -60,3 +62,44 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.join_all();
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+
+// This Benchmark tests the CheckQueue with uneven work: every tenth batch is
+// a hundred times as expensive as the others, so the workers whose queues
+// receive those have to be helped out by the idle ones.
+static void CCheckQueueSpeedUnevenJob(benchmark::State& state)
+{
+    struct UnevenJob {
+        uint32_t nRounds {0};
+        UnevenJob(){
+        }
+        explicit UnevenJob(uint32_t nRoundsIn) : nRounds(nRoundsIn){
+        }
+        bool operator()()
+        {
+            uint256 hash;
+            for (uint32_t i = 0; i < nRounds; ++i)
+                CSHA256().Write(hash.begin(), hash.size()).Finalize(hash.begin());
+            return true;
+        }
+        void swap(UnevenJob& x){std::swap(nRounds, x.nRounds);};
+    };
+    CCheckQueue<UnevenJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<UnevenJob> control(&queue);
+        for (size_t b = 0; b < BATCHES; ++b) {
+            std::vector<UnevenJob> vChecks;
+            vChecks.reserve(BATCH_SIZE);
+            for (size_t x = 0; x < BATCH_SIZE; ++x)
+                vChecks.emplace_back(b % 10 == 0 ? 100 : 1);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+BENCHMARK(CCheckQueueSpeedUnevenJob, 250);
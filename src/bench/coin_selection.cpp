@@ -3,8 +3,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <random.h>
 #include <wallet/wallet.h>
 
+#include <algorithm>
 #include <set>
 
 static void addCoin(const CAmount& nValue, const CWallet& wallet, std::vector<COutput>& vCoins)
@@ -56,4 +58,97 @@ static void CoinSelection(benchmark::State& state)
     }
 }
 
+// A wallet of LARGE_WALLET_COINS coins of random values, as kept by services
+// paying out from one wallet.
+static const int LARGE_WALLET_COINS = 100000;
+
+static void AddRandomCoins(const CWallet& wallet, std::vector<COutput>& vCoins)
+{
+    FastRandomContext rand(true);
+    for (int i = 0; i < LARGE_WALLET_COINS; i++)
+        addCoin(CENT / 10 + rand.randrange(COIN), wallet, vCoins);
+}
+
+static void DeleteCoins(std::vector<COutput>& vCoins)
+{
+    for (COutput output : vCoins)
+        delete output.tx;
+    vCoins.clear();
+}
+
+static std::vector<CInputCoin> SortedInputCoins(const std::vector<COutput>& vCoins)
+{
+    std::vector<CInputCoin> vUTXOs;
+    for (const COutput& output : vCoins)
+        vUTXOs.emplace_back(output.tx, output.i);
+    std::sort(vUTXOs.begin(), vUTXOs.end(), [](const CInputCoin& a, const CInputCoin& b) {
+        return a.txout.nValue > b.txout.nValue;
+    });
+    return vUTXOs;
+}
+
+// The stochastic selection, whose number of attempts shrinks as the wallet grows
+static void CoinSelectionLargeWallet(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+    AddRandomCoins(wallet, vCoins);
+
+    FastRandomContext rand(true);
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(50 * COIN + rand.randrange(COIN), 1, 6, 0, vCoins, setCoinsRet, nValueRet);
+        assert(success);
+    }
+    DeleteCoins(vCoins);
+}
+
+// The search for a set needing no change, which SelectCoins tries first
+static void BnBLargeWallet(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+    AddRandomCoins(wallet, vCoins);
+    const std::vector<CInputCoin> vUTXOs = SortedInputCoins(vCoins);
+
+    FastRandomContext rand(true);
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        SelectCoinsBnB(vUTXOs, 50 * COIN + rand.randrange(COIN), 3000, setCoinsRet, nValueRet);
+    }
+    DeleteCoins(vCoins);
+}
+
+// Coins of 2^(n+i) and 2^(n+i) + 2^(n-1-i), whose only solution is found
+// last, so that the search runs for all of BNB_MAX_TRIES.
+static void BnBExhaustion(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+    const int n = 17;
+    CAmount nTarget = 0;
+    for (int i = 0; i < n; i++) {
+        nTarget += CAmount(1) << (n + i);
+        addCoin(CAmount(1) << (n + i), wallet, vCoins);
+        addCoin((CAmount(1) << (n + i)) + (CAmount(1) << (n - 1 - i)), wallet, vCoins);
+    }
+    const std::vector<CInputCoin> vUTXOs = SortedInputCoins(vCoins);
+
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool success = SelectCoinsBnB(vUTXOs, nTarget, 0, setCoinsRet, nValueRet);
+        assert(!success);
+    }
+    DeleteCoins(vCoins);
+}
+
 BENCHMARK(CoinSelection, 650);
+BENCHMARK(CoinSelectionLargeWallet, 5);
+BENCHMARK(BnBLargeWallet, 250);
+BENCHMARK(BnBExhaustion, 650);
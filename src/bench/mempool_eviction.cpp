@@ -111,4 +111,86 @@ static void MempoolEviction(benchmark::State& state)
     }
 }
 
+// A package as large as the default descendant limit allows: a root with two
+// outputs, each spent by a chain of 12 transactions.
+static std::vector<CTransactionRef> CreatePackage(int n)
+{
+    std::vector<CTransactionRef> package;
+    CMutableTransaction root;
+    root.vin.resize(1);
+    root.vin[0].scriptSig = CScript() << n;
+    root.vout.resize(2);
+    for (CTxOut& out : root.vout) {
+        out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        out.nValue = 10 * COIN;
+    }
+    package.push_back(MakeTransactionRef(root));
+    for (uint32_t branch = 0; branch < root.vout.size(); branch++) {
+        COutPoint prevout(root.GetHash(), branch);
+        for (int i = 0; i < 12; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = prevout;
+            tx.vin[0].scriptSig = CScript() << OP_1;
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            tx.vout[0].nValue = 10 * COIN;
+            package.push_back(MakeTransactionRef(tx));
+            prevout = COutPoint(tx.GetHash(), 0);
+        }
+    }
+    return package;
+}
+
+// A block confirming the roots of 100 packages is connected, which updates
+// the ancestor state of all their descendants, and disconnected again, which
+// re-adds the roots and has UpdateTransactionsFromBlock link them back up.
+static void MempoolReorg(benchmark::State& state)
+{
+    CTxMemPool pool;
+    std::vector<CTransactionRef> vRoots;
+    std::vector<uint256> vRootHashes;
+    for (int n = 0; n < 100; n++) {
+        const std::vector<CTransactionRef> package = CreatePackage(n);
+        for (const CTransactionRef& tx : package) {
+            AddTx(*tx, 1000LL, pool);
+        }
+        vRoots.push_back(package[0]);
+        vRootHashes.push_back(package[0]->GetHash());
+    }
+
+    while (state.KeepRunning()) {
+        pool.removeForBlock(vRoots, 1);
+        for (const CTransactionRef& root : vRoots) {
+            AddTx(*root, 1000LL, pool);
+        }
+        pool.UpdateTransactionsFromBlock(vRootHashes);
+    }
+    assert(pool.size() == 2500);
+}
+
+// 100 packages enter the mempool and are removed recursively, as when their
+// roots are double spent.
+static void MempoolRemovePackages(benchmark::State& state)
+{
+    std::vector<std::vector<CTransactionRef>> packages;
+    for (int n = 0; n < 100; n++) {
+        packages.push_back(CreatePackage(n));
+    }
+    CTxMemPool pool;
+
+    while (state.KeepRunning()) {
+        for (const auto& package : packages) {
+            for (const CTransactionRef& tx : package) {
+                AddTx(*tx, 1000LL, pool);
+            }
+        }
+        for (const auto& package : packages) {
+            pool.removeRecursive(*package[0], MemPoolRemovalReason::CONFLICT);
+        }
+    }
+}
+
 BENCHMARK(MempoolEviction, 41000);
+BENCHMARK(MempoolReorg, 200);
+BENCHMARK(MempoolRemovePackages, 20);
@@ -0,0 +1,92 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/fees.h>
+#include <random.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static const int TXS_PER_BLOCK = 100;
+
+// Add a block's worth of transactions at random feerates to the mempool, and
+// mine about a third of everything waiting, so that confirmation times spread
+// over many targets.
+static void AddBlock(CTxMemPool& pool, FastRandomContext& rand, std::vector<CTransactionRef>& waiting, unsigned int& nHeight, uint32_t& nCount)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    for (int i = 0; i < TXS_PER_BLOCK; ++i) {
+        tx.vin[0].prevout.n = nCount++;
+        CTransactionRef ptx = MakeTransactionRef(tx);
+        pool.addUnchecked(ptx->GetHash(), CTxMemPoolEntry(ptx, 1000 + rand.randrange(100000), 0, nHeight, false, 4, LockPoints()));
+        waiting.push_back(ptx);
+    }
+    std::vector<CTransactionRef> block;
+    std::vector<CTransactionRef> left;
+    for (const CTransactionRef& ptx : waiting) {
+        (rand.randrange(3) == 0 ? block : left).push_back(ptx);
+    }
+    waiting.swap(left);
+    pool.removeForBlock(block, ++nHeight);
+}
+
+static void PolicyEstimatorProcessBlock(benchmark::State& state)
+{
+    CBlockPolicyEstimator estimator;
+    CTxMemPool pool(&estimator);
+    FastRandomContext rand(true);
+    std::vector<CTransactionRef> waiting;
+    unsigned int nHeight = 1;
+    uint32_t nCount = 0;
+
+    while (state.KeepRunning()) {
+        AddBlock(pool, rand, waiting, nHeight, nCount);
+    }
+}
+
+static void PolicyEstimatorEstimate(benchmark::State& state, bool fNewBlocks)
+{
+    CBlockPolicyEstimator estimator;
+    CTxMemPool pool(&estimator);
+    FastRandomContext rand(true);
+    std::vector<CTransactionRef> waiting;
+    unsigned int nHeight = 1;
+    uint32_t nCount = 0;
+    for (int i = 0; i < 200; ++i) {
+        AddBlock(pool, rand, waiting, nHeight, nCount);
+    }
+
+    std::vector<const CTxMemPoolEntry*> empty;
+    int target = 1;
+    while (state.KeepRunning()) {
+        if (fNewBlocks) {
+            // An empty block invalidates every estimate without changing the data much
+            estimator.processBlock(++nHeight, empty);
+        }
+        FeeCalculation feeCalc;
+        estimator.estimateSmartFee(target, &feeCalc, target % 2);
+        if (++target > 144) target = 1;
+    }
+}
+
+// Repeated queries between blocks, as from a wallet service
+static void PolicyEstimatorEstimateSmartFee(benchmark::State& state)
+{
+    PolicyEstimatorEstimate(state, false);
+}
+
+// The first query after each block
+static void PolicyEstimatorEstimateAfterBlock(benchmark::State& state)
+{
+    PolicyEstimatorEstimate(state, true);
+}
+
+BENCHMARK(PolicyEstimatorProcessBlock, 1600);
+BENCHMARK(PolicyEstimatorEstimateSmartFee, 5000000);
+BENCHMARK(PolicyEstimatorEstimateAfterBlock, 2500);
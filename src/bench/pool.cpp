@@ -0,0 +1,53 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <support/allocators/pool.h>
+
+#include <unordered_map>
+
+template <typename Map>
+void BenchFillClearMap(benchmark::State& state, Map& map)
+{
+    size_t batch_size = 5000;
+
+    // make sure a bit more than batch_size fit into the map
+    map.reserve(batch_size * 2);
+
+    // Fill the map with a batch of items and clear it again, like the coins
+    // cache does between flushes.
+    uint64_t key = 7;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < batch_size; ++i) {
+            map[key];
+            key = key * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+        map.clear();
+    }
+}
+
+static void PoolAllocator_StdUnorderedMap(benchmark::State& state)
+{
+    auto map = std::unordered_map<uint64_t, uint64_t>();
+    BenchFillClearMap(state, map);
+}
+
+static void PoolAllocator_StdUnorderedMapWithPoolResource(benchmark::State& state)
+{
+    typedef std::unordered_map<uint64_t,
+                               uint64_t,
+                               std::hash<uint64_t>,
+                               std::equal_to<uint64_t>,
+                               PoolAllocator<std::pair<const uint64_t, uint64_t>,
+                                             sizeof(std::pair<const uint64_t, uint64_t>) + 4 * sizeof(void*)>>
+        Map;
+
+    // make sure the resource supports large enough pools to hold the node. We do this by adding the size of a few pointers to it.
+    Map::allocator_type::ResourceType pool_resource;
+    Map map(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(), &pool_resource);
+    BenchFillClearMap(state, map);
+}
+
+BENCHMARK(PoolAllocator_StdUnorderedMap, 140);
+BENCHMARK(PoolAllocator_StdUnorderedMapWithPoolResource, 140);
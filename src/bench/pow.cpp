@@ -0,0 +1,63 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <miner.h>
+#include <pow.h>
+#include <random.h>
+#include <util.h>
+
+static const uint32_t NONCES = 0x10000;
+
+// A header no nonce is expected to solve, so that every run tries them all.
+static CBlockHeader CreateHeader(FastRandomContext& rand)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = rand.rand256();
+    header.hashMerkleRoot = rand.rand256();
+    header.nTime = 1500000000;
+    header.nBits = 0x1d00ffff;
+    return header;
+}
+
+static void PowGetHash(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    FastRandomContext rand(true);
+    CBlockHeader header = CreateHeader(rand);
+    while (state.KeepRunning()) {
+        header.nNonce = 0;
+        while (header.nNonce < NONCES && !CheckProofOfWork(header.GetHash(), header.nBits, chainParams->GetConsensus())) {
+            ++header.nNonce;
+        }
+    }
+}
+
+static void PowGrind(benchmark::State& state, int nThreads)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    FastRandomContext rand(true);
+    CBlockHeader header = CreateHeader(rand);
+    while (state.KeepRunning()) {
+        header.nNonce = 0;
+        uint64_t nMaxTries = NONCES;
+        GrindProofOfWork(header, NONCES, nMaxTries, chainParams->GetConsensus(), nThreads);
+    }
+}
+
+static void PowGrindSingleThread(benchmark::State& state)
+{
+    PowGrind(state, 1);
+}
+
+static void PowGrindAllThreads(benchmark::State& state)
+{
+    PowGrind(state, std::max(GetNumCores(), 1));
+}
+
+BENCHMARK(PowGetHash, 15);
+BENCHMARK(PowGrindSingleThread, 20);
+BENCHMARK(PowGrindAllThreads, 20);
@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <key.h>
+#include <primitives/transaction.h>
+#include <random.h>
+#include <script/sigcache.h>
+#include <util.h>
+
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+static const int MIN_CORES = 2;
+static const size_t SIGNATURES = 1000;
+static const size_t LOOKUPS_PER_THREAD = 4096;
+
+// Look up cached signatures from several threads at once, like the script
+// check threads and the RPC and network threads accepting transactions do.
+static void SigCacheLookup(benchmark::State& state, int nThreads)
+{
+    InitSignatureCache();
+
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    const CTransaction tx;
+    PrecomputedTransactionData txdata(tx);
+    const CachingTransactionSignatureChecker checker(&tx, 0, 0, true, txdata);
+
+    // Fill the cache; the first verification of each signature stores it.
+    std::vector<uint256> hashes(SIGNATURES);
+    std::vector<std::vector<unsigned char>> sigs(SIGNATURES);
+    for (size_t i = 0; i < SIGNATURES; ++i) {
+        hashes[i] = GetRandHash();
+        key.Sign(hashes[i], sigs[i]);
+        assert(checker.VerifySignature(sigs[i], pubkey, hashes[i]));
+    }
+
+    while (state.KeepRunning()) {
+        boost::thread_group tg;
+        for (int x = 0; x < nThreads; ++x) {
+            tg.create_thread([&, x] {
+                for (size_t i = 0; i < LOOKUPS_PER_THREAD; ++i) {
+                    const size_t n = (i * 7 + x) % SIGNATURES;
+                    assert(checker.VerifySignature(sigs[n], pubkey, hashes[n]));
+                }
+            });
+        }
+        tg.join_all();
+    }
+}
+
+static void SigCacheLookupOneThread(benchmark::State& state)
+{
+    SigCacheLookup(state, 1);
+}
+
+static void SigCacheLookupAllCores(benchmark::State& state)
+{
+    SigCacheLookup(state, std::max(MIN_CORES, GetNumCores()));
+}
+
+BENCHMARK(SigCacheLookupOneThread, 200);
+BENCHMARK(SigCacheLookupAllCores, 200);
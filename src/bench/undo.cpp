@@ -0,0 +1,112 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <clientversion.h>
+#include <pubkey.h>
+#include <random.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <undo.h>
+
+static const int BLOCK_HEIGHT = 413567;
+static const size_t INPUTS = 2000;
+static const size_t INPUTS_PER_TX = 2;
+
+// Undo data shaped like that of a full block: mostly recent coins, paying
+// to a mix of P2PKH, P2SH and version 0 witness programs.
+static CBlockUndo CreateBlockUndo()
+{
+    FastRandomContext rand(true);
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(INPUTS / INPUTS_PER_TX);
+    for (size_t i = 0; i < INPUTS; ++i) {
+        CScript script;
+        switch (i % 10) {
+        case 0: case 1: case 2: case 3:
+            script = GetScriptForDestination(CKeyID(uint160(rand.randbytes(20))));
+            break;
+        case 4: case 5:
+            script = GetScriptForDestination(CScriptID(uint160(rand.randbytes(20))));
+            break;
+        case 6: case 7: case 8:
+            script = CScript() << OP_0 << rand.randbytes(20);
+            break;
+        default:
+            script = CScript() << OP_0 << rand.randbytes(32);
+        }
+        const int nHeight = BLOCK_HEIGHT - (int)rand.randrange(i % 3 == 0 ? 100000 : 1000);
+        Coin coin(CTxOut(rand.randrange(100 * COIN), script), nHeight, 0, false);
+        blockundo.vtxundo[i / INPUTS_PER_TX].vprevout.push_back(std::move(coin));
+    }
+    return blockundo;
+}
+
+static void UndoSerialize(benchmark::State& state, bool fCompact)
+{
+    const CBlockUndo blockundo = CreateBlockUndo();
+    const CompactBlockUndoSerializer compact(blockundo, BLOCK_HEIGHT);
+    // The compact encoding has to be worth what it costs.
+    assert(GetSerializeSize(compact, SER_DISK, CLIENT_VERSION) < GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION));
+
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    while (state.KeepRunning()) {
+        stream.clear();
+        if (fCompact) {
+            stream << compact;
+        } else {
+            stream << blockundo;
+        }
+    }
+}
+
+static void UndoDeserialize(benchmark::State& state, bool fCompact)
+{
+    const CBlockUndo blockundo = CreateBlockUndo();
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    if (fCompact) {
+        stream << CompactBlockUndoSerializer(blockundo, BLOCK_HEIGHT);
+    } else {
+        stream << blockundo;
+    }
+    const size_t size = stream.size();
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlockUndo read;
+        if (fCompact) {
+            CompactBlockUndoDeserializer deserializer(read, BLOCK_HEIGHT);
+            stream >> deserializer;
+        } else {
+            stream >> read;
+        }
+        assert(stream.Rewind(size));
+    }
+}
+
+static void UndoSerializeLegacy(benchmark::State& state)
+{
+    UndoSerialize(state, false);
+}
+
+static void UndoSerializeCompact(benchmark::State& state)
+{
+    UndoSerialize(state, true);
+}
+
+static void UndoDeserializeLegacy(benchmark::State& state)
+{
+    UndoDeserialize(state, false);
+}
+
+static void UndoDeserializeCompact(benchmark::State& state)
+{
+    UndoDeserialize(state, true);
+}
+
+BENCHMARK(UndoSerializeLegacy, 200);
+BENCHMARK(UndoSerializeCompact, 200);
+BENCHMARK(UndoDeserializeLegacy, 200);
+BENCHMARK(UndoDeserializeCompact, 200);
@@ -8,10 +8,14 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 template <typename T>
 class CCheckQueueControl;
@@ -25,12 +29,38 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has its own queue, which the master fills round-robin, and
+  * workers that run out of work steal from the others. A shared mutex is
+  * only taken to go to sleep and to wake sleeping threads up.
+  *
+  * The master may also add verifications for the next round, which the
+  * workers pick up once the current round's are taken. The master doesn't
+  * wait for those until the next round.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    /**
+     * The checks waiting to be picked up by one thread, per round (current
+     * and next). The owner takes the most recently added ones from the back,
+     * other threads that ran out of work steal the oldest ones from the front.
+     */
+    struct WorkQueue
+    {
+        boost::mutex mutex;
+        std::deque<T> checks[2];
+        //! Sizes of checks, readable without taking the mutex
+        std::atomic<size_t> nSize[2];
+
+        WorkQueue() { nSize[0] = nSize[1] = 0; }
+    };
+
+    //! The queues of the master (index 0) and of the worker threads.
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+
+    //! Mutex to sleep on when out of work
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,96 +69,190 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The number of worker threads that have started.
+    std::atomic<unsigned int> nWorkers;
+
+    //! The number of worker threads that are idle.
+    std::atomic<int> nIdle;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The queue the next batch added is put into (only used by the master).
+    unsigned int nNextQueue;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Index of the current round in the per-round state; the other is the next round.
+    std::atomic<unsigned int> nRound;
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! The temporary evaluation result, per round.
+    std::atomic<bool> fAllOk[2];
+
+    //! Number of verifications waiting in the queues.
+    std::atomic<unsigned int> nQueued;
 
     /**
-     * Number of verifications that haven't completed yet.
+     * Number of verifications that haven't completed yet, per round.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo[2];
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! The number of worker queues that are in use.
+    unsigned int WorkerQueues() const
+    {
+        return std::min<unsigned int>(nWorkers, queues.size() - 1);
+    }
+
+    /**
+     * Move a batch of checks of round r from wq into vChecks.
+     * Do not try to do everything at once, but aim for increasingly smaller
+     * batches so all threads finish approximately simultaneously. Don't do
+     * batches smaller than 1 (duh), or larger than nBatchSize, and leave a
+     * thief no more than half of the queue it steals from.
+     */
+    bool Take(WorkQueue& wq, unsigned int r, std::vector<T>& vChecks, bool fOwner)
+    {
+        if (wq.nSize[r] == 0)
+            return false;
+        boost::unique_lock<boost::mutex> lock(wq.mutex);
+        std::deque<T>& checks = wq.checks[r];
+        if (checks.empty())
+            return false;
+        size_t nNow = std::max(1U, std::min(nBatchSize, nQueued / (2 * (WorkerQueues() + 1))));
+        nNow = std::min(nNow, fOwner ? checks.size() : (checks.size() + 1) / 2);
+        vChecks.resize(nNow);
+        for (T& check : vChecks) {
+            // Swap jobs out of the queue instead of copying them.
+            if (fOwner) {
+                check.swap(checks.back());
+                checks.pop_back();
+            } else {
+                check.swap(checks.front());
+                checks.pop_front();
+            }
+        }
+        wq.nSize[r] = checks.size();
+        nQueued -= nNow;
+        return true;
+    }
+
+    /** Take a batch of round r from our own queue, or else steal one from another queue. */
+    bool TakeOrSteal(size_t nOwn, unsigned int r, std::vector<T>& vChecks)
+    {
+        if (Take(*queues[nOwn], r, vChecks, true))
+            return true;
+        for (size_t i = 1; i < queues.size(); i++) {
+            if (Take(*queues[(nOwn + i) % queues.size()], r, vChecks, false))
+                return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        const size_t nOwn = fMaster ? 0 : 1 + nWorkers++ % (queues.size() - 1);
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
+            // The current round goes first. The master only helps with that
+            // one, so it can return as soon as it is done.
+            unsigned int r = nRound;
+            bool fTaken = TakeOrSteal(nOwn, r, vChecks);
+            if (!fTaken && !fMaster) {
+                r ^= 1;
+                fTaken = TakeOrSteal(nOwn, r, vChecks);
+            }
+            if (fTaken) {
                 // Check whether we need to do work at all
-                fOk = fAllOk;
+                bool fOk = fAllOk[r];
+                // execute work
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                const unsigned int nNow = vChecks.size();
+                vChecks.clear();
+                if (!fOk)
+                    fAllOk[r] = false;
+                if ((nTodo[r] -= nNow) == 0 && !fMaster) {
+                    // We processed the last element of a round; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
+                }
+                continue;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                // Everything has been taken; wait for the workers to finish
+                // their batches.
+                while (nTodo[r] != 0)
+                    condMaster.wait(lock);
+                bool fRet = fAllOk[r];
+                // reset the status for new work later
+                fAllOk[r] = true;
+                // the checks added for the next round are now the current ones
+                nRound = r ^ 1;
+                // return the current status
+                return fRet;
+            }
+            nIdle++;
+            while (nQueued == 0)
+                condWorker.wait(lock); // wait
+            nIdle--;
         } while (true);
     }
 
+    /** Add a batch of checks to round r. */
+    void Add(std::vector<T>& vChecks, unsigned int r)
+    {
+        if (vChecks.empty())
+            return;
+        nTodo[r] += vChecks.size();
+
+        // Spread the checks over the workers' queues, so that they rarely
+        // touch the same mutex. Without workers the master gets them all.
+        const unsigned int nQueues = WorkerQueues();
+        const size_t nChunk = nQueues ? (vChecks.size() + nQueues - 1) / nQueues : vChecks.size();
+        for (size_t nBegin = 0; nBegin < vChecks.size(); nBegin += nChunk) {
+            WorkQueue& wq = nQueues ? *queues[1 + nNextQueue++ % nQueues] : *queues[0];
+            const size_t nEnd = std::min(vChecks.size(), nBegin + nChunk);
+            boost::unique_lock<boost::mutex> lock(wq.mutex);
+            for (size_t i = nBegin; i < nEnd; i++) {
+                wq.checks[r].emplace_back();
+                wq.checks[r].back().swap(vChecks[i]);
+            }
+            wq.nSize[r] = wq.checks[r].size();
+            nQueued += nEnd - nBegin;
+        }
+
+        // Only wake up workers when some are asleep. A worker announces
+        // itself in nIdle before it checks nQueued, so either it sees the
+        // new checks or we see it.
+        if (nIdle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
+    }
+
 public:
     //! Mutex to ensure only one concurrent CCheckQueueControl
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nWorkers(0), nIdle(0), nNextQueue(0), nRound(0), nQueued(0), nBatchSize(nBatchSizeIn)
+    {
+        fAllOk[0] = fAllOk[1] = true;
+        nTodo[0] = nTodo[1] = 0;
+        // One queue for the master and one per core for the workers. Any
+        // further workers share queues.
+        queues.resize(1 + std::max(1U, boost::thread::hardware_concurrency()));
+        for (auto& wq : queues)
+            wq.reset(new WorkQueue());
+    }
 
     //! Worker thread
     void Thread()
@@ -136,7 +260,7 @@ public:
         Loop();
     }
 
-    //! Wait until execution finishes, and return whether all evaluations were successful.
+    //! Wait until execution of the current round finishes, and return whether all evaluations were successful.
     bool Wait()
     {
         return Loop(true);
@@ -145,16 +269,13 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        Add(vChecks, nRound);
+    }
+
+    //! Add a batch of checks to be processed once the current ones are taken, and waited for in the next round
+    void AddDeferred(std::vector<T>& vChecks)
+    {
+        Add(vChecks, nRound ^ 1);
     }
 
     ~CCheckQueue()
@@ -201,6 +322,18 @@ public:
             pqueue->Add(vChecks);
     }
 
+    /**
+     * Add checks that this control does not wait for. They are processed
+     * when the workers run out of other work, and the next
+     * CCheckQueueControl of the queue waits for them and includes their
+     * results, so whatever they reference has to live until then.
+     */
+    void AddDeferred(std::vector<T>& vChecks)
+    {
+        if (pqueue != nullptr)
+            pqueue->AddDeferred(vChecks);
+    }
+
     ~CCheckQueueControl()
     {
         if (!fDone)
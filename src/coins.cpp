@@ -31,7 +31,9 @@ size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn),
+    cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &m_cache_coins_memory_resource),
+    cachedCoinsUsage(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -80,6 +82,7 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
         fresh = !(it->second.flags & CCoinsCacheEntry::DIRTY);
     }
     it->second.coin = std::move(coin);
+    it->second.flags &= ~CCoinsCacheEntry::SYNCING;
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
@@ -105,6 +108,7 @@ bool CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout) {
     if (it->second.flags & CCoinsCacheEntry::FRESH) {
         cacheCoins.erase(it);
     } else {
+        it->second.flags &= ~CCoinsCacheEntry::SYNCING;
         it->second.flags |= CCoinsCacheEntry::DIRTY;
         it->second.coin.Clear();
     }
@@ -187,6 +191,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
                 itUs->second.coin = std::move(it->second.coin);
                 cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
+                itUs->second.flags &= ~CCoinsCacheEntry::SYNCING;
                 itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 // NOTE: It is possible the child has a FRESH flag here in
                 // the event the entry we found in the parent is pruned. But
@@ -201,12 +206,74 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
 }
 
 bool CCoinsViewCache::Flush() {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    // The pool keeps every chunk it allocated; hand them back so the memory
+    // is really available again after a flush.
+    ReallocateCache();
     return fOk;
 }
 
+bool CCoinsViewCache::Sync(CCriticalSection* cs) {
+    // The base consumes the map it is given, so hand it copies of the
+    // modified entries. Those are no longer fresh once the base has them,
+    // and are marked so that a change during the write can be told apart.
+    CCoinsMapMemoryResource resource;
+    CCoinsMap mapDirty(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
+    for (auto& entry : cacheCoins) {
+        if (entry.second.flags & CCoinsCacheEntry::DIRTY) {
+            entry.second.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::SYNCING;
+            mapDirty.insert(entry);
+        }
+    }
+    const uint256 hashBlockSync = hashBlock;
+
+    bool fOk;
+    {
+        // Take the write lock before letting go of cs, so that a Flush()
+        // started meanwhile cannot reach the base before this older state.
+        std::unique_lock<std::mutex> lock(m_write_mutex);
+        if (cs) LEAVE_CRITICAL_SECTION(*cs);
+        try {
+            fOk = base->BatchWrite(mapDirty, hashBlockSync);
+        } catch (...) {
+            lock.unlock();
+            if (cs) ENTER_CRITICAL_SECTION(*cs);
+            throw;
+        }
+        lock.unlock();
+        if (cs) ENTER_CRITICAL_SECTION(*cs);
+    }
+    if (!fOk) return false;
+
+    // The base now has every entry that was not modified during the write:
+    // spent coins can go, and the others are neither dirty nor fresh anymore.
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (!(it->second.flags & CCoinsCacheEntry::SYNCING)) {
+            ++it;
+        } else if (it->second.coin.IsSpent()) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+        } else {
+            it->second.flags = 0;
+            ++it;
+        }
+    }
+    return true;
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    // Cache should be empty when we're calling this.
+    assert(cacheCoins.size() == 0);
+    cacheCoins.~CCoinsMap();
+    m_cache_coins_memory_resource.~CCoinsMapMemoryResource();
+    ::new (&m_cache_coins_memory_resource) CCoinsMapMemoryResource();
+    ::new (&cacheCoins) CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &m_cache_coins_memory_resource);
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -12,12 +12,16 @@
 #include <hash.h>
 #include <memusage.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
+#include <sync.h>
 #include <uint256.h>
 #include <chainparams.h>
 
 #include <assert.h>
 #include <stdint.h>
 
+#include <functional>
+#include <mutex>
 #include <unordered_map>
 
 /**
@@ -125,13 +129,34 @@ struct CCoinsCacheEntry
          * flush the changes to the parent cache.  It is always safe to
          * not mark FRESH if that condition is not guaranteed.
          */
+        SYNCING = (1 << 2), // Sync() is writing this entry to the parent view; any modification clears it.
     };
 
     CCoinsCacheEntry() : flags(0) {}
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * PoolAllocator's MAX_BLOCK_SIZE_BYTES parameter here uses sizeof the data, and adds the size
+ * of 4 pointers. We do not know the exact node size used in the std::unordered_node implementation
+ * because it is implementation defined. Most implementations have an overhead of 1 or 2 pointers,
+ * so nodes can be connected in a linked list, and in some cases the hash value is stored as well.
+ * Using an additional sizeof(void*)*4 for MAX_BLOCK_SIZE_BYTES should thus be sufficient so that
+ * all implementations can allocate the nodes from the PoolAllocator.
+ *
+ * Allocating the nodes from chunks instead of one by one from the heap saves
+ * the per-allocation overhead of malloc, so more coins fit in -dbcache, and
+ * keeps nodes that were inserted together close to each other in memory.
+ */
+typedef std::unordered_map<COutPoint,
+                           CCoinsCacheEntry,
+                           SaltedOutpointHasher,
+                           std::equal_to<COutPoint>,
+                           PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                                         sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4>>
+    CCoinsMap;
+
+typedef CCoinsMap::allocator_type::ResourceType CCoinsMapMemoryResource;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -218,11 +243,15 @@ protected:
      * declared as "const".  
      */
     mutable uint256 hashBlock;
+    mutable CCoinsMapMemoryResource m_cache_coins_memory_resource{};
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Held while writing to the base, so that a Flush() cannot interleave with a Sync(). */
+    std::mutex m_write_mutex;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -280,6 +309,19 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base, like Flush(),
+     * but keep the unspent coins cached. Only the modified entries are
+     * written, so calling this often spreads the writes out instead of
+     * leaving them all to the next Flush().
+     * If cs is given, it must be the lock guarding this cache, held exactly
+     * once by the caller: the modified entries are copied with it held, and
+     * it is released while they are written. Entries modified in the
+     * meantime stay dirty. Only one Sync() may run at a time.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync(CCriticalSection* cs = nullptr);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -305,6 +347,11 @@ public:
     //! Check whether all prevouts of the transaction are present in the UTXO set represented by this view
     bool HaveInputs(const CTransaction& tx) const;
 
+    //! Force a reallocation of the cache map. This is required when downsizing
+    //! the cache because the map's allocator may be hanging onto a lot of
+    //! memory despite having called .clear().
+    void ReallocateCache();
+
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
 };
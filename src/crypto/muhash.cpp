@@ -0,0 +1,167 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <assert.h>
+#include <string.h>
+
+namespace {
+
+/** The modulus is 2^3072 - MAX_PRIME_DIFF. */
+const uint32_t MAX_PRIME_DIFF = 1103717;
+
+} // namespace
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (size_t i = 0; i < LIMBS; ++i) {
+        limbs[i] = ReadLE32(data + 4 * i);
+    }
+    // Values of 2^3072 - MAX_PRIME_DIFF and up are vanishingly unlikely, but
+    // each number must have one representation for ToBytes to be canonical.
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (size_t i = 1; i < LIMBS; ++i) {
+        limbs[i] = 0;
+    }
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] < (uint32_t)(0 - MAX_PRIME_DIFF)) return false;
+    for (size_t i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != 0xffffffff) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Adding MAX_PRIME_DIFF and dropping the 2^3072 bit subtracts the modulus.
+    uint64_t carry = MAX_PRIME_DIFF;
+    for (size_t i = 0; i < LIMBS; ++i) {
+        carry += limbs[i];
+        limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook multiplication into 6144 bits.
+    uint32_t product[2 * LIMBS] = {0};
+    for (size_t i = 0; i < LIMBS; ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < LIMBS; ++j) {
+            carry += (uint64_t)limbs[i] * a.limbs[j] + product[i + j];
+            product[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        product[i + LIMBS] = (uint32_t)carry;
+    }
+
+    // 2^3072 is congruent to MAX_PRIME_DIFF, so fold the high half onto the
+    // low half, and the few bits that overflow that once more.
+    uint64_t carry = 0;
+    for (size_t i = 0; i < LIMBS; ++i) {
+        carry += (uint64_t)product[i + LIMBS] * MAX_PRIME_DIFF + product[i];
+        limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    while (carry) {
+        uint64_t high = carry * MAX_PRIME_DIFF;
+        carry = 0;
+        for (size_t i = 0; i < LIMBS && (high || carry); ++i) {
+            carry += (uint64_t)limbs[i] + (uint32_t)high;
+            high >>= 32;
+            limbs[i] = (uint32_t)carry;
+            carry >>= 32;
+        }
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // By Fermat's little theorem, the inverse is this^(p - 2), where the
+    // exponent p - 2 = 2^3072 - MAX_PRIME_DIFF - 2 has all bits above the
+    // lowest limb set.
+    const uint32_t low_limb = (uint32_t)(0 - MAX_PRIME_DIFF - 2);
+    Num3072 result;
+    for (int bit = LIMBS * 32 - 1; bit >= 0; --bit) {
+        result.Multiply(result);
+        if (bit >= 32 || ((low_limb >> bit) & 1)) {
+            result.Multiply(*this);
+        }
+    }
+    return result;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (size_t i = 0; i < LIMBS; ++i) {
+        WriteLE32(out + 4 * i, limbs[i]);
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    ChaCha20(hash, sizeof(hash)).Output(bytes, sizeof(bytes));
+    return Num3072(bytes);
+}
+
+MuHash3072::MuHash3072(const unsigned char* data, size_t len) : numerator(ToNum3072(data, len)) {}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char (&out)[32])
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    numerator.ToBytes(bytes);
+    CSHA256().Write(bytes, sizeof(bytes)).Finalize(out);
+}
@@ -122,6 +122,7 @@ public:
  *
  *  Read Operations:
  *      - contains(*, false)
+ *      - for_each()
  *
  *  Read+Erase Operations:
  *      - contains(*, true)
@@ -475,6 +476,21 @@ public:
             }
         return false;
     }
+
+    /** for_each calls f on every element that hasn't been erased, those of
+     * the older epoch first, so that inserting them into another cache in
+     * the same order keeps the most recent ones when it runs out of space.
+     *
+     * @param f a callable taking a const Element&
+     */
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (bool epoch : {false, true})
+            for (uint32_t i = 0; i < size; ++i)
+                if (epoch_flags[i] == epoch && !collection_flags.bit_is_set(i))
+                    f(table[i]);
+    }
 };
 } // namespace CuckooCache
 
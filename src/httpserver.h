@@ -114,6 +114,12 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Append to the body of the reply, ahead of WriteReply, so that a large
+     * body can be handed over as it is produced instead of in one string.
+     */
+    void WriteReplyPart(const std::string& strPart);
 };
 
 /** Event handler closure.
@@ -0,0 +1,329 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <dbwrapper.h>
+#include <index/addressindex.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+static const char DB_ADDRESS_HISTORY = 'a';
+static const char DB_ADDRESS_UNSPENT = 'u';
+static const char DB_ADDRESS_BALANCE = 'b';
+static const char DB_BEST_BLOCK = 'B';
+
+std::unique_ptr<AddressIndex> g_addressindex;
+
+namespace {
+
+class CIndexedAddressVisitor : public boost::static_visitor<bool>
+{
+private:
+    CIndexedAddress* address;
+
+public:
+    explicit CIndexedAddressVisitor(CIndexedAddress* addressIn) : address(addressIn) {}
+
+    bool operator()(const CNoDestination& dest) const { return false; }
+    bool operator()(const WitnessUnknown& dest) const { return false; }
+
+    bool operator()(const CKeyID& keyID) const { return Set(ADDRESS_INDEX_P2PKH, keyID.begin(), keyID.size()); }
+    bool operator()(const CScriptID& scriptID) const { return Set(ADDRESS_INDEX_P2SH, scriptID.begin(), scriptID.size()); }
+    bool operator()(const WitnessV0KeyHash& id) const { return Set(ADDRESS_INDEX_P2WPKH, id.begin(), id.size()); }
+    bool operator()(const WitnessV0ScriptHash& id) const { return Set(ADDRESS_INDEX_P2WSH, id.begin(), id.size()); }
+
+private:
+    bool Set(uint8_t type, const unsigned char* data, size_t size) const
+    {
+        address->type = type;
+        address->hash.SetNull();
+        memcpy(address->hash.begin(), data, size);
+        return true;
+    }
+};
+
+} // namespace
+
+bool GetIndexedAddress(const CTxDestination& dest, CIndexedAddress& address)
+{
+    return boost::apply_visitor(CIndexedAddressVisitor(&address), dest);
+}
+
+bool GetIndexedAddress(const CScript& script, CIndexedAddress& address)
+{
+    CTxDestination dest;
+    return ExtractDestination(script, dest) && GetIndexedAddress(dest, address);
+}
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<CDBWrapper>(GetDataDir() / "indexes" / "addressindex", n_cache_size, f_memory, f_wipe))
+{}
+
+AddressIndex::~AddressIndex() {}
+
+bool AddressIndex::ReadBestBlock(CBlockLocator& locator) const
+{
+    return m_db->Read(DB_BEST_BLOCK, locator);
+}
+
+CAddressBalance AddressIndex::GetBalance(const CIndexedAddress& address) const
+{
+    AssertLockHeld(cs_pending);
+
+    CAddressBalance balance;
+    auto it = m_pending_balance.find(address);
+    if (it != m_pending_balance.end()) {
+        balance = it->second;
+    } else {
+        m_db->Read(std::make_pair(DB_ADDRESS_BALANCE, address), balance);
+    }
+    return balance;
+}
+
+bool AddressIndex::ApplyBlock(const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fUndo)
+{
+    AssertLockHeld(cs_pending);
+
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: undo data does not match block at height %d", __func__, nHeight);
+    }
+
+    // Reverting walks the block backwards, so that outputs created and spent
+    // within the block are removed from the unspent set again.
+    for (size_t n = 0; n < block.vtx.size(); n++) {
+        const size_t i = fUndo ? block.vtx.size() - 1 - n : n;
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        for (uint32_t k = 0; k < tx.vout.size(); k++) {
+            const CTxOut& out = tx.vout[k];
+            CIndexedAddress address;
+            if (!GetIndexedAddress(out.scriptPubKey, address)) continue;
+
+            CAddressIndexKey key(address, nHeight, i, txid, k, false);
+            CAddressUnspentKey unspent_key(address, txid, k);
+            CAddressBalance balance = GetBalance(address);
+            if (fUndo) {
+                m_pending_history[key] = boost::none;
+                m_pending_unspent[unspent_key] = boost::none;
+                balance.nBalance -= out.nValue;
+                balance.nReceived -= out.nValue;
+            } else {
+                m_pending_history[key] = out.nValue;
+                m_pending_unspent[unspent_key] = CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight);
+                balance.nBalance += out.nValue;
+                balance.nReceived += out.nValue;
+            }
+            m_pending_balance[address] = balance;
+        }
+
+        if (tx.IsCoinBase()) continue;
+
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size()) {
+            return error("%s: undo data does not match transaction %s", __func__, txid.ToString());
+        }
+        for (uint32_t j = 0; j < tx.vin.size(); j++) {
+            const Coin& coin = txundo.vprevout[j];
+            CIndexedAddress address;
+            if (!GetIndexedAddress(coin.out.scriptPubKey, address)) continue;
+
+            const COutPoint& prevout = tx.vin[j].prevout;
+            CAddressIndexKey key(address, nHeight, i, txid, j, true);
+            CAddressUnspentKey unspent_key(address, prevout.hash, prevout.n);
+            CAddressBalance balance = GetBalance(address);
+            if (fUndo) {
+                m_pending_history[key] = boost::none;
+                m_pending_unspent[unspent_key] = CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight);
+                balance.nBalance += coin.out.nValue;
+            } else {
+                m_pending_history[key] = -coin.out.nValue;
+                m_pending_unspent[unspent_key] = boost::none;
+                balance.nBalance -= coin.out.nValue;
+            }
+            m_pending_balance[address] = balance;
+        }
+    }
+    return true;
+}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo blockundo;
+    if (pindex->pprev && !UndoReadFromDisk(blockundo, pindex)) {
+        return false;
+    }
+
+    LOCK(cs_pending);
+    return ApplyBlock(block, blockundo, pindex->nHeight, false);
+}
+
+bool AddressIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        CBlockUndo blockundo;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params) || !UndoReadFromDisk(blockundo, pindex)) {
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+
+        LOCK(cs_pending);
+        if (!ApplyBlock(block, blockundo, pindex->nHeight, true)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t AddressIndex::GetPendingCount() const
+{
+    LOCK(cs_pending);
+    return m_pending_history.size() + m_pending_unspent.size() + m_pending_balance.size();
+}
+
+bool AddressIndex::CommitInternal(const CBlockLocator& locator)
+{
+    LOCK(cs_commit);
+
+    std::vector<std::pair<CAddressIndexKey, boost::optional<CAmount>>> history;
+    std::vector<std::pair<CAddressUnspentKey, boost::optional<CAddressUnspentValue>>> unspent;
+    std::vector<std::pair<CIndexedAddress, CAddressBalance>> balances;
+    {
+        LOCK(cs_pending);
+        history.assign(m_pending_history.begin(), m_pending_history.end());
+        unspent.assign(m_pending_unspent.begin(), m_pending_unspent.end());
+        balances.assign(m_pending_balance.begin(), m_pending_balance.end());
+    }
+
+    CDBBatch batch(*m_db);
+    for (const auto& entry : history) {
+        if (entry.second) {
+            batch.Write(std::make_pair(DB_ADDRESS_HISTORY, entry.first), *entry.second);
+        } else {
+            batch.Erase(std::make_pair(DB_ADDRESS_HISTORY, entry.first));
+        }
+    }
+    for (const auto& entry : unspent) {
+        if (entry.second) {
+            batch.Write(std::make_pair(DB_ADDRESS_UNSPENT, entry.first), *entry.second);
+        } else {
+            batch.Erase(std::make_pair(DB_ADDRESS_UNSPENT, entry.first));
+        }
+    }
+    for (const auto& entry : balances) {
+        batch.Write(std::make_pair(DB_ADDRESS_BALANCE, entry.first), entry.second);
+    }
+    batch.Write(DB_BEST_BLOCK, locator);
+    if (!m_db->WriteBatch(batch)) {
+        return error("%s: failed to write %u address index entries", __func__,
+                     history.size() + unspent.size() + balances.size());
+    }
+
+    // Entries changed by blocks indexed in the meantime stay pending.
+    LOCK(cs_pending);
+    for (const auto& entry : history) {
+        auto it = m_pending_history.find(entry.first);
+        if (it != m_pending_history.end() && it->second == entry.second) m_pending_history.erase(it);
+    }
+    for (const auto& entry : unspent) {
+        auto it = m_pending_unspent.find(entry.first);
+        if (it != m_pending_unspent.end() && it->second == entry.second) m_pending_unspent.erase(it);
+    }
+    for (const auto& entry : balances) {
+        auto it = m_pending_balance.find(entry.first);
+        if (it != m_pending_balance.end() && it->second == entry.second) m_pending_balance.erase(it);
+    }
+    return true;
+}
+
+bool AddressIndex::FindHistory(const CIndexedAddress& address, std::vector<std::pair<CAddressIndexKey, CAmount>>& entries,
+                               int nStartHeight, int nEndHeight) const
+{
+    LOCK(cs_commit);
+
+    std::map<CAddressIndexKey, CAmount> result;
+    const CAddressIndexKey begin(address, std::max(nStartHeight, 0));
+
+    std::unique_ptr<CDBIterator> pcursor(m_db->NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESS_HISTORY, begin));
+    while (pcursor->Valid()) {
+        std::pair<char, CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESS_HISTORY ||
+            key.second.address != address || key.second.nHeight > nEndHeight) {
+            break;
+        }
+        CAmount value;
+        if (!pcursor->GetValue(value)) {
+            return error("%s: failed to read address index entry", __func__);
+        }
+        result.emplace(key.second, value);
+        pcursor->Next();
+    }
+
+    {
+        LOCK(cs_pending);
+        for (auto it = m_pending_history.lower_bound(begin);
+             it != m_pending_history.end() && it->first.address == address && it->first.nHeight <= nEndHeight; ++it) {
+            if (it->second) {
+                result[it->first] = *it->second;
+            } else {
+                result.erase(it->first);
+            }
+        }
+    }
+
+    entries.assign(result.begin(), result.end());
+    return true;
+}
+
+bool AddressIndex::FindUnspent(const CIndexedAddress& address, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent) const
+{
+    LOCK(cs_commit);
+
+    std::map<CAddressUnspentKey, CAddressUnspentValue> result;
+    const CAddressUnspentKey begin(address);
+
+    std::unique_ptr<CDBIterator> pcursor(m_db->NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESS_UNSPENT, begin));
+    while (pcursor->Valid()) {
+        std::pair<char, CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESS_UNSPENT || key.second.address != address) {
+            break;
+        }
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value)) {
+            return error("%s: failed to read address index entry", __func__);
+        }
+        result.emplace(key.second, value);
+        pcursor->Next();
+    }
+
+    {
+        LOCK(cs_pending);
+        for (auto it = m_pending_unspent.lower_bound(begin);
+             it != m_pending_unspent.end() && it->first.address == address; ++it) {
+            if (it->second) {
+                result[it->first] = *it->second;
+            } else {
+                result.erase(it->first);
+            }
+        }
+    }
+
+    unspent.assign(result.begin(), result.end());
+    return true;
+}
+
+bool AddressIndex::FindBalance(const CIndexedAddress& address, CAddressBalance& balance) const
+{
+    LOCK2(cs_commit, cs_pending);
+    balance = GetBalance(address);
+    return true;
+}
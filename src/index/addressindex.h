@@ -0,0 +1,247 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_ADDRESSINDEX_H
+#define BITCOIN_INDEX_ADDRESSINDEX_H
+
+#include <amount.h>
+#include <index/base.h>
+#include <script/script.h>
+#include <script/standard.h>
+#include <serialize.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <boost/optional.hpp>
+
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
+
+class CBlockUndo;
+class CDBWrapper;
+
+/** Kinds of output scripts that the address index can look up. */
+enum AddressIndexType : uint8_t
+{
+    ADDRESS_INDEX_NONE = 0,
+    ADDRESS_INDEX_P2PKH = 1,  //!< also covers pay-to-pubkey outputs
+    ADDRESS_INDEX_P2SH = 2,
+    ADDRESS_INDEX_P2WPKH = 3,
+    ADDRESS_INDEX_P2WSH = 4,
+};
+
+/** An indexed address: its kind and hash, with 160-bit hashes zero-extended. */
+struct CIndexedAddress
+{
+    uint8_t type;
+    uint256 hash;
+
+    CIndexedAddress() : type(ADDRESS_INDEX_NONE) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(type);
+        READWRITE(hash);
+    }
+
+    bool IsNull() const { return type == ADDRESS_INDEX_NONE; }
+
+    friend bool operator==(const CIndexedAddress& a, const CIndexedAddress& b) { return a.type == b.type && a.hash == b.hash; }
+    friend bool operator!=(const CIndexedAddress& a, const CIndexedAddress& b) { return !(a == b); }
+    friend bool operator<(const CIndexedAddress& a, const CIndexedAddress& b) { return a.type < b.type || (a.type == b.type && a.hash < b.hash); }
+};
+
+/** Map an output script to the address it pays to, if it is of an indexed kind. */
+bool GetIndexedAddress(const CScript& script, CIndexedAddress& address);
+bool GetIndexedAddress(const CTxDestination& dest, CIndexedAddress& address);
+
+/**
+ * One credit or debit of an address. The height and the position of the
+ * transaction in its block are serialized big-endian, so that the entries of
+ * an address are stored in chain order and height ranges can be read with a
+ * single seek.
+ */
+struct CAddressIndexKey
+{
+    CIndexedAddress address;
+    int nHeight;
+    uint32_t nTxIndex;
+    uint256 txid;
+    uint32_t nIndex;     //!< output index for credits, input index for debits
+    bool fSpending;
+
+    CAddressIndexKey() : nHeight(0), nTxIndex(0), nIndex(0), fSpending(false) {}
+    CAddressIndexKey(const CIndexedAddress& addressIn, int nHeightIn, uint32_t nTxIndexIn = 0,
+                     const uint256& txidIn = uint256(), uint32_t nIndexIn = 0, bool fSpendingIn = false)
+        : address(addressIn), nHeight(nHeightIn), nTxIndex(nTxIndexIn), txid(txidIn), nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        ::Serialize(s, address);
+        ser_writedata32be(s, nHeight);
+        ser_writedata32be(s, nTxIndex);
+        ::Serialize(s, txid);
+        ::Serialize(s, nIndex);
+        ::Serialize(s, fSpending);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        ::Unserialize(s, address);
+        nHeight = ser_readdata32be(s);
+        nTxIndex = ser_readdata32be(s);
+        ::Unserialize(s, txid);
+        ::Unserialize(s, nIndex);
+        ::Unserialize(s, fSpending);
+    }
+
+    friend bool operator<(const CAddressIndexKey& a, const CAddressIndexKey& b) {
+        if (a.address != b.address) return a.address < b.address;
+        if (a.nHeight != b.nHeight) return a.nHeight < b.nHeight;
+        if (a.nTxIndex != b.nTxIndex) return a.nTxIndex < b.nTxIndex;
+        if (a.txid != b.txid) return a.txid < b.txid;
+        if (a.nIndex != b.nIndex) return a.nIndex < b.nIndex;
+        return a.fSpending < b.fSpending;
+    }
+};
+
+/** An unspent output paying to an address. */
+struct CAddressUnspentKey
+{
+    CIndexedAddress address;
+    uint256 txid;
+    uint32_t nIndex;
+
+    CAddressUnspentKey() : nIndex(0) {}
+    CAddressUnspentKey(const CIndexedAddress& addressIn, const uint256& txidIn = uint256(), uint32_t nIndexIn = 0)
+        : address(addressIn), txid(txidIn), nIndex(nIndexIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(address);
+        READWRITE(txid);
+        READWRITE(nIndex);
+    }
+
+    friend bool operator<(const CAddressUnspentKey& a, const CAddressUnspentKey& b) {
+        if (a.address != b.address) return a.address < b.address;
+        if (a.txid != b.txid) return a.txid < b.txid;
+        return a.nIndex < b.nIndex;
+    }
+};
+
+struct CAddressUnspentValue
+{
+    CAmount nValue;
+    CScript script;
+    int nHeight;
+
+    CAddressUnspentValue() : nValue(0), nHeight(0) {}
+    CAddressUnspentValue(CAmount nValueIn, const CScript& scriptIn, int nHeightIn)
+        : nValue(nValueIn), script(scriptIn), nHeight(nHeightIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nValue);
+        READWRITE(*(CScriptBase*)(&script));
+        READWRITE(nHeight);
+    }
+
+    friend bool operator==(const CAddressUnspentValue& a, const CAddressUnspentValue& b) {
+        return a.nValue == b.nValue && a.script == b.script && a.nHeight == b.nHeight;
+    }
+};
+
+/** Running totals of an address, so that balance queries do not depend on
+ *  the length of its history. */
+struct CAddressBalance
+{
+    CAmount nBalance;
+    CAmount nReceived;
+
+    CAddressBalance() : nBalance(0), nReceived(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nBalance);
+        READWRITE(nReceived);
+    }
+
+    friend bool operator==(const CAddressBalance& a, const CAddressBalance& b) {
+        return a.nBalance == b.nBalance && a.nReceived == b.nReceived;
+    }
+};
+
+/**
+ * AddressIndex records, for every address, the outputs paying to it and the
+ * inputs spending from it, its unspent outputs and its balance. It lives in
+ * its own database (indexes/addressindex/) and is rolled back from the undo
+ * data when blocks are disconnected.
+ */
+class AddressIndex final : public BaseIndex
+{
+private:
+    const std::unique_ptr<CDBWrapper> m_db;
+
+    mutable CCriticalSection cs_pending;
+
+    /// Changes of indexed blocks that have not been committed to disk yet;
+    /// an empty value erases the entry.
+    std::map<CAddressIndexKey, boost::optional<CAmount>> m_pending_history;
+    std::map<CAddressUnspentKey, boost::optional<CAddressUnspentValue>> m_pending_unspent;
+    std::map<CIndexedAddress, CAddressBalance> m_pending_balance;
+
+    /// Held by commits and by queries, so that a query never sees entries
+    /// move from the pending maps to disk halfway through.
+    mutable CCriticalSection cs_commit;
+
+    CAddressBalance GetBalance(const CIndexedAddress& address) const;
+
+    /// Apply (or with fUndo, revert) the entries of a block to the pending maps.
+    bool ApplyBlock(const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fUndo);
+
+protected:
+    bool ReadBestBlock(CBlockLocator& locator) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    size_t GetPendingCount() const override;
+
+    bool CommitInternal(const CBlockLocator& locator) override;
+
+    const char* GetName() const override { return "addressindex"; }
+
+public:
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    ~AddressIndex() override;
+
+    /// Credits and debits of an address between two heights (inclusive), in
+    /// chain order.
+    bool FindHistory(const CIndexedAddress& address, std::vector<std::pair<CAddressIndexKey, CAmount>>& entries,
+                     int nStartHeight = 0, int nEndHeight = std::numeric_limits<int>::max()) const;
+
+    /// Unspent outputs paying to an address.
+    bool FindUnspent(const CIndexedAddress& address, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent) const;
+
+    /// Current balance and total amount received by an address.
+    bool FindBalance(const CIndexedAddress& address, CAddressBalance& balance) const;
+};
+
+/// The global address index, used by the getaddress* RPCs. May be null.
+extern std::unique_ptr<AddressIndex> g_addressindex;
+
+#endif // BITCOIN_INDEX_ADDRESSINDEX_H
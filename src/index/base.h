@@ -0,0 +1,124 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BASE_H
+#define BITCOIN_INDEX_BASE_H
+
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <threadinterrupt.h>
+#include <uint256.h>
+#include <validationinterface.h>
+
+#include <atomic>
+#include <thread>
+
+class CBlockIndex;
+struct CBlockLocator;
+
+/**
+ * Base class for indices of blockchain data. This implements
+ * CValidationInterface and ensures blocks are indexed sequentially according
+ * to their position in the active chain.
+ *
+ * Indices are built on a background thread from their last committed best
+ * block, so they can be enabled on an existing node without a reindex, and
+ * are kept up to date from BlockConnected notifications afterwards. Writes
+ * are buffered by the implementation and committed together with the best
+ * block locator, so a crash never leaves an index claiming more than it has
+ * written.
+ */
+class BaseIndex : public CValidationInterface
+{
+private:
+    /// Whether the index is in sync with the main chain. The flag is flipped
+    /// from false to true once, after which point this starts processing
+    /// ValidationInterface notifications to stay in sync.
+    std::atomic<bool> m_synced{false};
+
+    /// The last block in the chain that the index is in sync with.
+    std::atomic<const CBlockIndex*> m_best_block_index{nullptr};
+
+    /// Height of the last block whose entries are on disk, or -1.
+    std::atomic<int> m_committed_height{-1};
+
+    std::thread m_thread_sync;
+    CThreadInterrupt m_interrupt;
+
+    /// Sync the index with the block index starting from the current best block.
+    /// Intended to be run in its own thread, m_thread_sync, and can be
+    /// interrupted with m_interrupt. Once the index gets in sync, the m_synced
+    /// flag is set and the BlockConnected ValidationInterface callback takes
+    /// over and the sync thread exits.
+    void ThreadSync();
+
+    /// Commit all buffered index entries together with a locator of the
+    /// given block.
+    bool Commit(const CBlockIndex* block_index);
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex,
+                        const std::vector<CTransactionRef>& txn_conflicted) override;
+
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override;
+
+    void SetBestChain(const CBlockLocator& locator) override;
+
+    /// Initialize internal state from the database and block index.
+    virtual bool Init();
+
+    /// Read the locator of the last block whose entries have been committed.
+    virtual bool ReadBestBlock(CBlockLocator& locator) const = 0;
+
+    /// Buffer the index entries for a newly connected block.
+    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) = 0;
+
+    /// Rewind the index from current_tip to new_tip, an ancestor of it, when
+    /// blocks are disconnected. The default keeps the entries of disconnected
+    /// blocks, so a lookup may return data of a block that is no longer in
+    /// the active chain; callers have to check it against the block they
+    /// expect.
+    virtual bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip);
+
+    /// Number of buffered index entries not yet committed to disk.
+    virtual size_t GetPendingCount() const = 0;
+
+    /// Atomically write all buffered entries and the best block locator.
+    virtual bool CommitInternal(const CBlockLocator& locator) = 0;
+
+    /// Get the name of the index for display in logs.
+    virtual const char* GetName() const = 0;
+
+public:
+    /// Destructor interrupts sync thread if running and blocks until it exits.
+    /// Buffered entries are only committed by an explicit Stop().
+    virtual ~BaseIndex();
+
+    /// Whether the background sync thread has caught up with the active chain.
+    bool IsSynced() const { return m_synced; }
+
+    /// Blocks the current thread until the index is caught up to the current
+    /// state of the block chain. This only blocks if the index has gotten in
+    /// sync once and only needs to process blocks in the ValidationInterface
+    /// queue. If the index is catching up from far behind, this method does
+    /// not block and immediately returns false.
+    bool BlockUntilSyncedToCurrentChain();
+
+    /// Height of the last block whose entries have been committed, or -1.
+    /// After a restart the index resumes from there, so block files above it
+    /// must not be pruned.
+    int GetCommittedHeight() const { return m_committed_height; }
+
+    void Interrupt();
+
+    /// Start initializes the sync state and registers the instance as a
+    /// ValidationInterface so that it stays in sync with blockchain updates.
+    void Start();
+
+    /// Stops the instance from staying in sync with blockchain updates and
+    /// commits any buffered entries.
+    void Stop();
+};
+
+#endif // BITCOIN_INDEX_BASE_H
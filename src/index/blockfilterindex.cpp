@@ -0,0 +1,182 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dbwrapper.h>
+#include <index/blockfilterindex.h>
+#include <util.h>
+#include <validation.h>
+
+static const char DB_BLOCK_FILTER = 'f';
+static const char DB_BEST_BLOCK = 'B';
+
+std::unique_ptr<BlockFilterIndex> g_blockfilterindex;
+
+BlockFilterIndex::BlockFilterIndex(BlockFilterType filter_type,
+                                   size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_filter_type(filter_type),
+      m_name(BlockFilterTypeName(filter_type) + " block filter index"),
+      m_db(MakeUnique<CDBWrapper>(GetDataDir() / "indexes" / "blockfilter" / BlockFilterTypeName(filter_type),
+                                  n_cache_size, f_memory, f_wipe))
+{
+    assert(!BlockFilterTypeName(filter_type).empty());
+}
+
+BlockFilterIndex::~BlockFilterIndex() {}
+
+bool BlockFilterIndex::ReadBestBlock(CBlockLocator& locator) const
+{
+    return m_db->Read(DB_BEST_BLOCK, locator);
+}
+
+bool BlockFilterIndex::ReadEntry(const uint256& block_hash, CBlockFilterEntry& entry) const
+{
+    {
+        LOCK(cs_pending);
+        auto it = m_pending.find(block_hash);
+        if (it != m_pending.end()) {
+            entry = it->second;
+            return true;
+        }
+    }
+    return m_db->Read(std::make_pair(DB_BLOCK_FILTER, block_hash), entry);
+}
+
+bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    uint256 prev_header;
+
+    if (pindex->pprev) {
+        // The genesis block has no undo data.
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+
+        CBlockFilterEntry prev_entry;
+        if (!ReadEntry(pindex->pprev->GetBlockHash(), prev_entry)) {
+            return error("%s: cannot read filter of previous block %s", __func__,
+                         pindex->pprev->GetBlockHash().ToString());
+        }
+        prev_header = prev_entry.header;
+    }
+
+    BlockFilter filter(m_filter_type, block, block_undo);
+
+    CBlockFilterEntry entry;
+    entry.hash = filter.GetHash();
+    entry.header = filter.ComputeHeader(prev_header);
+    entry.encoded = filter.GetEncodedFilter();
+
+    LOCK(cs_pending);
+    m_pending[pindex->GetBlockHash()] = std::move(entry);
+    return true;
+}
+
+size_t BlockFilterIndex::GetPendingCount() const
+{
+    LOCK(cs_pending);
+    return m_pending.size();
+}
+
+bool BlockFilterIndex::CommitInternal(const CBlockLocator& locator)
+{
+    LOCK(cs_commit);
+
+    std::vector<std::pair<uint256, CBlockFilterEntry>> entries;
+    {
+        LOCK(cs_pending);
+        entries.assign(m_pending.begin(), m_pending.end());
+    }
+
+    CDBBatch batch(*m_db);
+    for (const auto& entry : entries) {
+        batch.Write(std::make_pair(DB_BLOCK_FILTER, entry.first), entry.second);
+    }
+    batch.Write(DB_BEST_BLOCK, locator);
+    if (!m_db->WriteBatch(batch)) {
+        return error("%s: failed to write %u block filters", __func__, entries.size());
+    }
+
+    // A block's filter never changes, so everything written can be dropped.
+    LOCK(cs_pending);
+    for (const auto& entry : entries) {
+        m_pending.erase(entry.first);
+    }
+    return true;
+}
+
+bool BlockFilterIndex::LookupRange(int start_height, const CBlockIndex* stop_index,
+                                   std::vector<std::pair<uint256, CBlockFilterEntry>>& entries) const
+{
+    if (start_height < 0) {
+        return error("%s: start height (%d) is negative", __func__, start_height);
+    }
+    if (start_height > stop_index->nHeight) {
+        return error("%s: start height (%d) is greater than stop height (%d)",
+                     __func__, start_height, stop_index->nHeight);
+    }
+
+    entries.resize(stop_index->nHeight - start_height + 1);
+    const CBlockIndex* block_index = stop_index;
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        it->first = block_index->GetBlockHash();
+        if (!ReadEntry(it->first, it->second)) {
+            return false;
+        }
+        block_index = block_index->pprev;
+    }
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const
+{
+    CBlockFilterEntry entry;
+    if (!ReadEntry(block_index->GetBlockHash(), entry)) {
+        return false;
+    }
+    filter_out = BlockFilter(m_filter_type, block_index->GetBlockHash(), std::move(entry.encoded));
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const
+{
+    CBlockFilterEntry entry;
+    if (!ReadEntry(block_index->GetBlockHash(), entry)) {
+        return false;
+    }
+    header_out = entry.header;
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* stop_index,
+                                         std::vector<BlockFilter>& filters_out) const
+{
+    std::vector<std::pair<uint256, CBlockFilterEntry>> entries;
+    if (!LookupRange(start_height, stop_index, entries)) {
+        return false;
+    }
+
+    filters_out.clear();
+    filters_out.reserve(entries.size());
+    for (auto& entry : entries) {
+        filters_out.emplace_back(m_filter_type, entry.first, std::move(entry.second.encoded));
+    }
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHashRange(int start_height, const CBlockIndex* stop_index,
+                                             std::vector<uint256>& hashes_out) const
+{
+    std::vector<std::pair<uint256, CBlockFilterEntry>> entries;
+    if (!LookupRange(start_height, stop_index, entries)) {
+        return false;
+    }
+
+    hashes_out.clear();
+    hashes_out.reserve(entries.size());
+    for (const auto& entry : entries) {
+        hashes_out.push_back(entry.second.hash);
+    }
+    return true;
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BLOCKFILTERINDEX_H
+#define BITCOIN_INDEX_BLOCKFILTERINDEX_H
+
+#include <blockfilter.h>
+#include <chain.h>
+#include <index/base.h>
+#include <sync.h>
+
+#include <map>
+#include <memory>
+
+class CDBWrapper;
+
+/** A stored block filter together with its hash and the filter header
+ *  committing to it and all filters before it. */
+struct CBlockFilterEntry
+{
+    uint256 hash;
+    uint256 header;
+    std::vector<unsigned char> encoded;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hash);
+        READWRITE(header);
+        READWRITE(encoded);
+    }
+};
+
+/**
+ * BlockFilterIndex is used to store and retrieve block filters, hashes, and
+ * headers for a range of blocks by height. An index is constructed for each
+ * supported filter type with its own database (indexes/blockfilter/<type>/).
+ *
+ * Entries are keyed by block hash, so the filters of blocks that were
+ * reorganized away remain valid and nothing needs to be rewound.
+ */
+class BlockFilterIndex final : public BaseIndex
+{
+private:
+    BlockFilterType m_filter_type;
+    std::string m_name;
+    const std::unique_ptr<CDBWrapper> m_db;
+
+    mutable CCriticalSection cs_pending;
+
+    /// Filters of indexed blocks that have not been committed to disk yet.
+    std::map<uint256, CBlockFilterEntry> m_pending;
+
+    CCriticalSection cs_commit;
+
+    bool ReadEntry(const uint256& block_hash, CBlockFilterEntry& entry) const;
+
+    /// Look up the entries of the blocks from start_height to stop_index.
+    bool LookupRange(int start_height, const CBlockIndex* stop_index,
+                     std::vector<std::pair<uint256, CBlockFilterEntry>>& entries) const;
+
+protected:
+    bool ReadBestBlock(CBlockLocator& locator) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    size_t GetPendingCount() const override;
+
+    bool CommitInternal(const CBlockLocator& locator) override;
+
+    const char* GetName() const override { return m_name.c_str(); }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit BlockFilterIndex(BlockFilterType filter_type,
+                              size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    ~BlockFilterIndex() override;
+
+    BlockFilterType GetFilterType() const { return m_filter_type; }
+
+    /** Get a single filter by block. */
+    bool LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const;
+
+    /** Get a single filter header by block. */
+    bool LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const;
+
+    /** Get a range of filters between two heights on a chain. */
+    bool LookupFilterRange(int start_height, const CBlockIndex* stop_index,
+                           std::vector<BlockFilter>& filters_out) const;
+
+    /** Get a range of filter hashes between two heights on a chain. */
+    bool LookupFilterHashRange(int start_height, const CBlockIndex* stop_index,
+                               std::vector<uint256>& hashes_out) const;
+};
+
+/// The global basic block filter index, used by getblockfilter and the BIP
+/// 157 messages. May be null.
+extern std::unique_ptr<BlockFilterIndex> g_blockfilterindex;
+
+#endif // BITCOIN_INDEX_BLOCKFILTERINDEX_H
@@ -0,0 +1,176 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <dbwrapper.h>
+#include <index/coinstatsindex.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+static const char DB_COIN_STATS = 's';
+static const char DB_BEST_BLOCK = 'B';
+
+std::unique_ptr<CoinStatsIndex> g_coinstatsindex;
+
+static CDataStream SerializeCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << outpoint;
+    ss << (uint32_t)(coin.nHeight * 2 + coin.fCoinBase);
+    ss << coin.out;
+    return ss;
+}
+
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss = SerializeCoin(outpoint, coin);
+    muhash.Insert((const unsigned char*)ss.data(), ss.size());
+}
+
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss = SerializeCoin(outpoint, coin);
+    muhash.Remove((const unsigned char*)ss.data(), ss.size());
+}
+
+static uint64_t GetBogoSize(const CScript& scriptPubKey)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + scriptPubKey.size() /* scriptPubKey */;
+}
+
+/**
+ * The two blocks whose coinbase duplicates that of an earlier block whose
+ * outputs were still unspent (see BIP30). Connecting them overwrote those
+ * outputs, leaving their number unchanged. Returns the height of the
+ * overwritten coins, or 0.
+ */
+static int GetOverwrittenCoinbaseHeight(const CBlockIndex* pindex)
+{
+    if (pindex->nHeight == 91842 && pindex->GetBlockHash() == uint256S("0x00000000000a4d0a398161ffc163c503763b1f4360639393e0e4c8e300e0caec")) {
+        return 91812;
+    }
+    if (pindex->nHeight == 91880 && pindex->GetBlockHash() == uint256S("0x00000000000743f190a18c5577a3c2d2a1f610ae9601ac046a38084ccb7cd721")) {
+        return 91722;
+    }
+    return 0;
+}
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<CDBWrapper>(GetDataDir() / "indexes" / "coinstats", n_cache_size, f_memory, f_wipe))
+{}
+
+CoinStatsIndex::~CoinStatsIndex() {}
+
+bool CoinStatsIndex::ReadBestBlock(CBlockLocator& locator) const
+{
+    return m_db->Read(DB_BEST_BLOCK, locator);
+}
+
+bool CoinStatsIndex::ReadEntry(const uint256& block_hash, CCoinStatsEntry& entry) const
+{
+    {
+        LOCK(cs_pending);
+        auto it = m_pending.find(block_hash);
+        if (it != m_pending.end()) {
+            entry = it->second;
+            return true;
+        }
+    }
+    return m_db->Read(std::make_pair(DB_COIN_STATS, block_hash), entry);
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CCoinStatsEntry entry;
+
+    // The outputs of the genesis block are not part of the UTXO set.
+    if (pindex->pprev) {
+        CBlockUndo block_undo;
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+        if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: undo data of block %s doesn't match it", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!ReadEntry(pindex->pprev->GetBlockHash(), entry)) {
+            return error("%s: cannot read coin stats of previous block %s", __func__,
+                         pindex->pprev->GetBlockHash().ToString());
+        }
+
+        const int nOverwrittenHeight = GetOverwrittenCoinbaseHeight(pindex);
+        for (size_t i = 0; i < block.vtx.size(); ++i) {
+            const CTransaction& tx = *block.vtx[i];
+            for (size_t j = 0; j < tx.vout.size(); ++j) {
+                const CTxOut& out = tx.vout[j];
+                if (out.scriptPubKey.IsUnspendable()) continue;
+                const COutPoint outpoint(tx.GetHash(), j);
+                if (i == 0 && nOverwrittenHeight) {
+                    RemoveCoinHash(entry.muhash, outpoint, Coin(out, nOverwrittenHeight, 0, true));
+                } else {
+                    entry.nTransactionOutputs++;
+                    entry.nTotalAmount += out.nValue;
+                    entry.nBogoSize += GetBogoSize(out.scriptPubKey);
+                }
+                ApplyCoinHash(entry.muhash, outpoint, Coin(out, pindex->nHeight, 0, tx.IsCoinBase()));
+            }
+
+            if (i == 0) continue;
+            const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+            if (tx_undo.vprevout.size() != tx.vin.size()) {
+                return error("%s: undo data of block %s doesn't match it", __func__, pindex->GetBlockHash().ToString());
+            }
+            for (size_t j = 0; j < tx.vin.size(); ++j) {
+                const Coin& coin = tx_undo.vprevout[j];
+                RemoveCoinHash(entry.muhash, tx.vin[j].prevout, coin);
+                entry.nTransactionOutputs--;
+                entry.nTotalAmount -= coin.out.nValue;
+                entry.nBogoSize -= GetBogoSize(coin.out.scriptPubKey);
+            }
+        }
+    }
+
+    LOCK(cs_pending);
+    m_pending[pindex->GetBlockHash()] = std::move(entry);
+    return true;
+}
+
+size_t CoinStatsIndex::GetPendingCount() const
+{
+    LOCK(cs_pending);
+    return m_pending.size();
+}
+
+bool CoinStatsIndex::CommitInternal(const CBlockLocator& locator)
+{
+    LOCK(cs_commit);
+
+    std::vector<std::pair<uint256, CCoinStatsEntry>> entries;
+    {
+        LOCK(cs_pending);
+        entries.assign(m_pending.begin(), m_pending.end());
+    }
+
+    CDBBatch batch(*m_db);
+    for (const auto& entry : entries) {
+        batch.Write(std::make_pair(DB_COIN_STATS, entry.first), entry.second);
+    }
+    batch.Write(DB_BEST_BLOCK, locator);
+    if (!m_db->WriteBatch(batch)) {
+        return error("%s: failed to write %u coin stats entries", __func__, entries.size());
+    }
+
+    // The statistics after a block never change, so everything written can be dropped.
+    LOCK(cs_pending);
+    for (const auto& entry : entries) {
+        m_pending.erase(entry.first);
+    }
+    return true;
+}
+
+bool CoinStatsIndex::LookupStats(const CBlockIndex* block_index, CCoinStatsEntry& entry) const
+{
+    return ReadEntry(block_index->GetBlockHash(), entry);
+}
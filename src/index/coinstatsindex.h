@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_COINSTATSINDEX_H
+#define BITCOIN_INDEX_COINSTATSINDEX_H
+
+#include <amount.h>
+#include <chain.h>
+#include <crypto/muhash.h>
+#include <index/base.h>
+#include <serialize.h>
+#include <sync.h>
+
+#include <map>
+#include <memory>
+
+class CDBWrapper;
+class Coin;
+class COutPoint;
+
+/** Add a coin to, or remove it from, a MuHash of the UTXO set. The hash
+ *  covers the outpoint, height, coinbase flag and output of each coin. */
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+/** The statistics of the UTXO set after a block, as gettxoutsetinfo reports them. */
+struct CCoinStatsEntry
+{
+    MuHash3072 muhash;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    CAmount nTotalAmount;
+
+    CCoinStatsEntry() : nTransactionOutputs(0), nBogoSize(0), nTotalAmount(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(muhash);
+        READWRITE(VARINT(nTransactionOutputs));
+        READWRITE(VARINT(nBogoSize));
+        READWRITE(nTotalAmount);
+    }
+};
+
+/**
+ * CoinStatsIndex keeps the statistics of the UTXO set after every block, so
+ * that gettxoutsetinfo does not have to walk the whole chainstate, and can
+ * answer for earlier blocks too. The entry of a block is that of its parent
+ * with the outputs the block creates added and the ones it spends, known from
+ * its undo data, taken away. The set is hashed with MuHash3072, whose state is
+ * stored as is, so that the expensive finalization only happens on lookup.
+ *
+ * Entries are keyed by block hash, so the entries of blocks that were
+ * reorganized away remain valid and nothing needs to be rewound.
+ */
+class CoinStatsIndex final : public BaseIndex
+{
+private:
+    const std::unique_ptr<CDBWrapper> m_db;
+
+    mutable CCriticalSection cs_pending;
+
+    /// Entries of indexed blocks that have not been committed to disk yet.
+    std::map<uint256, CCoinStatsEntry> m_pending;
+
+    CCriticalSection cs_commit;
+
+    bool ReadEntry(const uint256& block_hash, CCoinStatsEntry& entry) const;
+
+protected:
+    bool ReadBestBlock(CBlockLocator& locator) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    size_t GetPendingCount() const override;
+
+    bool CommitInternal(const CBlockLocator& locator) override;
+
+    const char* GetName() const override { return "coinstatsindex"; }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    ~CoinStatsIndex() override;
+
+    /** Get the statistics of the UTXO set after the given block. */
+    bool LookupStats(const CBlockIndex* block_index, CCoinStatsEntry& entry) const;
+};
+
+/// The global UTXO set statistics index, used by gettxoutsetinfo. May be null.
+extern std::unique_ptr<CoinStatsIndex> g_coinstatsindex;
+
+#endif // BITCOIN_INDEX_COINSTATSINDEX_H
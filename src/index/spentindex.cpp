@@ -0,0 +1,132 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <dbwrapper.h>
+#include <index/spentindex.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+static const char DB_SPENT = 's';
+static const char DB_BEST_BLOCK = 'B';
+
+std::unique_ptr<SpentIndex> g_spentindex;
+
+SpentIndex::SpentIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<CDBWrapper>(GetDataDir() / "indexes" / "spentindex", n_cache_size, f_memory, f_wipe))
+{}
+
+SpentIndex::~SpentIndex() {}
+
+bool SpentIndex::ReadBestBlock(CBlockLocator& locator) const
+{
+    return m_db->Read(DB_BEST_BLOCK, locator);
+}
+
+bool SpentIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    if (block.vtx.size() <= 1) return true;
+
+    CBlockUndo blockundo;
+    if (!UndoReadFromDisk(blockundo, pindex)) {
+        return false;
+    }
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: undo data does not match block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    LOCK(cs_pending);
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size()) {
+            return error("%s: undo data does not match transaction %s", __func__, tx.GetHash().ToString());
+        }
+        for (uint32_t j = 0; j < tx.vin.size(); j++) {
+            const Coin& coin = txundo.vprevout[j];
+            CIndexedAddress address;
+            GetIndexedAddress(coin.out.scriptPubKey, address);
+            m_pending[tx.vin[j].prevout] = CSpentIndexValue(tx.GetHash(), j, pindex->nHeight, coin.out.nValue, address);
+        }
+    }
+    return true;
+}
+
+bool SpentIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+
+        LOCK(cs_pending);
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            for (const CTxIn& txin : block.vtx[i]->vin) {
+                m_pending[txin.prevout] = boost::none;
+            }
+        }
+    }
+    return true;
+}
+
+size_t SpentIndex::GetPendingCount() const
+{
+    LOCK(cs_pending);
+    return m_pending.size();
+}
+
+bool SpentIndex::CommitInternal(const CBlockLocator& locator)
+{
+    LOCK(cs_commit);
+
+    std::vector<std::pair<COutPoint, boost::optional<CSpentIndexValue>>> entries;
+    {
+        LOCK(cs_pending);
+        entries.assign(m_pending.begin(), m_pending.end());
+    }
+
+    CDBBatch batch(*m_db);
+    for (const auto& entry : entries) {
+        if (entry.second) {
+            batch.Write(std::make_pair(DB_SPENT, entry.first), *entry.second);
+        } else {
+            batch.Erase(std::make_pair(DB_SPENT, entry.first));
+        }
+    }
+    batch.Write(DB_BEST_BLOCK, locator);
+    if (!m_db->WriteBatch(batch)) {
+        return error("%s: failed to write %u spent index entries", __func__, entries.size());
+    }
+
+    // Readers keep finding the entries in m_pending until they are on disk.
+    LOCK(cs_pending);
+    for (const auto& entry : entries) {
+        auto it = m_pending.find(entry.first);
+        if (it != m_pending.end() && it->second == entry.second) {
+            m_pending.erase(it);
+        }
+    }
+    return true;
+}
+
+bool SpentIndex::FindSpent(const COutPoint& outpoint, CSpentIndexValue& value) const
+{
+    {
+        LOCK(cs_pending);
+        auto it = m_pending.find(outpoint);
+        if (it != m_pending.end()) {
+            if (!it->second) return false;
+            value = *it->second;
+            return true;
+        }
+    }
+    return m_db->Read(std::make_pair(DB_SPENT, outpoint), value);
+}
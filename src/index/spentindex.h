@@ -0,0 +1,97 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_SPENTINDEX_H
+#define BITCOIN_INDEX_SPENTINDEX_H
+
+#include <amount.h>
+#include <index/addressindex.h>
+#include <index/base.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <boost/optional.hpp>
+
+#include <map>
+#include <memory>
+
+class CDBWrapper;
+
+/** Where an output was spent, with the value and address of the output so
+ *  that callers do not have to look up the funding transaction. */
+struct CSpentIndexValue
+{
+    uint256 txid;       //!< spending transaction
+    uint32_t nInput;    //!< input of the spending transaction
+    int nHeight;
+    CAmount nValue;
+    CIndexedAddress address;
+
+    CSpentIndexValue() : nInput(0), nHeight(0), nValue(0) {}
+    CSpentIndexValue(const uint256& txidIn, uint32_t nInputIn, int nHeightIn, CAmount nValueIn, const CIndexedAddress& addressIn)
+        : txid(txidIn), nInput(nInputIn), nHeight(nHeightIn), nValue(nValueIn), address(addressIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(nInput);
+        READWRITE(nHeight);
+        READWRITE(nValue);
+        READWRITE(address);
+    }
+
+    friend bool operator==(const CSpentIndexValue& a, const CSpentIndexValue& b) {
+        return a.txid == b.txid && a.nInput == b.nInput && a.nHeight == b.nHeight &&
+               a.nValue == b.nValue && a.address == b.address;
+    }
+};
+
+/**
+ * SpentIndex maps every spent outpoint to the input that spent it. It lives in
+ * its own database (indexes/spentindex/) and is rolled back when blocks are
+ * disconnected.
+ */
+class SpentIndex final : public BaseIndex
+{
+private:
+    const std::unique_ptr<CDBWrapper> m_db;
+
+    mutable CCriticalSection cs_pending;
+
+    /// Changes of indexed blocks that have not been committed to disk yet;
+    /// an empty value erases the entry.
+    std::map<COutPoint, boost::optional<CSpentIndexValue>> m_pending;
+
+    CCriticalSection cs_commit;
+
+protected:
+    bool ReadBestBlock(CBlockLocator& locator) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    size_t GetPendingCount() const override;
+
+    bool CommitInternal(const CBlockLocator& locator) override;
+
+    const char* GetName() const override { return "spentindex"; }
+
+public:
+    explicit SpentIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    ~SpentIndex() override;
+
+    /// Look up the input spending an outpoint in the indexed chain.
+    bool FindSpent(const COutPoint& outpoint, CSpentIndexValue& value) const;
+};
+
+/// The global spent index, used by the getspentinfo RPC. May be null.
+extern std::unique_ptr<SpentIndex> g_spentindex;
+
+#endif // BITCOIN_INDEX_SPENTINDEX_H
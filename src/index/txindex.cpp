@@ -0,0 +1,92 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/txindex.h>
+#include <util.h>
+#include <validation.h>
+
+std::unique_ptr<TxIndex> g_txindex;
+
+bool TxIndex::ReadBestBlock(CBlockLocator& locator) const
+{
+    if (pblocktree->ReadTxIndexBestBlock(locator)) {
+        return true;
+    }
+
+    // Earlier versions maintained the index synchronously in ConnectBlock and
+    // only recorded that it was enabled, so such an index is complete up to
+    // the current chain tip.
+    bool fLegacyTxIndex = false;
+    if (pblocktree->ReadFlag("txindex", fLegacyTxIndex) && fLegacyTxIndex) {
+        LOCK(cs_main);
+        if (chainActive.Tip()) {
+            locator = chainActive.GetLocator();
+            LogPrintf("%s: using transaction index built by an earlier version\n", __func__);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+
+    LOCK(cs_pending);
+    for (const auto& tx : block.vtx) {
+        m_pending[tx->GetHash()] = pos;
+        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    }
+    return true;
+}
+
+size_t TxIndex::GetPendingCount() const
+{
+    LOCK(cs_pending);
+    return m_pending.size();
+}
+
+bool TxIndex::CommitInternal(const CBlockLocator& locator)
+{
+    LOCK(cs_commit);
+
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    {
+        LOCK(cs_pending);
+        vPos.assign(m_pending.begin(), m_pending.end());
+    }
+
+    // Readers keep finding the entries in m_pending until they are on disk.
+    if (!pblocktree->WriteTxIndex(vPos, locator)) {
+        return error("%s: failed to write %u transaction index entries", __func__, vPos.size());
+    }
+
+    LOCK(cs_pending);
+    for (const auto& entry : vPos) {
+        auto it = m_pending.find(entry.first);
+        if (it != m_pending.end() && it->second == entry.second &&
+            it->second.nTxOffset == entry.second.nTxOffset) {
+            m_pending.erase(it);
+        }
+    }
+    return true;
+}
+
+bool TxIndex::FindTx(const uint256& txid, CDiskTxPos& pos) const
+{
+    {
+        LOCK(cs_pending);
+        auto it = m_pending.find(txid);
+        if (it != m_pending.end()) {
+            pos = it->second;
+            return true;
+        }
+    }
+    return pblocktree->ReadTxIndex(txid, pos);
+}
+
+bool TxIndex::Reset()
+{
+    return pblocktree->EraseTxIndexBestBlock() && pblocktree->WriteFlag("txindex", false);
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_TXINDEX_H
+#define BITCOIN_INDEX_TXINDEX_H
+
+#include <index/base.h>
+#include <sync.h>
+#include <txdb.h>
+
+#include <map>
+#include <memory>
+
+/**
+ * TxIndex is used to look up transactions included in the blockchain by hash.
+ * The index entries live in the block tree database (blocks/index/) next to
+ * the locator of the last block they cover, so indexes built by earlier
+ * versions in ConnectBlock are picked up without rebuilding them.
+ */
+class TxIndex final : public BaseIndex
+{
+private:
+    mutable CCriticalSection cs_pending;
+
+    /// Entries of indexed blocks that have not been committed to disk yet.
+    std::map<uint256, CDiskTxPos> m_pending;
+
+    /// Serializes commits coming from the sync thread and the notification queue.
+    CCriticalSection cs_commit;
+
+protected:
+    bool ReadBestBlock(CBlockLocator& locator) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    size_t GetPendingCount() const override;
+
+    bool CommitInternal(const CBlockLocator& locator) override;
+
+    const char* GetName() const override { return "txindex"; }
+
+public:
+    /// Look up the on-disk position of a transaction by hash. Entries that are
+    /// still buffered in memory are found as well. After a reorg the position
+    /// may be in a block that has been disconnected.
+    bool FindTx(const uint256& txid, CDiskTxPos& pos) const;
+
+    /// Forget the indexed best block, so that the index is rebuilt from
+    /// scratch the next time it is enabled.
+    static bool Reset();
+};
+
+/// The global transaction index, used in GetTransaction. May be null.
+extern std::unique_ptr<TxIndex> g_txindex;
+
+#endif // BITCOIN_INDEX_TXINDEX_H
@@ -262,9 +262,9 @@ static bool GetKernelStakeModifier(unsigned int nCoinStakeTime, uint64_t& nStake
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTxOut& txOutPrev, const COutPoint& prevout, uint32_t nTimeTx, uint256& hashProofOfStake, bool fPrintProofOfStake)
+bool CheckStakeKernelHash(unsigned int nBits, const CBlockIndex* pindexFrom, unsigned int nTxPrevOffset, const CTxOut& txOutPrev, const COutPoint& prevout, uint32_t nTimeTx, uint256& hashProofOfStake, bool fPrintProofOfStake)
 {
-    uint32_t nTimeBlockFrom = blockFrom.GetBlockTime();
+    uint32_t nTimeBlockFrom = pindexFrom->GetBlockTime();
     if (nTimeBlockFrom + Params().GetConsensus().nStakeMinAge > nTimeTx) // Min age requirement
         return error("CheckStakeKernelHash() : min age violation");
 
@@ -280,7 +280,7 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
     uint64_t nStakeModifier = 0;
     int nStakeModifierHeight = 0;
     int64_t nStakeModifierTime = 0;
-    if (!GetKernelStakeModifier(blockFrom.GetBlockTime(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake))
+    if (!GetKernelStakeModifier(nTimeBlockFrom, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake))
         return false;
 
     ss << nStakeModifier << nTimeBlockFrom << nTxPrevOffset << nTimeBlockFrom << prevout.n << nTimeTx;
@@ -290,8 +290,8 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
         LogPrintf("CheckStakeKernelHash() : using modifier 0x%016" PRIx64 " at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
             nStakeModifier, nStakeModifierHeight,
             DateTimeStrFormat(nStakeModifierTime),
-            mapBlockIndex[blockFrom.GetHash()]->nHeight,
-            DateTimeStrFormat(blockFrom.GetBlockTime()));
+            pindexFrom->nHeight,
+            DateTimeStrFormat(nTimeBlockFrom));
         LogPrintf("CheckStakeKernelHash() : modifier=0x%016" PRIx64 " nTimeBlockFrom=%u nTxPrevOffset=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
             nTimeBlockFrom, nTxPrevOffset, prevout.n, nTimeTx,
@@ -305,8 +305,8 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
         LogPrint(BCLog::STAKEMODIFIER, "CheckStakeKernelHash() : using modifier 0x%016" PRIx64 " at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
             nStakeModifier, nStakeModifierHeight,
             DateTimeStrFormat(nStakeModifierTime),
-            mapBlockIndex[blockFrom.GetHash()]->nHeight,
-            DateTimeStrFormat(blockFrom.GetBlockTime()));
+            pindexFrom->nHeight,
+            DateTimeStrFormat(nTimeBlockFrom));
         LogPrint(BCLog::STAKEMODIFIER, "CheckStakeKernelHash() : modifier=0x%016" PRIx64 " nTimeBlockFrom=%u nTxPrevOffset=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
             nTimeBlockFrom, nTxPrevOffset, prevout.n, nTimeTx,
@@ -316,48 +316,29 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
 }
 
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(CValidationState& state, const CTransactionRef& tx, unsigned int nBits, uint256& hashProofOfStake, unsigned int nBlockTime)
+bool CheckProofOfStake(CValidationState& state, const CTransactionRef& tx, unsigned int nBits, uint256& hashProofOfStake, unsigned int nBlockTime, const CCoinsViewCache& view, const CBlockIndex* pindexPrev)
 {
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx->vin[0];
 
-    // Transaction index is required to get to block header
-    if (!fTxIndex)
-        return error("CheckProofOfStake() : transaction index not available");
-
-    // First try finding the previous transaction in database
-    CTransactionRef txTmp;
-    uint256 hashBlock;
-    if (!GetTransaction(txin.prevout.hash, txTmp, Params().GetConsensus(), hashBlock))
+    // The kernel output and the block that created it come from the coins
+    // view and the block index; only the offset of the transaction in its
+    // block is looked up, so kernels stay verifiable on pruned nodes.
+    const Coin& coinPrev = view.AccessCoin(txin.prevout);
+    if (coinPrev.IsSpent() || !pindexPrev || coinPrev.nHeight > (uint32_t)pindexPrev->nHeight)
         return state.DoS(1, error("CheckProofOfStake() : txPrev not found")); // previous transaction not in main chain, may occur during initial download
+    const CBlockIndex* pindexFrom = pindexPrev->GetAncestor(coinPrev.nHeight);
+
+    CDiskTxPos postx;
+    if (!FindTxPosition(txin.prevout.hash, pindexPrev, coinPrev.nHeight, postx))
+        return state.DoS(1, error("CheckProofOfStake() : position of txPrev %s not found", txin.prevout.hash.ToString()));
 
     // Verify signature
     PrecomputedTransactionData txdata(*tx);
-    if (!CScriptCheck(txTmp->vout[tx->vin[0].prevout.n], *tx, 0, 0, true, &txdata)())
+    if (!CScriptCheck(coinPrev.out, *tx, 0, 0, true, &txdata)())
         return state.DoS(100, error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx->GetHash().ToString()));
 
-    // Get transaction index for the previous transaction
-    CDiskTxPos postx;
-    if (!pblocktree->ReadTxIndex(txin.prevout.hash, postx))
-        return error("CheckProofOfStake() : tx index not found");  // tx index not found
-
-    // Read txPrev and header of its block
-    CBlockHeader header;
-    CTransactionRef txPrev;
-    {
-        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-        try {
-            file >> header;
-            fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-            file >> txPrev;
-        } catch (std::exception& e) {
-            return error("%s() : deserialize or I/O error in CheckProofOfStake()", __PRETTY_FUNCTION__);
-        }
-        if (txPrev->GetHash() != txin.prevout.hash)
-            return error("%s() : txid mismatch in CheckProofOfStake()", __PRETTY_FUNCTION__);
-    }
-
-    if (!CheckStakeKernelHash(nBits, header, postx.nTxOffset + CBlockHeader::NORMAL_SERIALIZE_SIZE, txPrev->vout[txin.prevout.n], txin.prevout, nBlockTime, hashProofOfStake, logCategories & BCLog::STAKEMODIFIER))
+    if (!CheckStakeKernelHash(nBits, pindexFrom, postx.nTxOffset + CBlockHeader::NORMAL_SERIALIZE_SIZE, coinPrev.out, txin.prevout, nBlockTime, hashProofOfStake, logCategories & BCLog::STAKEMODIFIER))
         return state.DoS(1, error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s", tx->GetHash().ToString(), hashProofOfStake.ToString())); // may occur during initial download or if behind on block chain sync
 
     return true;
@@ -0,0 +1,100 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mappedfile.h>
+
+#include <util.h>
+
+#ifndef WIN32
+#include <fcntl.h> // for open
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h> // for fstat
+#include <unistd.h> // for close
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+MappedFile::~MappedFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
+std::shared_ptr<const MappedFile> MappedFile::Open(const fs::path& path)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > std::numeric_limits<size_t>::max()) {
+        close(fd);
+        return nullptr;
+    }
+    size_t size = st.st_size;
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LogPrint(BCLog::BENCH, "Unable to map %s: %s\n", path.string(), strerror(errno));
+        return nullptr;
+    }
+    return std::shared_ptr<const MappedFile>(new MappedFile(static_cast<const unsigned char*>(addr), size));
+#endif
+}
+
+std::shared_ptr<const MappedFile> MappedFileCache::Get(const fs::path& path, size_t min_size)
+{
+    LOCK(cs);
+    const std::string key = path.string();
+    auto it = m_files.find(key);
+    if (it != m_files.end() && it->second.file->size() >= min_size) {
+        it->second.nLastUsed = ++m_use_counter;
+        return it->second.file;
+    }
+
+    std::shared_ptr<const MappedFile> file = MappedFile::Open(path);
+    if (!file || file->size() < min_size) {
+        return nullptr;
+    }
+    if (it != m_files.end()) {
+        // The file has grown; readers of the old mapping keep it alive.
+        it->second.file = file;
+        it->second.nLastUsed = ++m_use_counter;
+        return file;
+    }
+
+    if (m_max_files == 0) {
+        return file;
+    }
+    if (m_files.size() >= m_max_files) {
+        auto oldest = m_files.begin();
+        for (auto i = m_files.begin(); i != m_files.end(); ++i) {
+            if (i->second.nLastUsed < oldest->second.nLastUsed) {
+                oldest = i;
+            }
+        }
+        m_files.erase(oldest);
+    }
+    m_files.emplace(key, Entry{file, ++m_use_counter});
+    return file;
+}
+
+void MappedFileCache::Release(const fs::path& path)
+{
+    LOCK(cs);
+    m_files.erase(path.string());
+}
+
+void MappedFileCache::Clear()
+{
+    LOCK(cs);
+    m_files.clear();
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MAPPEDFILE_H
+#define BITCOIN_MAPPEDFILE_H
+
+#include <fs.h>
+#include <sync.h>
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+/**
+ * A read-only memory mapping of a whole file, as large as the file was when
+ * it was mapped. Data appended to the file later is not visible through it,
+ * and the file must not be truncated while it is mapped.
+ */
+class MappedFile
+{
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+
+    MappedFile(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+
+public:
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /** Map the file at path. Returns nullptr if it can't be mapped, or if
+     *  memory mapping isn't supported on this platform. */
+    static std::shared_ptr<const MappedFile> Open(const fs::path& path);
+
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+};
+
+/**
+ * Keeps the most recently used files mapped, so that reading from them
+ * needs neither a system call nor a copy into a buffer of our own. A
+ * mapping is shared with whoever still reads from it, and unmapped when
+ * the last of them is done.
+ */
+class MappedFileCache
+{
+private:
+    struct Entry
+    {
+        std::shared_ptr<const MappedFile> file;
+        uint64_t nLastUsed;
+    };
+
+    mutable CCriticalSection cs;
+    std::map<std::string, Entry> m_files;
+    uint64_t m_use_counter;
+    const size_t m_max_files;
+
+public:
+    explicit MappedFileCache(size_t max_files) : m_use_counter(0), m_max_files(max_files) {}
+
+    /**
+     * Get a mapping of the file at path that covers at least its first
+     * min_size bytes, remapping it if it has grown since it was mapped.
+     * Returns nullptr if that isn't possible.
+     */
+    std::shared_ptr<const MappedFile> Get(const fs::path& path, size_t min_size);
+
+    /** Forget the mapping of path, before the file is truncated or removed. */
+    void Release(const fs::path& path);
+
+    /** Forget all mappings. */
+    void Clear();
+};
+
+#endif // BITCOIN_MAPPEDFILE_H
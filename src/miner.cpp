@@ -13,6 +13,8 @@
 #include <consensus/tx_verify.h>
 #include <consensus/merkle.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
 #include <hash.h>
 #include <validation.h>
 #include <net.h>
@@ -21,12 +23,14 @@
 #include <pow.h>
 #include <primitives/transaction.h>
 #include <script/standard.h>
+#include <streams.h>
 #include <timedata.h>
 #include <util.h>
 #include <utilmoneystr.h>
 #include <validationinterface.h>
 
 #include <algorithm>
+#include <atomic>
 #include <queue>
 #include <utility>
 #ifdef ENABLE_WALLET
@@ -507,6 +511,127 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+std::unique_ptr<BlockTemplateBuilder> g_block_template_builder;
+
+BlockTemplateBuilder::BlockTemplateBuilder(const CChainParams& params, std::chrono::milliseconds refresh_interval)
+    : m_chainparams(params), m_refresh_interval(refresh_interval) {}
+
+BlockTemplateBuilder::~BlockTemplateBuilder()
+{
+    Interrupt();
+    Stop();
+}
+
+void BlockTemplateBuilder::Start()
+{
+    RegisterValidationInterface(this);
+    m_thread = std::thread(&TraceThread<std::function<void()>>, "blocktemplate",
+                           std::bind(&BlockTemplateBuilder::ThreadBuild, this));
+}
+
+void BlockTemplateBuilder::Interrupt()
+{
+    {
+        WaitableLock lock(m_cs);
+        m_interrupted = true;
+    }
+    m_cv.notify_all();
+}
+
+void BlockTemplateBuilder::Stop()
+{
+    UnregisterValidationInterface(this);
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+bool BlockTemplateBuilder::IsInUse() const
+{
+    return std::chrono::steady_clock::now() - m_last_request < std::chrono::seconds(BLOCK_TEMPLATE_IDLE_TIMEOUT);
+}
+
+BlockTemplateBuilder::Snapshot BlockTemplateBuilder::GetSnapshot()
+{
+    WaitableLock lock(m_cs);
+    const bool was_idle = !IsInUse();
+    m_last_request = std::chrono::steady_clock::now();
+    if (was_idle && m_dirty) {
+        // Changes were ignored while nobody asked; start catching up.
+        m_cv.notify_all();
+        return Snapshot();
+    }
+    return m_snapshot;
+}
+
+void BlockTemplateBuilder::MarkDirty(bool tip_changed)
+{
+    {
+        WaitableLock lock(m_cs);
+        m_dirty = true;
+        m_tip_changed |= tip_changed;
+    }
+    m_cv.notify_all();
+}
+
+void BlockTemplateBuilder::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    if (!fInitialDownload) MarkDirty(true);
+}
+
+void BlockTemplateBuilder::TransactionAddedToMempool(const CTransactionRef& ptx)
+{
+    MarkDirty(false);
+}
+
+void BlockTemplateBuilder::TransactionRemovedFromMempool(const CTransactionRef& ptx)
+{
+    MarkDirty(false);
+}
+
+void BlockTemplateBuilder::ThreadBuild()
+{
+    const CScript scriptDummy = CScript() << OP_TRUE;
+    while (true) {
+        {
+            WaitableLock lock(m_cs);
+            m_cv.wait(lock, [this] { return m_interrupted || (m_dirty && IsInUse()); });
+            // A new tip is worth a template right away, the mempool churn
+            // that follows it is batched.
+            if (!m_tip_changed) {
+                m_cv.wait_until(lock, m_last_build + m_refresh_interval, [this] { return m_interrupted || m_tip_changed; });
+            }
+            if (m_interrupted) return;
+            m_dirty = false;
+            m_tip_changed = false;
+        }
+
+        if (IsInitialBlockDownload()) continue;
+
+        Snapshot snapshot;
+        snapshot.transactions_updated = mempool.GetTransactionsUpdated();
+        try {
+            snapshot.block_template = BlockAssembler(m_chainparams).CreateNewBlock(scriptDummy, true);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        if (!snapshot.block_template) continue;
+        snapshot.fees = -snapshot.block_template->vTxFees[0];
+
+        {
+            WaitableLock lock(m_cs);
+            m_last_build = std::chrono::steady_clock::now();
+            snapshot.sequence = m_snapshot.sequence + 1;
+            m_snapshot = std::move(snapshot);
+        }
+        // Wake up getblocktemplate long polls, which check whether the fees improved.
+        {
+            WaitableLock lock(csBestBlock);
+            cvBlockChange.notify_all();
+        }
+    }
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -526,6 +651,116 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
 
+namespace {
+
+/** Number of nonces GrindProofOfWork tries before starting more threads. */
+static const uint32_t POW_GRIND_BATCH = 0x1000;
+
+/** Number of nonces a grinding thread claims at a time. */
+static const uint32_t POW_GRIND_CHUNK = 0x4000;
+
+/**
+ * Hashes a block header for different nonces. The header is serialized as
+ * CBlockHeader::GetHash does, and the nonce ends at byte 80, in the second
+ * SHA256 chunk, so the state after the first chunk is shared by all nonces.
+ */
+class HeaderHasher
+{
+private:
+    CSHA256 m_midstate;
+    unsigned char m_tail[32];
+    size_t m_tail_size;
+
+public:
+    explicit HeaderHasher(const CBlockHeader& header)
+    {
+        CDataStream stream(SER_GETHASH, PROTOCOL_VERSION | SERIALIZE_BLOCK_LEGACY);
+        stream << header;
+        assert(stream.size() >= 80 && stream.size() - 64 <= sizeof(m_tail));
+        m_midstate.Write((const unsigned char*)stream.data(), 64);
+        m_tail_size = stream.size() - 64;
+        memcpy(m_tail, stream.data() + 64, m_tail_size);
+    }
+
+    uint256 GetHash(uint32_t nNonce) const
+    {
+        unsigned char tail[sizeof(m_tail)];
+        memcpy(tail, m_tail, m_tail_size);
+        WriteLE32(tail + 12, nNonce);
+        unsigned char first[CSHA256::OUTPUT_SIZE];
+        CSHA256(m_midstate).Write(tail, m_tail_size).Finalize(first);
+        uint256 hash;
+        CSHA256().Write(first, sizeof(first)).Finalize(hash.begin());
+        return hash;
+    }
+};
+
+} // namespace
+
+bool GrindProofOfWork(CBlockHeader& header, uint32_t nMaxNonce, uint64_t& nMaxTries, const Consensus::Params& params, int nThreads)
+{
+    const uint32_t nStart = header.nNonce;
+    if (nStart >= nMaxNonce || nMaxTries == 0) {
+        return false;
+    }
+    const uint32_t nEnd = nStart + (uint32_t)std::min<uint64_t>(nMaxTries, nMaxNonce - nStart);
+
+    // Equivalent to CheckProofOfWork, with the target decoded once. No nonce
+    // meets a target out of range, but the tries are spent all the same.
+    bool fNegative;
+    bool fOverflow;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(header.nBits, &fNegative, &fOverflow);
+    if (fNegative || bnTarget == 0 || fOverflow || bnTarget > UintToArith256(params.powLimitStart)) {
+        nMaxTries -= nEnd - nStart;
+        header.nNonce = nEnd;
+        return false;
+    }
+
+    const HeaderHasher hasher(header);
+    const uint32_t nBatchEnd = nStart + std::min(POW_GRIND_BATCH, nEnd - nStart);
+    uint32_t nNonce = nStart;
+    while (nNonce < nBatchEnd && UintToArith256(hasher.GetHash(nNonce)) > bnTarget) {
+        ++nNonce;
+    }
+
+    if (nNonce == nBatchEnd && nBatchEnd < nEnd) {
+        // Threads claim chunks in order and skip those above the lowest
+        // nonce found so far, so every chunk below it is searched in full.
+        std::atomic<uint32_t> nNextChunk(nBatchEnd);
+        std::atomic<uint32_t> nFound(nEnd);
+        auto grind = [&]() {
+            while (true) {
+                uint32_t nChunk = nNextChunk.load();
+                do {
+                    if (nChunk >= nEnd || nChunk >= nFound.load()) return;
+                } while (!nNextChunk.compare_exchange_weak(nChunk, nChunk + std::min(POW_GRIND_CHUNK, nEnd - nChunk)));
+                const uint32_t nChunkEnd = nChunk + std::min(POW_GRIND_CHUNK, nEnd - nChunk);
+                for (uint32_t n = nChunk; n < nChunkEnd; ++n) {
+                    if (UintToArith256(hasher.GetHash(n)) <= bnTarget) {
+                        uint32_t nPrev = nFound.load();
+                        while (n < nPrev && !nFound.compare_exchange_weak(nPrev, n)) {}
+                        return;
+                    }
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int i = 1; i < nThreads; ++i) {
+            threads.emplace_back(grind);
+        }
+        grind();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        nNonce = nFound.load();
+    }
+
+    nMaxTries -= nNonce - nStart;
+    header.nNonce = nNonce;
+    return nNonce < nEnd;
+}
+
 #ifdef ENABLE_WALLET
 //////////////////////////////////////////////////////////////////////////////
 //
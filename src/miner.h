@@ -7,10 +7,15 @@
 #define BITCOIN_MINER_H
 
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
+#include <uint256.h>
+#include <validationinterface.h>
 
 #include <stdint.h>
+#include <chrono>
 #include <memory>
+#include <thread>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 
@@ -26,6 +31,10 @@ namespace boost {
 } // namespace boost
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -blocktemplaterefresh, the minimum time in milliseconds between background template rebuilds */
+static const int64_t DEFAULT_BLOCK_TEMPLATE_REFRESH = 500;
+/** Seconds after the last getblocktemplate call that the background builder keeps the template up to date */
+static const int64_t BLOCK_TEMPLATE_IDLE_TIMEOUT = 60;
 
 struct CBlockTemplate
 {
@@ -200,10 +209,96 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/**
+ * Keeps a block template on top of the current tip up to date in the
+ * background, so that getblocktemplate can hand out a copy instead of
+ * assembling a block, with cs_main and mempool.cs held, on every call.
+ *
+ * The template is rebuilt on its own thread when the tip changes, and at most
+ * once per refresh interval while transactions enter and leave the mempool.
+ * The builder only does so while getblocktemplate is being polled; after
+ * BLOCK_TEMPLATE_IDLE_TIMEOUT seconds without a request it goes idle until
+ * the next one.
+ */
+class BlockTemplateBuilder final : public CValidationInterface
+{
+public:
+    struct Snapshot {
+        /** The template, which includes witness transactions; null if there is none. */
+        std::shared_ptr<const CBlockTemplate> block_template;
+        /** Increases with every template built. */
+        uint64_t sequence = 0;
+        /** mempool.GetTransactionsUpdated() from before the template was assembled. */
+        unsigned int transactions_updated = 0;
+        /** The fees the template collects. */
+        CAmount fees = 0;
+    };
+
+    BlockTemplateBuilder(const CChainParams& params, std::chrono::milliseconds refresh_interval);
+    ~BlockTemplateBuilder();
+
+    /** Start the builder thread and register for mempool and tip notifications. */
+    void Start();
+    void Interrupt();
+    void Stop();
+
+    /**
+     * Get the latest template, and keep the builder busy for the next
+     * BLOCK_TEMPLATE_IDLE_TIMEOUT seconds. Returns an empty snapshot while the
+     * template may be missing mempool changes from an idle period. The caller
+     * must check the template builds on the current tip.
+     */
+    Snapshot GetSnapshot();
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& ptx) override;
+
+private:
+    const CChainParams& m_chainparams;
+    const std::chrono::milliseconds m_refresh_interval;
+
+    CWaitableCriticalSection m_cs;
+    CConditionVariable m_cv;
+    Snapshot m_snapshot;
+    /** Whether the mempool or tip changed since the template was built. */
+    bool m_dirty = true;
+    bool m_tip_changed = false;
+    bool m_interrupted = false;
+    std::chrono::steady_clock::time_point m_last_request;
+    std::chrono::steady_clock::time_point m_last_build;
+
+    std::thread m_thread;
+
+    bool IsInUse() const;
+    void MarkDirty(bool tip_changed);
+    void ThreadBuild();
+};
+
+/** The background template builder used by getblocktemplate. May be null. */
+extern std::unique_ptr<BlockTemplateBuilder> g_block_template_builder;
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
+/**
+ * Search for a proof-of-work nonce, trying the nonces from the header's nNonce
+ * up to but not including nMaxNonce, at most nMaxTries of them. On success the
+ * header's nNonce is set to the lowest nonce that meets its nBits and true is
+ * returned; otherwise nNonce is left where the search stopped.
+ *
+ * The header is serialized once and the SHA256 state after its first 64 bytes
+ * reused for every nonce. The first POW_GRIND_BATCH nonces are tried on the
+ * calling thread, which on easy targets such as regtest's nearly always
+ * suffices; the rest of the range is shared out among nThreads threads.
+ * nMaxTries is decreased by the number of nonces that fail before the one
+ * found, as if they had been tried one by one, so the outcome does not
+ * depend on nThreads.
+ */
+bool GrindProofOfWork(CBlockHeader& header, uint32_t nMaxNonce, uint64_t& nMaxTries, const Consensus::Params& params, int nThreads);
+
 void MintStake(boost::thread_group& threadGroup, CWallet* pwallet);
 
 #endif // BITCOIN_MINER_H
@@ -12,6 +12,8 @@
 #include <txmempool.h>
 #include <util.h>
 
+#include <tuple>
+
 static constexpr double INF_FEERATE = 1e99;
 
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
@@ -68,6 +70,10 @@ bool FeeModeFromString(const std::string& mode_string, FeeEstimateMode& fee_esti
  *
  * The tracking of unconfirmed (mempool) transactions is completely independent of the
  * historical tracking of transactions that have been confirmed in a block.
+ *
+ * The per confirmation count and bucket tables are each kept in one contiguous
+ * vector, row by row, so that decaying them and summing over buckets walks
+ * memory in order.
  */
 class TxConfirmStats
 {
@@ -76,6 +82,12 @@ private:
     const std::vector<double>& buckets;              // The upper-bound of the range for the bucket (inclusive)
     const std::map<double, unsigned int>& bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
+    // Number of buckets, the row length of the tables below
+    size_t bucketCount;
+
+    // Number of periods of scale blocks that confirmations are tracked for
+    unsigned int maxPeriods;
+
     // For each bucket X:
     // Count the total # of txs in each bucket
     // Track the historical moving average of this total over blocks
@@ -83,11 +95,11 @@ private:
 
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    std::vector<double> confAvg; // confAvg[Y * bucketCount + X]
 
     // Track moving avg of txs which have been evicted from the mempool
     // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    std::vector<double> failAvg; // failAvg[Y * bucketCount + X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
@@ -104,10 +116,17 @@ private:
     // Mempool counts of outstanding transactions
     // For each bucket X, track the number of transactions in the mempool
     // that are unconfirmed for each possible confirmation value Y
-    std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
+    std::vector<int> unconfTxs;  //unconfTxs[Y * bucketCount + X]
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
 
+    // Results of EstimateMedianVal since the data last changed, keyed by its
+    // arguments. Wallets ask for the same few targets over and over, while
+    // the answers only move when a block arrives or a tracked transaction
+    // leaves the mempool.
+    typedef std::tuple<int, double, double, bool, unsigned int> EstimateKey;
+    mutable std::map<EstimateKey, std::pair<double, EstimationResult>> estimateCache;
+
     void resizeInMemoryCounters(size_t newbuckets);
 
 public:
@@ -159,7 +178,7 @@ public:
                              EstimationResult *result = nullptr) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return scale * maxPeriods; }
 
     /** Write state of estimation data to a file*/
     void Write(CAutoFile& fileout) const;
@@ -174,42 +193,35 @@ public:
 
 TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
                                 const std::map<double, unsigned int>& defaultBucketMap,
-                               unsigned int maxPeriods, double _decay, unsigned int _scale)
-    : buckets(defaultBuckets), bucketMap(defaultBucketMap)
+                               unsigned int _maxPeriods, double _decay, unsigned int _scale)
+    : buckets(defaultBuckets), bucketMap(defaultBucketMap), bucketCount(defaultBuckets.size()), maxPeriods(_maxPeriods)
 {
     decay = _decay;
     assert(_scale != 0 && "_scale must be non-zero");
     scale = _scale;
-    confAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        confAvg[i].resize(buckets.size());
-    }
-    failAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        failAvg[i].resize(buckets.size());
-    }
+    confAvg.resize(maxPeriods * bucketCount);
+    failAvg.resize(maxPeriods * bucketCount);
 
-    txCtAvg.resize(buckets.size());
-    avg.resize(buckets.size());
+    txCtAvg.resize(bucketCount);
+    avg.resize(bucketCount);
 
-    resizeInMemoryCounters(buckets.size());
+    resizeInMemoryCounters(bucketCount);
 }
 
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
     // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
-    unconfTxs.resize(GetMaxConfirms());
-    for (unsigned int i = 0; i < unconfTxs.size(); i++) {
-        unconfTxs[i].resize(newbuckets);
-    }
+    unconfTxs.assign(GetMaxConfirms() * newbuckets, 0);
     oldUnconfTxs.resize(newbuckets);
 }
 
 // Roll the unconfirmed txs circular buffer
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
+    estimateCache.clear();
+    int* row = &unconfTxs[(nBlockHeight % GetMaxConfirms()) * bucketCount];
+    for (unsigned int j = 0; j < bucketCount; j++) {
+        oldUnconfTxs[j] += row[j];
+        row[j] = 0;
     }
 }
 
@@ -219,10 +231,11 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
     // blocksToConfirm is 1-based
     if (blocksToConfirm < 1)
         return;
+    estimateCache.clear();
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+    for (size_t i = periodsToConfirm; i <= maxPeriods; i++) {
+        confAvg[(i - 1) * bucketCount + bucketindex]++;
     }
     txCtAvg[bucketindex]++;
     avg[bucketindex] += val;
@@ -230,11 +243,12 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
 
 void TxConfirmStats::UpdateMovingAverages()
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
-        for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
+    estimateCache.clear();
+    for (double& v : confAvg)
+        v *= decay;
+    for (double& v : failAvg)
+        v *= decay;
+    for (unsigned int j = 0; j < bucketCount; j++) {
         avg[j] = avg[j] * decay;
         txCtAvg[j] = txCtAvg[j] * decay;
     }
@@ -245,6 +259,13 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
                                          double successBreakPoint, bool requireGreater,
                                          unsigned int nBlockHeight, EstimationResult *result) const
 {
+    const EstimateKey key(confTarget, sufficientTxVal, successBreakPoint, requireGreater, nBlockHeight);
+    auto cached = estimateCache.find(key);
+    if (cached != estimateCache.end()) {
+        if (result) *result = cached->second.second;
+        return cached->second.first;
+    }
+
     // Counters for a bucket (or range of buckets)
     double nConf = 0; // Number of tx's confirmed within the confTarget
     double totalNum = 0; // Total number of tx's that were ever confirmed
@@ -272,7 +293,18 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int bestFarBucket = startbucket;
 
     bool foundAnswer = false;
-    unsigned int bins = unconfTxs.size();
+    unsigned int bins = GetMaxConfirms();
+
+    // Number of tx's in each bucket still in the mempool for confTarget or
+    // longer, summed a whole row of the circular buffer at a time
+    std::vector<int> extraPerBucket(oldUnconfTxs);
+    for (unsigned int confct = confTarget; confct < bins; confct++) {
+        const int* row = &unconfTxs[((nBlockHeight - confct) % bins) * bucketCount];
+        for (unsigned int j = 0; j < bucketCount; j++)
+            extraPerBucket[j] += row[j];
+    }
+    const double* confRow = &confAvg[(periodTarget - 1) * bucketCount];
+    const double* failRow = &failAvg[(periodTarget - 1) * bucketCount];
     bool newBucketRange = true;
     bool passing = true;
     EstimatorBucket passBucket;
@@ -285,12 +317,10 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
+        nConf += confRow[bucket];
         totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
-        for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
-        extraNum += oldUnconfTxs[bucket];
+        failNum += failRow[bucket];
+        extraNum += extraPerBucket[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
         // (Only count the confirmed data points, so that each confirmation count
@@ -384,23 +414,51 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
              failBucket.withinTarget, failBucket.totalConfirmed, failBucket.inMempool, failBucket.leftMempool);
 
 
-    if (result) {
-        result->pass = passBucket;
-        result->fail = failBucket;
-        result->decay = decay;
-        result->scale = scale;
-    }
+    std::pair<double, EstimationResult>& entry = estimateCache[key];
+    entry.first = median;
+    entry.second.pass = passBucket;
+    entry.second.fail = failBucket;
+    entry.second.decay = decay;
+    entry.second.scale = scale;
+    if (result) *result = entry.second;
     return median;
 }
 
+/** Write a table the way a std::vector<std::vector<double>> of its rows is serialized */
+static void WriteTable(CAutoFile& fileout, const std::vector<double>& table, size_t rows, size_t columns)
+{
+    WriteCompactSize(fileout, rows);
+    for (size_t i = 0; i < rows; i++) {
+        WriteCompactSize(fileout, columns);
+        for (size_t j = 0; j < columns; j++) {
+            fileout << table[i * columns + j];
+        }
+    }
+}
+
+/** Read a table written by WriteTable, checking that every row has the given length */
+static void ReadTable(CAutoFile& filein, std::vector<double>& table, size_t columns, const char* error)
+{
+    std::vector<std::vector<double>> rows;
+    filein >> rows;
+    table.clear();
+    table.reserve(rows.size() * columns);
+    for (const auto& row : rows) {
+        if (row.size() != columns) {
+            throw std::runtime_error(error);
+        }
+        table.insert(table.end(), row.begin(), row.end());
+    }
+}
+
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
     fileout << decay;
     fileout << scale;
     fileout << avg;
     fileout << txCtAvg;
-    fileout << confAvg;
-    fileout << failAvg;
+    WriteTable(fileout, confAvg, maxPeriods, bucketCount);
+    WriteTable(fileout, failAvg, maxPeriods, bucketCount);
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -408,7 +466,7 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     // Read data file and do some very basic sanity checking
     // buckets and bucketMap are not updated yet, so don't access them
     // If there is a read failure, we'll just discard this entire object anyway
-    size_t maxConfirms, maxPeriods;
+    size_t maxConfirms;
 
     // The current version will store the decay with each individual TxConfirmStats and also keep a scale factor
     filein >> decay;
@@ -428,28 +486,20 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     if (txCtAvg.size() != numBuckets) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
     }
-    filein >> confAvg;
-    maxPeriods = confAvg.size();
+    ReadTable(filein, confAvg, numBuckets, "Corrupt estimates file. Mismatch in feerate conf average bucket count");
+    bucketCount = numBuckets;
+    maxPeriods = confAvg.size() / numBuckets;
     maxConfirms = scale * maxPeriods;
 
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
     }
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (confAvg[i].size() != numBuckets) {
-            throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
-        }
-    }
 
-    filein >> failAvg;
-    if (maxPeriods != failAvg.size()) {
+    ReadTable(filein, failAvg, numBuckets, "Corrupt estimates file. Mismatch in one of failure average bucket counts");
+    if (maxPeriods * numBuckets != failAvg.size()) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in confirms tracked for failures");
     }
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (failAvg[i].size() != numBuckets) {
-            throw std::runtime_error("Corrupt estimates file. Mismatch in one of failure average bucket counts");
-        }
-    }
+    estimateCache.clear();
 
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
@@ -461,9 +511,11 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
 
 unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
 {
+    // Transactions only count against estimates once they have waited a block,
+    // so one entering at the height estimates are made for leaves them as is.
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    unsigned int blockIndex = nBlockHeight % unconfTxs.size();
-    unconfTxs[blockIndex][bucketindex]++;
+    unsigned int blockIndex = nBlockHeight % GetMaxConfirms();
+    unconfTxs[blockIndex * bucketCount + bucketindex]++;
     return bucketindex;
 }
 
@@ -478,7 +530,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         return;  //This can't happen because we call this with our best seen height, no entries can have higher
     }
 
-    if (blocksAgo >= (int)unconfTxs.size()) {
+    estimateCache.clear();
+    if (blocksAgo >= (int)GetMaxConfirms()) {
         if (oldUnconfTxs[bucketindex] > 0) {
             oldUnconfTxs[bucketindex]--;
         } else {
@@ -487,9 +540,9 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         }
     }
     else {
-        unsigned int blockIndex = entryHeight % unconfTxs.size();
-        if (unconfTxs[blockIndex][bucketindex] > 0) {
-            unconfTxs[blockIndex][bucketindex]--;
+        unsigned int blockIndex = entryHeight % GetMaxConfirms();
+        if (unconfTxs[blockIndex * bucketCount + bucketindex] > 0) {
+            unconfTxs[blockIndex * bucketCount + bucketindex]--;
         } else {
             LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
@@ -498,8 +551,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
-        for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+        for (size_t i = 0; i < periodsAgo && i < maxPeriods; i++) {
+            failAvg[i * bucketCount + bucketindex]++;
         }
     }
 }
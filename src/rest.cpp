@@ -23,6 +23,7 @@
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const size_t MAX_REST_REPLY_PART = 1 << 16; //hand replies over to libevent in parts of about 64 KiB
 
 enum RetFormat {
     RF_UNDEF,
@@ -326,10 +327,23 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        std::string strJSON = mempoolObject.write() + "\n";
+        // Same as mempoolToJSON(true), written out an entry at a time from a
+        // snapshot rather than built up as one object.
+        std::shared_ptr<const std::vector<TxMempoolEntryStats>> snapshot = mempool.GetSnapshot();
         req->WriteHeader("Content-Type", "application/json");
+        std::string strJSON = "{";
+        for (size_t i = 0; i < snapshot->size(); i++) {
+            const TxMempoolEntryStats& e = (*snapshot)[i];
+            UniValue info(UniValue::VOBJ);
+            entryToJSON(info, e);
+            if (i) strJSON += ",";
+            strJSON += "\"" + e.txid.ToString() + "\":" + info.write();
+            if (strJSON.size() >= MAX_REST_REPLY_PART) {
+                req->WriteReplyPart(strJSON);
+                strJSON.clear();
+            }
+        }
+        strJSON += "}\n";
         req->WriteReply(HTTP_OK, strJSON);
         return true;
     }
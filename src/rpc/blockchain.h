@@ -10,6 +10,7 @@
 class CBlock;
 class CBlockIndex;
 class UniValue;
+struct TxMempoolEntryStats;
 
 /**
  * Get the difficulty of the net wrt to the given block index, or the chain tip if
@@ -33,6 +34,9 @@ UniValue mempoolInfoToJSON();
 /** Mempool to JSON */
 UniValue mempoolToJSON(bool fVerbose = false);
 
+/** Mempool entry to JSON, as getmempoolentry reports it */
+void entryToJSON(UniValue &info, const TxMempoolEntryStats &e);
+
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
@@ -32,17 +32,11 @@ std::vector<KernelRecord> KernelRecord::DecomposeOutputs(const CWallet *wallet,
     int64_t nTime = 0;
     uint256 hash = wtx.GetHash();
 
-    CDiskTxPos postx;
-    if (pblocktree->ReadTxIndex(hash, postx))
     {
-        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-        CBlockHeader header;
-        try {
-            file >> header;
-            nTime = header.GetBlockTime();
-        } catch (std::exception &e) {
-            return kernels;
-        }
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(wtx.hashBlock);
+        if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second))
+            nTime = mi->second->GetBlockTime();
     }
 
     std::map<std::string, std::string> mapValue = wtx.mapValue;
@@ -120,6 +120,7 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
         nHeightEnd = nHeight+nGenerate;
     }
     unsigned int nExtraNonce = 0;
+    const int nThreads = std::max(GetNumCores(), 1);
     UniValue blockHashes(UniValue::VARR);
     while (nHeight < nHeightEnd)
     {
@@ -131,14 +132,10 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
             LOCK(cs_main);
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
-        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus())) {
-            ++pblock->nNonce;
-            --nMaxTries;
-        }
-        if (nMaxTries == 0) {
-            break;
-        }
-        if (pblock->nNonce == nInnerLoopCount) {
+        if (!GrindProofOfWork(*pblock, nInnerLoopCount, nMaxTries, Params().GetConsensus(), nThreads)) {
+            if (nMaxTries == 0) {
+                break;
+            }
             continue;
         }
         std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
@@ -485,6 +482,16 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
         }
 
+        // With the background builder, also respond as soon as the template
+        // collects meaningfully more fees than the one the caller is working on.
+        CAmount nFeesLP = -1;
+        if (g_block_template_builder) {
+            const BlockTemplateBuilder::Snapshot snapshot = g_block_template_builder->GetSnapshot();
+            if (snapshot.block_template && snapshot.block_template->block.hashPrevBlock == hashWatchedChain) {
+                nFeesLP = snapshot.fees;
+            }
+        }
+
         LEAVE_CRITICAL_SECTION(cs_main);
         {
             checktxtime = std::chrono::steady_clock::now() + std::chrono::minutes(1);
@@ -492,6 +499,13 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             WaitableLock lock(csBestBlock);
             while (chainActive.Tip()->GetBlockHash() == hashWatchedChain && IsRPCRunning())
             {
+                if (nFeesLP >= 0) {
+                    const BlockTemplateBuilder::Snapshot snapshot = g_block_template_builder->GetSnapshot();
+                    if (snapshot.block_template && snapshot.block_template->block.hashPrevBlock == hashWatchedChain &&
+                        snapshot.fees > nFeesLP + nFeesLP / 100) {
+                        break;
+                    }
+                }
                 if (cvBlockChange.wait_until(lock, checktxtime) == std::cv_status::timeout)
                 {
                     // Timeout: Check transactions for update
@@ -521,12 +535,30 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     // Cache whether the last invocation was with segwit support, to avoid returning
     // a segwit-block to a non-segwit caller.
     static bool fLastTemplateSupportsSegwit = true;
-    if (pindexPrev != chainActive.Tip() ||
+    // Sequence number of the background builder's template in use, if any.
+    static uint64_t nSnapshotLast = 0;
+    BlockTemplateBuilder::Snapshot snapshot;
+    if (g_block_template_builder && fSupportsSegwit) {
+        snapshot = g_block_template_builder->GetSnapshot();
+    }
+    if (snapshot.block_template && snapshot.block_template->block.hashPrevBlock == chainActive.Tip()->GetBlockHash())
+    {
+        if (pindexPrev != chainActive.Tip() || nSnapshotLast != snapshot.sequence || !fLastTemplateSupportsSegwit) {
+            pblocktemplate.reset(new CBlockTemplate(*snapshot.block_template));
+            nTransactionsUpdatedLast = snapshot.transactions_updated;
+            nStart = GetTime();
+            fLastTemplateSupportsSegwit = true;
+            nSnapshotLast = snapshot.sequence;
+            pindexPrev = chainActive.Tip();
+        }
+    }
+    else if (pindexPrev != chainActive.Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
         fLastTemplateSupportsSegwit != fSupportsSegwit)
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = nullptr;
+        nSnapshotLast = 0;
 
         // Store the pindexBest used before CreateNewBlock, to avoid races
         nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
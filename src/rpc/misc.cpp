@@ -8,6 +8,8 @@
 #include <clientversion.h>
 #include <core_io.h>
 #include <crypto/ripemd160.h>
+#include <index/addressindex.h>
+#include <index/spentindex.h>
 #include <init.h>
 #include <validation.h>
 #include <httpserver.h>
@@ -16,6 +18,7 @@
 #include <rpc/blockchain.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
+#include <script/sigcache.h>
 #include <timedata.h>
 #include <util.h>
 #include <utilstrencodings.h>
@@ -26,6 +29,8 @@
 #endif
 #include <warnings.h>
 
+#include <limits>
+#include <set>
 #include <stdint.h>
 #ifdef HAVE_MALLOC_INFO
 #include <malloc.h>
@@ -572,6 +577,18 @@ static std::string RPCMallocInfo()
 }
 #endif
 
+static UniValue RPCSignatureCacheInfo()
+{
+    SignatureCacheStats stats = GetSignatureCacheStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("shards", (uint64_t)SIGNATURE_CACHE_SHARDS));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    obj.push_back(Pair("inserts", stats.nInserts));
+    obj.push_back(Pair("contended", stats.nContended));
+    return obj;
+}
+
 UniValue getmemoryinfo(const JSONRPCRequest& request)
 {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
@@ -594,6 +611,13 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"sigcache\": {             (json object) Information about the signature cache\n"
+            "    \"shards\": xx,           (numeric) Number of independently locked parts of the cache\n"
+            "    \"hits\": xxxxx,          (numeric) Number of lookups that found the signature\n"
+            "    \"misses\": xxxxx,        (numeric) Number of lookups that didn't\n"
+            "    \"inserts\": xxxxx,       (numeric) Number of signatures added\n"
+            "    \"contended\": xxxxx,     (numeric) Number of lookups and inserts that had to wait for another thread\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
@@ -607,6 +631,7 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+        obj.push_back(Pair("sigcache", RPCSignatureCacheInfo()));
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -705,6 +730,303 @@ UniValue logging(const JSONRPCRequest& request)
     return result;
 }
 
+static const std::string ADDRESS_INDEX_ARGUMENT =
+    "1. {\n"
+    "  \"addresses\"\n"
+    "    [\n"
+    "      \"address\"  (string) The base58check or bech32 encoded address\n"
+    "      ,...\n"
+    "    ]\n"
+    "}\n";
+
+/** Parse a single address or an {"addresses": [...]} object into index keys. */
+static std::vector<std::pair<std::string, CIndexedAddress>> ParseIndexedAddresses(const UniValue& param)
+{
+    std::vector<std::string> strings;
+    if (param.isStr()) {
+        strings.push_back(param.get_str());
+    } else if (param.isObject()) {
+        const UniValue& addresses = find_value(param.get_obj(), "addresses");
+        if (!addresses.isArray()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        }
+        for (const UniValue& address : addresses.getValues()) {
+            strings.push_back(address.get_str());
+        }
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or an object with an addresses array");
+    }
+
+    std::vector<std::pair<std::string, CIndexedAddress>> result;
+    for (const std::string& str : strings) {
+        CIndexedAddress address;
+        if (!GetIndexedAddress(DecodeDestination(str), address)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + str);
+        }
+        result.emplace_back(str, address);
+    }
+    return result;
+}
+
+/** Wait for an index to process the blocks connected so far. */
+static void WaitForIndex(BaseIndex* index, const std::string& flag)
+{
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Index is not enabled. Use -%s to enable it", flag));
+    }
+    if (!index->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("The %s is still in the process of being built", flag));
+    }
+}
+
+UniValue getaddresstxids(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddresstxids {\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the txids touching the given addresses, in chain order (requires -addressindex).\n"
+            "\nArguments:\n"
+            + ADDRESS_INDEX_ARGUMENT +
+            "  \"start\"   (number, optional) The first block height to include\n"
+            "  \"end\"     (number, optional) The last block height to include\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\"]}'")
+            + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\"]}")
+        );
+
+    int nStartHeight = 0;
+    int nEndHeight = std::numeric_limits<int>::max();
+    if (request.params[0].isObject()) {
+        const UniValue& start = find_value(request.params[0].get_obj(), "start");
+        const UniValue& end = find_value(request.params[0].get_obj(), "end");
+        if (!start.isNull()) nStartHeight = start.get_int();
+        if (!end.isNull()) nEndHeight = end.get_int();
+        if (nEndHeight < nStartHeight) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "End height is below start height");
+        }
+    }
+
+    const auto addresses = ParseIndexedAddresses(request.params[0]);
+    WaitForIndex(g_addressindex.get(), "addressindex");
+
+    // Merge the histories by chain position; a transaction touching several
+    // addresses is listed once.
+    std::set<std::pair<std::pair<int, uint32_t>, uint256>> txids;
+    for (const auto& address : addresses) {
+        std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+        if (!g_addressindex->FindHistory(address.second, entries, nStartHeight, nEndHeight)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index for " + address.first);
+        }
+        for (const auto& entry : entries) {
+            txids.emplace(std::make_pair(entry.first.nHeight, entry.first.nTxIndex), entry.first.txid);
+        }
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const auto& txid : txids) {
+        result.push_back(txid.second.GetHex());
+    }
+    return result;
+}
+
+UniValue getaddressdeltas(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressdeltas {\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns all changes to the given addresses, in chain order (requires -addressindex).\n"
+            "\nArguments:\n"
+            + ADDRESS_INDEX_ARGUMENT +
+            "  \"start\"   (number, optional) The first block height to include\n"
+            "  \"end\"     (number, optional) The last block height to include\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"satoshis\"  (number) The difference of satoshis\n"
+            "    \"txid\"      (string) The related txid\n"
+            "    \"index\"     (number) The related input or output index\n"
+            "    \"height\"    (number) The block height\n"
+            "    \"address\"   (string) The address\n"
+            "  }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\"]}'")
+            + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\"]}")
+        );
+
+    int nStartHeight = 0;
+    int nEndHeight = std::numeric_limits<int>::max();
+    if (request.params[0].isObject()) {
+        const UniValue& start = find_value(request.params[0].get_obj(), "start");
+        const UniValue& end = find_value(request.params[0].get_obj(), "end");
+        if (!start.isNull()) nStartHeight = start.get_int();
+        if (!end.isNull()) nEndHeight = end.get_int();
+        if (nEndHeight < nStartHeight) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "End height is below start height");
+        }
+    }
+
+    const auto addresses = ParseIndexedAddresses(request.params[0]);
+    WaitForIndex(g_addressindex.get(), "addressindex");
+
+    UniValue result(UniValue::VARR);
+    for (const auto& address : addresses) {
+        std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+        if (!g_addressindex->FindHistory(address.second, entries, nStartHeight, nEndHeight)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index for " + address.first);
+        }
+        for (const auto& entry : entries) {
+            UniValue delta(UniValue::VOBJ);
+            delta.pushKV("satoshis", entry.second);
+            delta.pushKV("txid", entry.first.txid.GetHex());
+            delta.pushKV("index", (int)entry.first.nIndex);
+            delta.pushKV("height", entry.first.nHeight);
+            delta.pushKV("address", address.first);
+            result.push_back(delta);
+        }
+    }
+    return result;
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressbalance {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the balance of the given addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            + ADDRESS_INDEX_ARGUMENT +
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\"   (number) The current balance in satoshis\n"
+            "  \"received\"  (number) The total number of satoshis received (including change)\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\"]}'")
+            + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\"]}")
+        );
+
+    const auto addresses = ParseIndexedAddresses(request.params[0]);
+    WaitForIndex(g_addressindex.get(), "addressindex");
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (const auto& address : addresses) {
+        CAddressBalance balance;
+        if (!g_addressindex->FindBalance(address.second, balance)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index for " + address.first);
+        }
+        nBalance += balance.nBalance;
+        nReceived += balance.nReceived;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("balance", nBalance);
+    result.pushKV("received", nReceived);
+    return result;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressutxos {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the unspent outputs of the given addresses in the active chain (requires -addressindex).\n"
+            "\nArguments:\n"
+            + ADDRESS_INDEX_ARGUMENT +
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\"      (string) The address\n"
+            "    \"txid\"         (string) The output txid\n"
+            "    \"outputIndex\"  (number) The output index\n"
+            "    \"script\"       (string) The script hex encoded\n"
+            "    \"satoshis\"     (number) The number of satoshis of the output\n"
+            "    \"height\"       (number) The block height\n"
+            "  }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\"]}'")
+            + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\"]}")
+        );
+
+    const auto addresses = ParseIndexedAddresses(request.params[0]);
+    WaitForIndex(g_addressindex.get(), "addressindex");
+
+    UniValue result(UniValue::VARR);
+    for (const auto& address : addresses) {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> unspent;
+        if (!g_addressindex->FindUnspent(address.second, unspent)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index for " + address.first);
+        }
+        for (const auto& entry : unspent) {
+            UniValue output(UniValue::VOBJ);
+            output.pushKV("address", address.first);
+            output.pushKV("txid", entry.first.txid.GetHex());
+            output.pushKV("outputIndex", (int)entry.first.nIndex);
+            output.pushKV("script", HexStr(entry.second.script.begin(), entry.second.script.end()));
+            output.pushKV("satoshis", entry.second.nValue);
+            output.pushKV("height", entry.second.nHeight);
+            result.push_back(output);
+        }
+    }
+    return result;
+}
+
+UniValue getspentinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1 || !request.params[0].isObject())
+        throw std::runtime_error(
+            "getspentinfo {\"txid\": \"txid\", \"index\": n}\n"
+            "\nReturns the txid and input index spending the given output (requires -spentindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"txid\"   (string) The hex string of the txid\n"
+            "  \"index\"  (number) The output index\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\"      (string) The spending transaction id\n"
+            "  \"index\"     (number) The spending input index\n"
+            "  \"height\"    (number) The height of the block containing the spending transaction\n"
+            "  \"satoshis\"  (number) The value of the spent output\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'")
+            + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
+        );
+
+    RPCTypeCheckObj(request.params[0].get_obj(),
+        {
+            {"txid", UniValueType(UniValue::VSTR)},
+            {"index", UniValueType(UniValue::VNUM)},
+        });
+    const uint256 txid = ParseHashO(request.params[0], "txid");
+    const int nIndex = find_value(request.params[0].get_obj(), "index").get_int();
+    if (nIndex < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid output index");
+    }
+
+    WaitForIndex(g_spentindex.get(), "spentindex");
+
+    CSpentIndexValue value;
+    if (!g_spentindex->FindSpent(COutPoint(txid, nIndex), value)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("txid", value.txid.GetHex());
+    result.pushKV("index", (int)value.nInput);
+    result.pushKV("height", value.nHeight);
+    result.pushKV("satoshis", value.nValue);
+    return result;
+}
+
 UniValue echo(const JSONRPCRequest& request)
 {
     if (request.fHelp)
@@ -729,6 +1051,12 @@ static const CRPCCommand commands[] =
     { "util",               "verifymessage",          &verifymessage,          {"address","signature","message"} },
     { "util",               "signmessagewithprivkey", &signmessagewithprivkey, {"privkey","message"} },
 
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        {"addresses"} },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       {"addresses"} },
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      {"addresses"} },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        {"addresses"} },
+    { "addressindex",       "getspentinfo",           &getspentinfo,           {"outpoint"} },
+
     /* Not shown in help */
     { "hidden",             "setmocktime",            &setmocktime,            {"timestamp"}},
     { "hidden",             "echo",                   &echo,                   {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
@@ -8,6 +8,7 @@
 #include <coins.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <index/txindex.h>
 #include <init.h>
 #include <keystore.h>
 #include <validation.h>
@@ -141,6 +142,13 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
             + HelpExampleCli("getrawtransaction", "\"mytxid\" true \"myblockhash\"")
         );
 
+    // The transaction index is updated from the validation interface queue,
+    // so let it catch up before taking cs_main.
+    bool f_txindex_ready = false;
+    if (g_txindex && request.params[2].isNull()) {
+        f_txindex_ready = g_txindex->BlockUntilSyncedToCurrentChain();
+    }
+
     LOCK(cs_main);
 
     bool in_active_chain = true;
@@ -189,10 +197,12 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
                 throw JSONRPCError(RPC_MISC_ERROR, "Block not available");
             }
             errmsg = "No such transaction found in the provided block";
+        } else if (!g_txindex) {
+            errmsg = "No such mempool transaction. Use -txindex to enable blockchain transaction queries";
+        } else if (!f_txindex_ready) {
+            errmsg = "No such mempool transaction. Blockchain transactions are still in the process of being indexed";
         } else {
-            errmsg = fTxIndex
-              ? "No such mempool or blockchain transaction"
-              : "No such mempool transaction. Use -txindex to enable blockchain transaction queries";
+            errmsg = "No such mempool or blockchain transaction";
         }
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, errmsg + ". Use gettransaction for wallet transactions.");
     }
@@ -994,6 +1004,8 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     if (!request.params[1].isNull() && request.params[1].get_bool())
         nMaxRawTxFee = 0;
 
+    PrevalidateTransaction(tx);
+
     { // cs_main scope
     LOCK(cs_main);
     CCoinsViewCache &view = *pcoinsTip;
@@ -1051,6 +1063,114 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     return hashTx.GetHex();
 }
 
+UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits a set of raw transactions (serialized, hex-encoded) to local node and network, in one go.\n"
+            "\nThe transactions may spend each other's outputs, in any order. Each is accepted or rejected on its own;\n"
+            "the ones that depend on a rejected transaction are rejected for missing inputs.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"     (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (array) The result of each transaction, in the order given\n"
+            "  {\n"
+            "    \"txid\": \"hex\",          (string) The transaction hash in hex\n"
+            "    \"allowed\": true|false,  (boolean) Whether the transaction is in the mempool\n"
+            "    \"reject-reason\": \"str\"  (string) Why the transaction was rejected, when it was\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex\\\"]\"")
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex\"]")
+        );
+
+    ObserveSafeMode();
+
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+    const UniValue& hexstrings = request.params[0].get_array();
+    std::vector<CTransactionRef> package;
+    package.reserve(hexstrings.size());
+    for (size_t i = 0; i < hexstrings.size(); i++) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, hexstrings[i].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        package.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (!request.params[1].isNull() && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    // Only the transactions spending confirmed or mempool outputs can be
+    // checked ahead; their children are verified under the lock.
+    for (const CTransactionRef& tx : package) {
+        PrevalidateTransaction(tx);
+    }
+
+    std::promise<void> promise;
+    std::vector<PackageTxResult> results;
+    {
+        LOCK(cs_main);
+        // Leave out what is already known, as sendrawtransaction does.
+        std::vector<CTransactionRef> vToSubmit;
+        std::vector<size_t> vSubmitted;
+        for (size_t i = 0; i < package.size(); i++) {
+            if (!mempool.exists(package[i]->GetHash())) {
+                vToSubmit.push_back(package[i]);
+                vSubmitted.push_back(i);
+            }
+        }
+        std::vector<PackageTxResult> submitted;
+        AcceptPackageToMemoryPool(mempool, vToSubmit, submitted, nullptr /* plTxnReplaced */, false /* bypass_limits */, nMaxRawTxFee);
+        results.resize(package.size());
+        for (size_t i = 0; i < package.size(); i++) {
+            results[i].fAccepted = true;
+        }
+        for (size_t j = 0; j < vSubmitted.size(); j++) {
+            results[vSubmitted[j]] = submitted[j];
+        }
+
+        // Make the wallet aware of the new transactions before returning,
+        // as sendrawtransaction does.
+        CallFunctionInValidationInterfaceQueue([&promise] {
+            promise.set_value();
+        });
+    }
+    promise.get_future().wait();
+
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < package.size(); i++) {
+        const uint256& hashTx = package[i]->GetHash();
+        const PackageTxResult& result = results[i];
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", hashTx.GetHex());
+        entry.pushKV("allowed", result.fAccepted);
+        if (result.fAccepted) {
+            CInv inv(MSG_TX, hashTx);
+            g_connman->ForEachNode([&inv](CNode* pnode)
+            {
+                pnode->PushInventory(inv);
+            });
+        } else if (result.state.IsInvalid()) {
+            entry.pushKV("reject-reason", strprintf("%i: %s", result.state.GetRejectCode(), result.state.GetRejectReason()));
+        } else if (result.fMissingInputs) {
+            entry.pushKV("reject-reason", "missing-inputs");
+        } else {
+            entry.pushKV("reject-reason", result.state.GetRejectReason());
+        }
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1059,6 +1179,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   {"hexstring","iswitness"} },
     { "rawtransactions",    "decodescript",           &decodescript,           {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    {"hexstrings","allowhighfees"} },
     { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  {"txs"} },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
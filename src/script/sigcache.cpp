@@ -12,6 +12,9 @@
 #include <util.h>
 
 #include <cuckoocache.h>
+
+#include <atomic>
+
 #include <boost/thread.hpp>
 
 namespace {
@@ -19,15 +22,47 @@ namespace {
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
+ *
+ * The cache is split into shards by the first byte of the entries, which
+ * are uniformly distributed, each with its own lock. Lookups only take a
+ * shared lock, and as entries are spread over the shards, inserts rarely
+ * block a lookup of another thread.
  */
 class CSignatureCache
 {
 private:
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+
+    struct Shard
+    {
+        map_type setValid;
+        boost::shared_mutex cs_shard;
+        std::atomic<uint64_t> nHits{0};
+        std::atomic<uint64_t> nMisses{0};
+        std::atomic<uint64_t> nInserts{0};
+        std::atomic<uint64_t> nContended{0};
+    };
+
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
+    Shard shards[SIGNATURE_CACHE_SHARDS];
+
+    Shard& GetShard(const uint256& entry)
+    {
+        // The cuckoo hashes are taken from the upper bits of each 32-bit
+        // word, so use the lower bits of the first word.
+        return shards[*entry.begin() % SIGNATURE_CACHE_SHARDS];
+    }
+
+    //! Take lock, counting how often it had to wait for another thread.
+    template <typename Lock>
+    static void LockShard(Shard& shard, Lock& lock)
+    {
+        if (!lock.try_lock()) {
+            shard.nContended.fetch_add(1, std::memory_order_relaxed);
+            lock.lock();
+        }
+    }
 
 public:
     CSignatureCache()
@@ -44,18 +79,59 @@ public:
     bool
     Get(const uint256& entry, const bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        Shard& shard = GetShard(entry);
+        boost::shared_lock<boost::shared_mutex> lock(shard.cs_shard, boost::defer_lock);
+        LockShard(shard, lock);
+        bool fFound = shard.setValid.contains(entry, erase);
+        (fFound ? shard.nHits : shard.nMisses).fetch_add(1, std::memory_order_relaxed);
+        return fFound;
     }
 
-    void Set(uint256& entry)
+    void Set(const uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.insert(entry);
+        Shard& shard = GetShard(entry);
+        boost::unique_lock<boost::shared_mutex> lock(shard.cs_shard, boost::defer_lock);
+        LockShard(shard, lock);
+        shard.setValid.insert(entry);
+        shard.nInserts.fetch_add(1, std::memory_order_relaxed);
     }
+
     uint32_t setup_bytes(size_t n)
     {
-        return setValid.setup_bytes(n);
+        uint32_t nElems = 0;
+        for (Shard& shard : shards) {
+            boost::unique_lock<boost::shared_mutex> lock(shard.cs_shard);
+            nElems += shard.setValid.setup_bytes(n / SIGNATURE_CACHE_SHARDS);
+        }
+        return nElems;
+    }
+
+    void GetEntries(uint256& nonceOut, std::vector<uint256>& entries)
+    {
+        nonceOut = nonce;
+        for (Shard& shard : shards) {
+            boost::shared_lock<boost::shared_mutex> lock(shard.cs_shard);
+            shard.setValid.for_each([&entries](const uint256& entry) { entries.push_back(entry); });
+        }
+    }
+
+    void LoadEntries(const uint256& nonceIn, const std::vector<uint256>& entries)
+    {
+        nonce = nonceIn;
+        for (const uint256& entry : entries)
+            Set(entry);
+    }
+
+    SignatureCacheStats GetStats()
+    {
+        SignatureCacheStats stats;
+        for (const Shard& shard : shards) {
+            stats.nHits += shard.nHits;
+            stats.nMisses += shard.nMisses;
+            stats.nInserts += shard.nInserts;
+            stats.nContended += shard.nContended;
+        }
+        return stats;
     }
 };
 
@@ -80,6 +156,21 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& entries)
+{
+    signatureCache.GetEntries(nonce, entries);
+}
+
+void LoadSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& entries)
+{
+    signatureCache.LoadEntries(nonce, entries);
+}
+
+SignatureCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
@@ -16,8 +16,11 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+// Number of independently locked parts of the signature cache
+static const unsigned int SIGNATURE_CACHE_SHARDS = 16;
 
 class CPubKey;
+class uint256;
 
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
@@ -53,4 +56,26 @@ public:
 
 void InitSignatureCache();
 
+/** Lookup and lock contention counters of the signature cache. */
+struct SignatureCacheStats
+{
+    uint64_t nHits = 0;
+    uint64_t nMisses = 0;
+    uint64_t nInserts = 0;
+    //! Number of lookups and inserts that had to wait for another thread
+    uint64_t nContended = 0;
+};
+
+SignatureCacheStats GetSignatureCacheStats();
+
+/** Get the nonce of the signature cache and the entries in it. */
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& entries);
+
+/**
+ * Replace the nonce of the signature cache and add entries computed with it,
+ * as obtained from GetSignatureCacheEntries() before a restart. Has to be
+ * called before any signature is checked.
+ */
+void LoadSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
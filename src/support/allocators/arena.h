@@ -0,0 +1,205 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
+#define BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+/**
+ * A monotonic memory resource for many small objects that are created
+ * together, like the transactions of a block while it is deserialized.
+ * Allocating is bumping a pointer into the current chunk; memory is never
+ * reused. It has the following properties:
+ *
+ * - Every chunk counts the allocations carved out of it that are still alive,
+ *   plus one while it is the chunk being allocated from. The chunk is freed
+ *   when that count drops to zero, so it does not matter which thread frees
+ *   an allocation, nor whether that happens before or after the resource is
+ *   destroyed.
+ *
+ * - An allocation that stays alive keeps its whole chunk alive. Chunks are
+ *   kept small so that holding on to a few of the objects does not hold on
+ *   to all of them.
+ *
+ * - Each allocation is preceded by a pointer to its chunk, which is what
+ *   Deallocate needs to find it.
+ *
+ * Allocate is not thread-safe, Deallocate is.
+ */
+class ArenaResource final
+{
+public:
+    static constexpr std::size_t DEFAULT_CHUNK_SIZE_BYTES = 4096;
+
+private:
+    struct Chunk {
+        std::atomic<std::size_t> m_refs;
+
+        Chunk() : m_refs(1) {}
+    };
+
+    static constexpr std::size_t ALIGN_BYTES = alignof(std::max_align_t);
+
+    /** Bytes in front of the first allocation of a chunk, and in front of each allocation. */
+    static constexpr std::size_t CHUNK_HEADER_BYTES = (sizeof(Chunk) + ALIGN_BYTES - 1) & ~(ALIGN_BYTES - 1);
+    static constexpr std::size_t ALLOCATION_HEADER_BYTES = (sizeof(Chunk*) + ALIGN_BYTES - 1) & ~(ALIGN_BYTES - 1);
+
+    static std::size_t RoundUp(std::size_t bytes)
+    {
+        return (bytes + ALIGN_BYTES - 1) & ~(ALIGN_BYTES - 1);
+    }
+
+    const std::size_t m_chunk_size_bytes;
+
+    /** The chunk allocations are carved out of, and the part of it that is still unused. */
+    Chunk* m_chunk = nullptr;
+    char* m_available_begin = nullptr;
+    char* m_available_end = nullptr;
+
+    std::size_t m_num_chunks = 0;
+
+    static void Release(Chunk* chunk)
+    {
+        if (chunk->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            chunk->~Chunk();
+            ::operator delete(static_cast<void*>(chunk));
+        }
+    }
+
+    void NewChunk(std::size_t min_bytes)
+    {
+        const std::size_t size = std::max(m_chunk_size_bytes, CHUNK_HEADER_BYTES + min_bytes);
+        char* storage = static_cast<char*>(::operator new(size));
+        if (m_chunk) Release(m_chunk);
+        m_chunk = new (storage) Chunk();
+        m_available_begin = storage + CHUNK_HEADER_BYTES;
+        m_available_end = storage + size;
+        ++m_num_chunks;
+    }
+
+public:
+    explicit ArenaResource(std::size_t chunk_size_bytes = DEFAULT_CHUNK_SIZE_BYTES) : m_chunk_size_bytes(chunk_size_bytes) {}
+
+    ~ArenaResource()
+    {
+        if (m_chunk) Release(m_chunk);
+    }
+
+    ArenaResource(const ArenaResource&) = delete;
+    ArenaResource& operator=(const ArenaResource&) = delete;
+
+    /** Allocate bytes, aligned for any type. */
+    void* Allocate(std::size_t bytes)
+    {
+        const std::size_t needed = ALLOCATION_HEADER_BYTES + RoundUp(bytes);
+        if (static_cast<std::size_t>(m_available_end - m_available_begin) < needed) {
+            NewChunk(needed);
+        }
+        char* header = m_available_begin;
+        m_available_begin += needed;
+        m_chunk->m_refs.fetch_add(1, std::memory_order_relaxed);
+        new (header) Chunk*(m_chunk);
+        return header + ALLOCATION_HEADER_BYTES;
+    }
+
+    /** Free memory returned by Allocate of any ArenaResource, from any thread. */
+    static void Deallocate(void* p)
+    {
+        Release(*reinterpret_cast<Chunk**>(static_cast<char*>(p) - ALLOCATION_HEADER_BYTES));
+    }
+
+    /** Number of chunks allocated so far. */
+    std::size_t NumAllocatedChunks() const
+    {
+        return m_num_chunks;
+    }
+};
+
+/**
+ * Allocator that allocates from an ArenaResource. The resource is only used
+ * to allocate, so objects may outlive it, e.g. when they are handed to
+ * std::allocate_shared.
+ */
+template <class T>
+class ArenaAllocator
+{
+    template <typename U>
+    friend class ArenaAllocator;
+
+    ArenaResource* m_resource;
+
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(ArenaResource* resource) noexcept : m_resource(resource) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_resource(other.m_resource) {}
+
+    T* allocate(std::size_t n)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "overaligned types are not supported");
+        return static_cast<T*>(m_resource->Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept
+    {
+        ArenaResource::Deallocate(p);
+    }
+
+    template <typename U>
+    friend bool operator==(const ArenaAllocator& a, const ArenaAllocator<U>& b) noexcept
+    {
+        return a.m_resource == b.m_resource;
+    }
+
+    template <typename U>
+    friend bool operator!=(const ArenaAllocator& a, const ArenaAllocator<U>& b) noexcept
+    {
+        return !(a == b);
+    }
+};
+
+/**
+ * While an ArenaScope is alive, objects that deserialization creates through
+ * shared pointers on this thread (the transactions of a block) are allocated
+ * from its resource. Scopes nest; a scope with a null resource turns the arena
+ * off again.
+ */
+class ArenaScope
+{
+    ArenaResource* const m_prev;
+
+    static ArenaResource*& CurrentRef()
+    {
+        static thread_local ArenaResource* current = nullptr;
+        return current;
+    }
+
+public:
+    explicit ArenaScope(ArenaResource* resource) : m_prev(CurrentRef())
+    {
+        CurrentRef() = resource;
+    }
+
+    ~ArenaScope()
+    {
+        CurrentRef() = m_prev;
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    /** The resource of the innermost scope on this thread, or nullptr. */
+    static ArenaResource* Current()
+    {
+        return CurrentRef();
+    }
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
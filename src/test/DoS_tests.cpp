@@ -24,10 +24,13 @@
 extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
 extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern size_t nOrphanWork;
 struct COrphanTx {
     CTransactionRef tx;
     NodeId fromPeer;
     int64_t nTimeExpire;
+    uint64_t nSequence;
+    size_t nPeerPos;
 };
 extern std::map<uint256, COrphanTx> mapOrphanTransactions;
 
@@ -382,4 +385,123 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(mapOrphanTransactions.empty());
 }
 
+static std::map<NodeId, size_t> CountOrphansByPeer()
+{
+    std::map<NodeId, size_t> counts;
+    for (const auto& entry : mapOrphanTransactions) {
+        counts[entry.second.fromPeer]++;
+    }
+    return counts;
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans_peers)
+{
+    // Orphans of the same size: 60 from peer 0 and 10 from each of peers 1-4
+    for (NodeId peer = 0; peer < 5; peer++)
+    {
+        for (int i = 0; i < (peer == 0 ? 60 : 10); i++)
+        {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout.n = 0;
+            tx.vin[0].prevout.hash = InsecureRand256();
+            tx.vin[0].scriptSig << OP_1;
+            tx.vout.resize(1);
+            tx.vout[0].nValue = 1*CENT;
+            tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+            BOOST_CHECK(AddOrphanTx(MakeTransactionRef(tx), peer));
+        }
+    }
+
+    LOCK(cs_main);
+    // The orphans of the peer that sent the most are evicted first
+    LimitOrphanTxSize(80);
+    std::map<NodeId, size_t> counts = CountOrphansByPeer();
+    BOOST_CHECK_EQUAL(counts[0], 40U);
+    for (NodeId peer = 1; peer < 5; peer++)
+        BOOST_CHECK_EQUAL(counts[peer], 10U);
+
+    // Which leaves every peer the same share once they are even
+    LimitOrphanTxSize(20);
+    counts = CountOrphansByPeer();
+    for (NodeId peer = 0; peer < 5; peer++)
+        BOOST_CHECK_EQUAL(counts[peer], 4U);
+
+    EraseOrphansFor(0);
+    counts = CountOrphansByPeer();
+    BOOST_CHECK(!counts.count(0));
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 16U);
+
+    LimitOrphanTxSize(0);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans_work)
+{
+    CAddress addr(ip(0xa0b0c001), NODE_NONE);
+    CNode node(1, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", true);
+    node.SetSendVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(&node);
+    std::atomic<bool> interruptDummy(false);
+
+    // 150 orphans from peer 1 and 10 from peer 2, each spending its own
+    // parent. They are not standard, so retrying one drops it.
+    std::vector<CTransactionRef> parents;
+    std::vector<CTransactionRef> orphans;
+    for (int i = 0; i < 160; i++)
+    {
+        CMutableTransaction parent;
+        parent.vin.resize(1);
+        parent.vin[0].prevout.n = 0;
+        parent.vin[0].prevout.hash = InsecureRand256();
+        parent.vout.resize(1);
+        parent.vout[0].nValue = 2*CENT;
+        parent.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        parents.push_back(MakeTransactionRef(parent));
+
+        CMutableTransaction tx;
+        tx.nVersion = CTransaction::MAX_STANDARD_VERSION + 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = parent.GetHash();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        orphans.push_back(MakeTransactionRef(tx));
+        BOOST_CHECK(AddOrphanTx(orphans.back(), i < 150 ? node.GetId() : 2));
+    }
+    BOOST_CHECK_EQUAL(nOrphanWork, 0U);
+
+    // A block bringing the parents queues every orphan on behalf of its peer
+    auto block = std::make_shared<CBlock>();
+    block->vtx = parents;
+    peerLogic->BlockConnected(block, nullptr, {});
+    BOOST_CHECK_EQUAL(nOrphanWork, 160U);
+
+    // A batch is capped, and holds the oldest orphans first
+    BOOST_CHECK(peerLogic->ProcessMessages(&node, interruptDummy));
+    BOOST_CHECK_EQUAL(nOrphanWork, 60U);
+    for (size_t i = 0; i < 150; i++)
+        BOOST_CHECK_EQUAL(mapOrphanTransactions.count(orphans[i]->GetHash()), i < MAX_ORPHAN_WORK_BATCH ? 0U : 1U);
+
+    // Erasing orphans takes them off the queue too
+    EraseOrphansFor(2);
+    BOOST_CHECK_EQUAL(nOrphanWork, 50U);
+
+    BOOST_CHECK(!peerLogic->ProcessMessages(&node, interruptDummy));
+    BOOST_CHECK_EQUAL(nOrphanWork, 0U);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+
+    // Nothing is left behind once the peer disconnects
+    for (size_t i = 0; i < 150; i++)
+        BOOST_CHECK(AddOrphanTx(orphans[i], node.GetId()));
+    peerLogic->BlockConnected(block, nullptr, {});
+    BOOST_CHECK_EQUAL(nOrphanWork, 150U);
+    bool dummy;
+    peerLogic->FinalizeNode(node.GetId(), dummy);
+    BOOST_CHECK_EQUAL(nOrphanWork, 0U);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
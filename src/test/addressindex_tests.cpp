@@ -0,0 +1,147 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/addressindex.h>
+#include <index/spentindex.h>
+#include <script/sign.h>
+#include <script/standard.h>
+#include <test/test_bitcoin.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+static void WaitForSync(BaseIndex& index)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+BOOST_AUTO_TEST_CASE(address_index_key_order)
+{
+    CIndexedAddress address;
+    BOOST_CHECK(GetIndexedAddress(CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG, address));
+    BOOST_CHECK_EQUAL(address.type, ADDRESS_INDEX_P2PKH);
+    BOOST_CHECK(!GetIndexedAddress(CScript() << OP_RETURN, address));
+
+    // Heights are serialized big-endian, so the database orders entries by height.
+    CDataStream low(SER_DISK, 0), high(SER_DISK, 0);
+    low << CAddressIndexKey(address, 255, 7);
+    high << CAddressIndexKey(address, 256, 0);
+    BOOST_CHECK(std::lexicographical_compare(low.begin(), low.end(), high.begin(), high.end()));
+
+    CAddressIndexKey key;
+    high >> key;
+    BOOST_CHECK(key.address == address);
+    BOOST_CHECK_EQUAL(key.nHeight, 256);
+}
+
+BOOST_FIXTURE_TEST_CASE(address_and_spent_index, TestChain100Setup)
+{
+    AddressIndex addressindex(1 << 20, true);
+    SpentIndex spentindex(1 << 20, true);
+    addressindex.Start();
+    spentindex.Start();
+    WaitForSync(addressindex);
+    WaitForSync(spentindex);
+
+    CIndexedAddress miner;
+    BOOST_REQUIRE(GetIndexedAddress(CTxDestination(coinbaseKey.GetPubKey().GetID()), miner));
+
+    CAmount nMined = 0;
+    for (const auto& txn : coinbaseTxns) {
+        nMined += txn.vout[0].nValue;
+    }
+
+    CAddressBalance balance;
+    BOOST_CHECK(addressindex.FindBalance(miner, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, nMined);
+    BOOST_CHECK_EQUAL(balance.nReceived, nMined);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount>> history;
+    BOOST_CHECK(addressindex.FindHistory(miner, history));
+    BOOST_CHECK_EQUAL(history.size(), coinbaseTxns.size());
+    BOOST_CHECK(addressindex.FindHistory(miner, history, 10, 19));
+    BOOST_REQUIRE_EQUAL(history.size(), 10U);
+    BOOST_CHECK_EQUAL(history.front().first.nHeight, 10);
+    BOOST_CHECK_EQUAL(history.back().first.nHeight, 19);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> unspent;
+    BOOST_CHECK(addressindex.FindUnspent(miner, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), coinbaseTxns.size());
+
+    // Spend the first coinbase to a new address.
+    CKey key;
+    key.MakeNewKey(true);
+    CIndexedAddress payee;
+    BOOST_REQUIRE(GetIndexedAddress(CTxDestination(key.GetPubKey().GetID()), payee));
+
+    CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL | SIGHASH_FORKID, coinbaseTxns[0].vout[0].nValue, SIGVERSION_BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)(SIGHASH_ALL | SIGHASH_FORKID));
+    spend.vin[0].scriptSig << vchSig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, coinbase_script);
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    const CAmount nBlockReward = block.vtx[0]->vout[0].nValue;
+    BOOST_CHECK(addressindex.BlockUntilSyncedToCurrentChain());
+    BOOST_CHECK(spentindex.BlockUntilSyncedToCurrentChain());
+
+    BOOST_CHECK(addressindex.FindBalance(payee, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, 11 * CENT);
+    BOOST_CHECK(addressindex.FindBalance(miner, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, nMined + nBlockReward - coinbaseTxns[0].vout[0].nValue);
+    BOOST_CHECK(addressindex.FindUnspent(miner, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), coinbaseTxns.size());
+    BOOST_CHECK(addressindex.FindHistory(miner, history, chainActive.Height(), chainActive.Height()));
+    BOOST_CHECK_EQUAL(history.size(), 2U);
+
+    CSpentIndexValue spent;
+    BOOST_REQUIRE(spentindex.FindSpent(spend.vin[0].prevout, spent));
+    BOOST_CHECK(spent.txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(spent.nHeight, chainActive.Height());
+    BOOST_CHECK_EQUAL(spent.nValue, coinbaseTxns[0].vout[0].nValue);
+    BOOST_CHECK(spent.address == miner);
+
+    // Disconnecting the block rolls both indexes back.
+    {
+        CValidationState state;
+        LOCK(cs_main);
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    SyncWithValidationInterfaceQueue();
+
+    BOOST_CHECK(addressindex.FindBalance(payee, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, 0);
+    BOOST_CHECK(addressindex.FindBalance(miner, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, nMined);
+    BOOST_CHECK(addressindex.FindUnspent(miner, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), coinbaseTxns.size());
+    BOOST_CHECK(std::any_of(unspent.begin(), unspent.end(), [&](const std::pair<CAddressUnspentKey, CAddressUnspentValue>& entry) {
+        return entry.first.txid == coinbaseTxns[0].GetHash();
+    }));
+    BOOST_CHECK(!spentindex.FindSpent(spend.vin[0].prevout, spent));
+
+    addressindex.Stop();
+    spentindex.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
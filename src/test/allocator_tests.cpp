@@ -4,6 +4,9 @@
 
 #include <util.h>
 
+#include <primitives/transaction.h>
+#include <streams.h>
+#include <support/allocators/arena.h>
 #include <support/allocators/secure.h>
 #include <test/test_bitcoin.h>
 
@@ -231,4 +234,72 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(arena_resource_tests)
+{
+    std::vector<int*> ints;
+    {
+        ArenaResource arena(256);
+        for (int i = 0; i < 100; ++i) {
+            int* p = static_cast<int*>(arena.Allocate(sizeof(int)));
+            BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t), 0);
+            *p = i;
+            ints.push_back(p);
+        }
+        BOOST_CHECK(arena.NumAllocatedChunks() > 1);
+        BOOST_CHECK(arena.NumAllocatedChunks() < ints.size());
+
+        // Allocations that do not fit a chunk get one of their own.
+        void* large = arena.Allocate(1000);
+        memset(large, 0xff, 1000);
+        ArenaResource::Deallocate(large);
+    }
+    // Allocations outlive the resource, and are freed in any order.
+    for (int i = 0; i < 100; i += 2) {
+        BOOST_CHECK_EQUAL(*ints[i], i);
+        ArenaResource::Deallocate(ints[i]);
+    }
+    for (int i = 1; i < 100; i += 2) {
+        BOOST_CHECK_EQUAL(*ints[i], i);
+        ArenaResource::Deallocate(ints[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(arena_scope_tests)
+{
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < 50; ++i) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout.n = i;
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = i;
+        txs.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << txs;
+
+    std::vector<CTransactionRef> txs_read;
+    {
+        ArenaResource arena;
+        ArenaScope arena_scope(&arena);
+        {
+            // A nested scope without a resource turns the arena off.
+            ArenaScope no_arena(nullptr);
+            BOOST_CHECK(ArenaScope::Current() == nullptr);
+        }
+        BOOST_CHECK(ArenaScope::Current() == &arena);
+        ss >> txs_read;
+        BOOST_CHECK(arena.NumAllocatedChunks() > 0);
+        BOOST_CHECK(arena.NumAllocatedChunks() < txs.size());
+    }
+    BOOST_CHECK(ArenaScope::Current() == nullptr);
+
+    // The transactions outlive the arena, and each one can be kept on its own.
+    BOOST_REQUIRE_EQUAL(txs_read.size(), txs.size());
+    CTransactionRef kept = txs_read[25];
+    txs_read.clear();
+    BOOST_CHECK(kept->GetHash() == txs[25]->GetHash());
+    BOOST_CHECK_EQUAL(kept->vout[0].nValue, 25);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
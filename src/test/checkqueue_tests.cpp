@@ -11,6 +11,7 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/thread.hpp>
 #include <atomic>
+#include <chrono>
 #include <thread>
 #include <vector>
 #include <mutex>
@@ -58,6 +59,42 @@ struct FailingCheck {
     };
 };
 
+struct AbortCheck {
+    static std::atomic<size_t> n_calls;
+    bool fails {false};
+    bool operator()()
+    {
+        n_calls.fetch_add(1, std::memory_order_relaxed);
+        return !fails;
+    }
+    void swap(AbortCheck& x) { std::swap(fails, x.fails); };
+};
+
+struct StealingCheck {
+    static std::mutex m;
+    static std::condition_variable cv;
+    static bool fBlocked;
+    static bool fRelease;
+    static size_t n_calls;
+    // Blocking can't be the default initialized behavior given how the queue
+    // swaps in default initialized Checks.
+    bool should_block {false};
+    bool operator()()
+    {
+        std::unique_lock<std::mutex> l(m);
+        if (should_block) {
+            fBlocked = true;
+            cv.notify_all();
+            cv.wait(l, []{ return fRelease; });
+        } else {
+            n_calls++;
+            cv.notify_all();
+        }
+        return true;
+    }
+    void swap(StealingCheck& x) { std::swap(should_block, x.should_block); };
+};
+
 struct UniqueCheck {
     static std::mutex m;
     static std::unordered_multiset<size_t> results;
@@ -133,6 +170,12 @@ std::mutex UniqueCheck::m;
 std::unordered_multiset<size_t> UniqueCheck::results;
 std::atomic<size_t> FakeCheckCheckCompletion::n_calls{0};
 std::atomic<size_t> MemoryCheck::fake_allocated_memory{0};
+std::atomic<size_t> AbortCheck::n_calls{0};
+std::mutex StealingCheck::m;
+std::condition_variable StealingCheck::cv;
+bool StealingCheck::fBlocked{false};
+bool StealingCheck::fRelease{false};
+size_t StealingCheck::n_calls{0};
 
 // Queue Typedefs
 typedef CCheckQueue<FakeCheckCheckCompletion> Correct_Queue;
@@ -141,6 +184,8 @@ typedef CCheckQueue<FailingCheck> Failing_Queue;
 typedef CCheckQueue<UniqueCheck> Unique_Queue;
 typedef CCheckQueue<MemoryCheck> Memory_Queue;
 typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
+typedef CCheckQueue<AbortCheck> Abort_Queue;
+typedef CCheckQueue<StealingCheck> Stealing_Queue;
 
 
 /** This test case checks that the CCheckQueue works properly
@@ -269,6 +314,107 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure)
     tg.join_all();
 }
 
+// Test that deferred checks count towards the next round only.
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Deferred)
+{
+    auto fail_queue = std::unique_ptr<Failing_Queue>(new Failing_Queue {QUEUE_BATCH_SIZE});
+    boost::thread_group tg;
+    for (auto x = 0; x < nScriptCheckThreads; ++x) {
+       tg.create_thread([&]{fail_queue->Thread();});
+    }
+
+    bool prev_fails = false;
+    for (auto times = 0; times < 20; ++times) {
+        const bool end_fails = times % 3 == 1;
+        CCheckQueueControl<FailingCheck> control(fail_queue.get());
+        {
+            std::vector<FailingCheck> vChecks;
+            vChecks.resize(100, false);
+            control.Add(vChecks);
+        }
+        {
+            std::vector<FailingCheck> vChecks;
+            vChecks.resize(100, false);
+            vChecks[99] = end_fails;
+            control.AddDeferred(vChecks);
+        }
+        BOOST_REQUIRE(control.Wait() != prev_fails);
+        prev_fails = end_fails;
+    }
+    {
+        CCheckQueueControl<FailingCheck> control(fail_queue.get());
+        BOOST_REQUIRE(control.Wait() != prev_fails);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+// Test that once a check fails, the remaining checks of the round are skipped,
+// and that the next round runs all of its checks again. Without workers the
+// master takes its own queue from the back, so the failing check added last
+// is the first one to run.
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Early_Abort)
+{
+    auto queue = std::unique_ptr<Abort_Queue>(new Abort_Queue {QUEUE_BATCH_SIZE});
+    const size_t COUNT = 1000;
+    for (bool fails : {true, false}) {
+        AbortCheck::n_calls = 0;
+        CCheckQueueControl<AbortCheck> control(queue.get());
+        {
+            std::vector<AbortCheck> vChecks(COUNT);
+            vChecks.back().fails = fails;
+            control.Add(vChecks);
+        }
+        BOOST_REQUIRE(control.Wait() != fails);
+        BOOST_REQUIRE_EQUAL(AbortCheck::n_calls, fails ? 1 : COUNT);
+    }
+}
+
+// Test that checks queued behind a busy worker are stolen by the others: one
+// worker is stuck in a check until everything added after it has run.
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Stealing)
+{
+    auto queue = std::unique_ptr<Stealing_Queue>(new Stealing_Queue {QUEUE_BATCH_SIZE});
+    boost::thread_group tg;
+    for (auto x = 0; x < nScriptCheckThreads; ++x) {
+        tg.create_thread([&]{queue->Thread();});
+    }
+    StealingCheck::fBlocked = false;
+    StealingCheck::fRelease = false;
+    StealingCheck::n_calls = 0;
+
+    const size_t COUNT = 1000;
+    bool fDone = false;
+    {
+        CCheckQueueControl<StealingCheck> control(queue.get());
+        {
+            std::vector<StealingCheck> vChecks(1);
+            vChecks[0].should_block = true;
+            control.Add(vChecks);
+        }
+        {
+            // Wait until a worker is stuck in the blocking check
+            std::unique_lock<std::mutex> l(StealingCheck::m);
+            StealingCheck::cv.wait(l, []{ return StealingCheck::fBlocked; });
+        }
+        // These get spread over all workers' queues, including the stuck one's
+        for (size_t i = 0; i < COUNT / 10; ++i) {
+            std::vector<StealingCheck> vChecks(10);
+            control.Add(vChecks);
+        }
+        {
+            std::unique_lock<std::mutex> l(StealingCheck::m);
+            fDone = StealingCheck::cv.wait_for(l, std::chrono::seconds(10), [&]{ return StealingCheck::n_calls == COUNT; });
+            StealingCheck::fRelease = true;
+        }
+        StealingCheck::cv.notify_all();
+        BOOST_REQUIRE(control.Wait());
+    }
+    tg.interrupt_all();
+    tg.join_all();
+    BOOST_REQUIRE(fDone);
+}
+
 // Test that unique checks are actually all called individually, rather than
 // just one check being called repeatedly. Test that checks are not called
 // more than once as well
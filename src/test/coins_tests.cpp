@@ -8,9 +8,12 @@
 #include <undo.h>
 #include <utilstrencodings.h>
 #include <test/test_bitcoin.h>
+#include <txdb.h>
 #include <validation.h>
 #include <consensus/validation.h>
 
+#include <functional>
+#include <thread>
 #include <vector>
 #include <map>
 
@@ -586,7 +589,8 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
 
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
     InsertCoinsMapEntry(map, value, flags);
     view.BatchWrite(map, {});
 }
@@ -855,4 +859,138 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+
+BOOST_AUTO_TEST_CASE(ccoins_sync)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+
+    COutPoint kept(InsecureRand256(), 0);
+    COutPoint spent(InsecureRand256(), 1);
+    cache.AddCoin(kept, Coin(CTxOut(VALUE1, CScript() << OP_TRUE), 1, 0, false), false);
+    // Not fresh, so spending it leaves a dirty spent entry in the cache.
+    cache.AddCoin(spent, Coin(CTxOut(VALUE2, CScript() << OP_TRUE), 1, 0, false), true);
+    cache.SpendCoin(spent);
+    uint256 best = InsecureRand256();
+    cache.SetBestBlock(best);
+
+    BOOST_CHECK(cache.Sync());
+    cache.SelfTest();
+
+    // The unspent coin stays cached but is no longer modified.
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK(cache.map().count(kept));
+    BOOST_CHECK_EQUAL(cache.map().at(kept).flags, 0);
+
+    // The base has the coin and the best block.
+    Coin coin;
+    BOOST_CHECK(base.GetCoin(kept, coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, VALUE1);
+    BOOST_CHECK(base.GetBestBlock() == best);
+}
+
+class CCoinsViewWriteHook : public CCoinsViewTest
+{
+public:
+    std::function<void()> hook;
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    {
+        if (hook) hook();
+        return CCoinsViewTest::BatchWrite(mapCoins, hashBlock);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(ccoins_sync_unlocked)
+{
+    CCriticalSection cs;
+    CCoinsViewWriteHook base;
+    CCoinsViewCacheTest cache(&base);
+
+    COutPoint kept(InsecureRand256(), 0);
+    COutPoint changed(InsecureRand256(), 1);
+    cache.AddCoin(kept, Coin(CTxOut(VALUE1, CScript() << OP_TRUE), 1, 0, false), false);
+    cache.AddCoin(changed, Coin(CTxOut(VALUE2, CScript() << OP_TRUE), 1, 0, false), false);
+    cache.SetBestBlock(InsecureRand256());
+
+    // Another thread takes the lock during the write and spends a coin that
+    // is being written; this would deadlock if Sync() kept holding cs.
+    base.hook = [&] {
+        std::thread thread([&] {
+            LOCK(cs);
+            cache.SpendCoin(changed);
+        });
+        thread.join();
+    };
+    {
+        LOCK(cs);
+        BOOST_CHECK(cache.Sync(&cs));
+    }
+    cache.SelfTest();
+
+    // The untouched coin is clean, the spent one is still to be written.
+    BOOST_CHECK_EQUAL(cache.map().at(kept).flags, 0);
+    BOOST_CHECK_EQUAL(cache.map().at(changed).flags, CCoinsCacheEntry::DIRTY);
+    BOOST_CHECK(cache.map().at(changed).coin.IsSpent());
+    Coin coin;
+    BOOST_CHECK(base.GetCoin(changed, coin) && !coin.IsSpent());
+
+    base.hook = nullptr;
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(!cache.map().count(changed));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_db_sharded_write)
+{
+    // Small batches and several threads, so that the coins are written in
+    // many rounds of parallel shards.
+    gArgs.ForceSetArg("-dbbatchsize", "4096");
+    gArgs.ForceSetArg("-dbflushthreads", "3");
+
+    CCoinsViewDB db(1 << 20, true);
+    std::map<COutPoint, Coin> expected;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
+    for (int i = 0; i < 2000; ++i) {
+        COutPoint outpoint(InsecureRand256(), InsecureRandRange(4));
+        CCoinsCacheEntry& entry = map[outpoint];
+        entry.coin = Coin(CTxOut(i + 1, CScript() << i << OP_DROP << OP_TRUE), i, 0, false);
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        expected[outpoint] = entry.coin;
+    }
+    uint256 best = InsecureRand256();
+    BOOST_CHECK(db.BatchWrite(map, best));
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(db.GetBestBlock() == best);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    for (const auto& entry : expected) {
+        Coin coin;
+        BOOST_CHECK(db.GetCoin(entry.first, coin));
+        BOOST_CHECK(coin == entry.second);
+    }
+
+    // Spend half of the coins; clean entries are not written.
+    int n = 0;
+    for (const auto& entry : expected) {
+        CCoinsCacheEntry& cached = map[entry.first];
+        cached.coin = entry.second;
+        if (n++ % 2 == 0) {
+            cached.coin.Clear();
+            cached.flags = CCoinsCacheEntry::DIRTY;
+        }
+    }
+    best = InsecureRand256();
+    BOOST_CHECK(db.BatchWrite(map, best));
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(db.GetBestBlock() == best);
+    n = 0;
+    for (const auto& entry : expected) {
+        BOOST_CHECK_EQUAL(db.HaveCoin(entry.first), n++ % 2 != 0);
+    }
+
+    gArgs.ForceSetArg("-dbbatchsize", std::to_string(nDefaultDbBatchSize));
+    gArgs.ForceSetArg("-dbflushthreads", std::to_string(nDefaultDbFlushThreads));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
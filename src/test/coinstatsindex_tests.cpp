@@ -0,0 +1,112 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <index/coinstatsindex.h>
+#include <key.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <test/test_bitcoin.h>
+#include <txdb.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+static std::vector<unsigned char> FinalizeHash(MuHash3072 muhash)
+{
+    unsigned char out[32];
+    muhash.Finalize(out);
+    return std::vector<unsigned char>(out, out + sizeof(out));
+}
+
+//! The statistics of the flushed chainstate, the slow way.
+static CCoinStatsEntry WalkUTXOSet()
+{
+    FlushStateToDisk();
+    CCoinStatsEntry entry;
+    std::unique_ptr<CCoinsViewCursor> cursor(pcoinsdbview->Cursor());
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(outpoint) && cursor->GetValue(coin));
+        ApplyCoinHash(entry.muhash, outpoint, coin);
+        entry.nTransactionOutputs++;
+        entry.nTotalAmount += coin.out.nValue;
+    }
+    return entry;
+}
+
+static void CheckTipStats(CoinStatsIndex& index)
+{
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+    const CCoinStatsEntry expected = WalkUTXOSet();
+    CCoinStatsEntry entry;
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(index.LookupStats(chainActive.Tip(), entry));
+    }
+    BOOST_CHECK_EQUAL(entry.nTransactionOutputs, expected.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(entry.nTotalAmount, expected.nTotalAmount);
+    BOOST_CHECK(FinalizeHash(entry.muhash) == FinalizeHash(expected.muhash));
+}
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup)
+{
+    CoinStatsIndex index(1 << 20, true);
+
+    CCoinStatsEntry entry;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!index.LookupStats(chainActive.Tip(), entry));
+    }
+
+    index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+    CheckTipStats(index);
+
+    // A block spending a coinbase takes its output out of the statistics.
+    const CScript scriptPubKey = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = coinbaseTxns[0].vout[0].nValue / 2;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    spend.vout[1].nValue = coinbaseTxns[0].vout[0].nValue / 4;
+    spend.vout[1].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    const uint256 hash = SignatureHash(coinbaseTxns[0].vout[0].scriptPubKey, spend, 0, SIGHASH_ALL | SIGHASH_FORKID,
+                                       coinbaseTxns[0].vout[0].nValue, SIGVERSION_BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)(SIGHASH_ALL | SIGHASH_FORKID));
+    spend.vin[0].scriptSig << vchSig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, scriptPubKey);
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    }
+    CheckTipStats(index);
+
+    // The statistics of earlier blocks remain available.
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(index.LookupStats(chainActive[chainActive.Height() - 1], entry));
+    }
+
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,7 +2,12 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <clientversion.h>
 #include <compressor.h>
+#include <key.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <undo.h>
 #include <util.h>
 #include <test/test_bitcoin.h>
 
@@ -62,4 +67,62 @@ BOOST_AUTO_TEST_CASE(compress_amounts)
         BOOST_CHECK(TestDecode(i));
 }
 
+BOOST_AUTO_TEST_CASE(compact_undo_roundtrip)
+{
+    const int nBlockHeight = 500000;
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    const std::vector<unsigned char> program32(32, 0x42);
+
+    std::vector<CScript> scripts;
+    scripts.push_back(GetScriptForDestination(pubkey.GetID()));
+    scripts.push_back(GetScriptForDestination(CScriptID(GetScriptForDestination(pubkey.GetID()))));
+    scripts.push_back(GetScriptForRawPubKey(pubkey));
+    scripts.push_back(CScript() << OP_0 << ToByteVector(pubkey.GetID()));
+    scripts.push_back(CScript() << OP_0 << program32);
+    scripts.push_back(CScript() << OP_1 << program32);
+    scripts.push_back(CScript() << OP_RETURN << std::vector<unsigned char>(80, 0x01));
+    scripts.push_back(CScript());
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(3);
+    for (size_t i = 0; i < 3 * scripts.size(); ++i) {
+        Coin coin(CTxOut((i + 1) * CENT, scripts[i % scripts.size()]), nBlockHeight - (int)(i * i * i), 0, i % 5 == 0);
+        blockundo.vtxundo[i % 3].vprevout.push_back(coin);
+    }
+    // A coin created in the spending block itself, and one from the genesis block.
+    blockundo.vtxundo[0].vprevout.push_back(Coin(CTxOut(1, scripts[0]), nBlockHeight, 0, false));
+    blockundo.vtxundo[1].vprevout.push_back(Coin(CTxOut(1, scripts[3]), 0, 0, true));
+
+    CDataStream legacy(SER_DISK, CLIENT_VERSION), compact(SER_DISK, CLIENT_VERSION);
+    legacy << blockundo;
+    compact << CompactBlockUndoSerializer(blockundo, nBlockHeight);
+    BOOST_CHECK(compact.size() < legacy.size());
+
+    CBlockUndo read;
+    CompactBlockUndoDeserializer deserializer(read, nBlockHeight);
+    compact >> deserializer;
+    BOOST_CHECK(compact.empty());
+    BOOST_REQUIRE_EQUAL(read.vtxundo.size(), blockundo.vtxundo.size());
+    for (size_t i = 0; i < read.vtxundo.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(read.vtxundo[i].vprevout.size(), blockundo.vtxundo[i].vprevout.size());
+        for (size_t j = 0; j < read.vtxundo[i].vprevout.size(); ++j) {
+            const Coin& a = read.vtxundo[i].vprevout[j];
+            const Coin& b = blockundo.vtxundo[i].vprevout[j];
+            BOOST_CHECK(a.out == b.out);
+            BOOST_CHECK_EQUAL(a.nHeight, b.nHeight);
+            BOOST_CHECK_EQUAL(a.fCoinBase, b.fCoinBase);
+        }
+    }
+
+    // Heights are relative to the block, so a record can't be written for,
+    // or read as, an earlier block than the coins it spends.
+    CDataStream invalid(SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK_THROW(invalid << CompactBlockUndoSerializer(blockundo, nBlockHeight - 1), std::ios_base::failure);
+    compact << CompactBlockUndoSerializer(blockundo, nBlockHeight);
+    CompactBlockUndoDeserializer early(read, 1000);
+    BOOST_CHECK_THROW(compact >> early, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include <crypto/aes.h>
 #include <crypto/chacha20.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -11,6 +12,7 @@
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
 #include <random.h>
+#include <streams.h>
 #include <utilstrencodings.h>
 #include <test/test_bitcoin.h>
 
@@ -524,6 +526,52 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+static std::vector<unsigned char> FinalizeMuHash(MuHash3072 muhash)
+{
+    unsigned char out[32];
+    muhash.Finalize(out);
+    return std::vector<unsigned char>(out, out + sizeof(out));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    const unsigned char a[] = "a", b[] = "b", c[] = "c";
+
+    // Insertion order does not matter.
+    MuHash3072 abc, cba;
+    abc.Insert(a, 1).Insert(b, 1).Insert(c, 1);
+    cba.Insert(c, 1).Insert(b, 1).Insert(a, 1);
+    BOOST_CHECK(FinalizeMuHash(abc) == FinalizeMuHash(cba));
+
+    // Removing an element, before or after inserting it, undoes it.
+    MuHash3072 ab(a, 1);
+    ab.Insert(b, 1);
+    MuHash3072 removed;
+    removed.Remove(c, 1).Insert(a, 1).Insert(c, 1).Insert(b, 1);
+    BOOST_CHECK(FinalizeMuHash(removed) == FinalizeMuHash(ab));
+    BOOST_CHECK(FinalizeMuHash(abc) != FinalizeMuHash(ab));
+    MuHash3072 empty;
+    empty.Insert(a, 1).Remove(a, 1);
+    BOOST_CHECK(FinalizeMuHash(empty) == FinalizeMuHash(MuHash3072()));
+
+    // Sets combine.
+    MuHash3072 combined(c, 1);
+    combined *= ab;
+    BOOST_CHECK(FinalizeMuHash(combined) == FinalizeMuHash(abc));
+    combined /= MuHash3072(a, 1);
+    MuHash3072 bc(b, 1);
+    bc.Insert(c, 1);
+    BOOST_CHECK(FinalizeMuHash(combined) == FinalizeMuHash(bc));
+
+    // The state round-trips, denominator included.
+    CDataStream ss(SER_DISK, 0);
+    ss << removed;
+    BOOST_CHECK_EQUAL(ss.size(), MuHash3072::SERIALIZED_SIZE);
+    MuHash3072 read;
+    ss >> read;
+    BOOST_CHECK(FinalizeMuHash(read) == FinalizeMuHash(ab));
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
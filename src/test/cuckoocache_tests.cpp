@@ -58,6 +58,34 @@ BOOST_AUTO_TEST_CASE(test_cuckoocache_no_fakes)
     }
 };
 
+/* Test that for_each reports the elements that are contained and not erased,
+ * and that inserting them into a new cache restores it.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each_ok)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(1000);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    for (size_t i = 0; i < hashes.size(); i += 2)
+        cc.contains(hashes[i], true);
+
+    std::vector<uint256> entries;
+    cc.for_each([&entries](const uint256& entry) { entries.push_back(entry); });
+    BOOST_CHECK_EQUAL(entries.size(), hashes.size() / 2);
+
+    CuckooCache::cache<uint256, SignatureCacheHasher> restored{};
+    restored.setup_bytes(1 << 20);
+    for (const uint256& entry : entries)
+        restored.insert(entry);
+    for (size_t i = 0; i < hashes.size(); ++i)
+        BOOST_CHECK_EQUAL(restored.contains(hashes[i], false), i % 2 == 1);
+}
+
 /** This helper returns the hit rate when megabytes*load worth of entries are
  * inserted into a megabytes sized cache
  */
@@ -0,0 +1,101 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <mappedfile.h>
+#include <streams.h>
+#include <test/test_bitcoin.h>
+#include <undo.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mappedfile_tests, BasicTestingSetup)
+
+static void AppendToFile(const fs::path& path, const std::vector<unsigned char>& data)
+{
+    FILE* file = fsbridge::fopen(path, "ab");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(mappedfile_cache)
+{
+    const fs::path path = GetDataDir() / "mapped";
+    const std::vector<unsigned char> first{1, 2, 3, 4}, second{5, 6};
+
+    MappedFileCache cache(1);
+    BOOST_CHECK(!cache.Get(path, 0));
+    AppendToFile(path, first);
+
+    std::shared_ptr<const MappedFile> file = cache.Get(path, first.size());
+#ifdef WIN32
+    BOOST_CHECK(!file);
+#else
+    BOOST_REQUIRE(file);
+    BOOST_CHECK_EQUAL(file->size(), first.size());
+    BOOST_CHECK(std::equal(first.begin(), first.end(), file->data()));
+    BOOST_CHECK(cache.Get(path, 0) == file);
+
+    // Asking for more than was mapped maps the file again once it has grown.
+    BOOST_CHECK(!cache.Get(path, first.size() + second.size()));
+    AppendToFile(path, second);
+    std::shared_ptr<const MappedFile> grown = cache.Get(path, first.size() + second.size());
+    BOOST_REQUIRE(grown);
+    BOOST_CHECK(grown != file);
+    BOOST_CHECK_EQUAL(grown->data()[5], 6);
+    // The old mapping stays valid for whoever still uses it.
+    BOOST_CHECK_EQUAL(file->data()[3], 4);
+
+    // Only one file is kept mapped.
+    const fs::path other = GetDataDir() / "mapped2";
+    AppendToFile(other, second);
+    BOOST_CHECK(cache.Get(other, 0));
+    BOOST_CHECK(cache.Get(path, 0) != grown);
+
+    cache.Release(path);
+    BOOST_CHECK(cache.Get(path, 0) != grown);
+#endif
+}
+
+BOOST_FIXTURE_TEST_CASE(mapped_block_reads, TestChain100Setup)
+{
+    const bool fMapBlockFilesBefore = fMapBlockFiles;
+    const Consensus::Params& params = Params().GetConsensus();
+    for (int height : {1, 50, 100}) {
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            pindex = chainActive[height];
+        }
+
+        CBlock mapped, unmapped;
+        CBlockUndo undo_mapped, undo_unmapped;
+        RawBlockData raw_mapped, raw_unmapped;
+        fMapBlockFiles = true;
+        BOOST_CHECK(ReadBlockFromDisk(mapped, pindex, params));
+        BOOST_CHECK(UndoReadFromDisk(undo_mapped, pindex));
+        BOOST_CHECK(ReadRawBlockFromDisk(raw_mapped, pindex, Params().MessageStart()));
+        fMapBlockFiles = false;
+        BOOST_CHECK(ReadBlockFromDisk(unmapped, pindex, params));
+        BOOST_CHECK(UndoReadFromDisk(undo_unmapped, pindex));
+        BOOST_CHECK(ReadRawBlockFromDisk(raw_unmapped, pindex, Params().MessageStart()));
+
+        BOOST_CHECK(mapped.GetHash() == pindex->GetBlockHash());
+        BOOST_CHECK(unmapped.GetHash() == pindex->GetBlockHash());
+        BOOST_CHECK_EQUAL(undo_mapped.vtxundo.size(), undo_unmapped.vtxundo.size());
+
+        // The raw block is the block's serialization, witness included.
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << mapped;
+        BOOST_REQUIRE_EQUAL(raw_mapped.size, ss.size());
+        BOOST_REQUIRE_EQUAL(raw_unmapped.size, ss.size());
+        BOOST_CHECK(std::equal(ss.begin(), ss.end(), (const char*)raw_mapped.data));
+        BOOST_CHECK(std::equal(ss.begin(), ss.end(), (const char*)raw_unmapped.data));
+    }
+    fMapBlockFiles = fMapBlockFilesBefore;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
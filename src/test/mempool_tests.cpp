@@ -2,9 +2,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <consensus/validation.h>
+#include <key.h>
 #include <policy/policy.h>
+#include <script/interpreter.h>
 #include <txmempool.h>
 #include <util.h>
+#include <validation.h>
+#include <validationinterface.h>
 
 #include <test/test_bitcoin.h>
 
@@ -571,4 +576,258 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolReorgUpdateTest)
+{
+    // A parent, two children and a grandchild spending both children, so
+    // that the grandchild is reachable from the parent twice.
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    CMutableTransaction txChild[2];
+    for (int i = 0; i < 2; i++) {
+        txChild[i].vin.resize(1);
+        txChild[i].vin[0].scriptSig = CScript() << OP_11;
+        txChild[i].vin[0].prevout = COutPoint(txParent.GetHash(), i);
+        txChild[i].vout.resize(1);
+        txChild[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild[i].vout[0].nValue = 11000LL;
+    }
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txGrandChild.vin[i].scriptSig = CScript() << OP_11;
+        txGrandChild.vin[i].prevout = COutPoint(txChild[i].GetHash(), 0);
+    }
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 11000LL;
+
+    CTxMemPool pool;
+    LOCK(pool.cs);
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+    pool.addUnchecked(txChild[0].GetHash(), entry.Fee(2000LL).FromTx(txChild[0]));
+    pool.addUnchecked(txChild[1].GetHash(), entry.Fee(3000LL).FromTx(txChild[1]));
+    pool.addUnchecked(txGrandChild.GetHash(), entry.Fee(4000LL).FromTx(txGrandChild));
+    const CTxMemPool::txiter itParent = pool.mapTx.find(txParent.GetHash());
+    const CTxMemPool::txiter itGrandChild = pool.mapTx.find(txGrandChild.GetHash());
+    const uint64_t nSizeParent = itParent->GetTxSize();
+    const uint64_t nSizeAll = itParent->GetSizeWithDescendants();
+    BOOST_CHECK_EQUAL(itParent->GetCountWithDescendants(), 4);
+    BOOST_CHECK_EQUAL(itParent->GetModFeesWithDescendants(), 10000LL);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 4);
+
+    // Confirming the parent takes it out of the ancestor state of the others,
+    // the grandchild included, once.
+    pool.removeForBlock({MakeTransactionRef(txParent)}, 1);
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(itGrandChild->GetSizeWithAncestors(), nSizeAll - nSizeParent);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 9000LL);
+
+    // Disconnecting the block again re-adds the parent, which only learns
+    // about its descendants from UpdateTransactionsFromBlock.
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+    pool.UpdateTransactionsFromBlock({txParent.GetHash()});
+    const CTxMemPool::txiter itReadded = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(itReadded->GetCountWithDescendants(), 4);
+    BOOST_CHECK_EQUAL(itReadded->GetSizeWithDescendants(), nSizeAll);
+    BOOST_CHECK_EQUAL(itReadded->GetModFeesWithDescendants(), 10000LL);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 4);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 10000LL);
+    BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(itReadded).size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 33000LL;
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 11000LL;
+
+    CTxMemPool pool;
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+    std::shared_ptr<const std::vector<TxMempoolEntryStats>> snapshot = pool.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot->size(), 1);
+    // Shared as long as nothing changes.
+    BOOST_CHECK(pool.GetSnapshot() == snapshot);
+
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(2000LL).FromTx(txChild));
+    std::shared_ptr<const std::vector<TxMempoolEntryStats>> snapshot2 = pool.GetSnapshot();
+    BOOST_CHECK(snapshot2 != snapshot);
+    BOOST_CHECK_EQUAL(snapshot->size(), 1);
+    BOOST_REQUIRE_EQUAL(snapshot2->size(), 2);
+    for (const TxMempoolEntryStats& e : *snapshot2) {
+        if (e.txid == txParent.GetHash()) {
+            BOOST_CHECK_EQUAL(e.nCountWithDescendants, 2);
+            BOOST_CHECK_EQUAL(e.nModFeesWithDescendants, 3000LL);
+            BOOST_CHECK(e.vDepends.empty());
+        } else {
+            BOOST_CHECK(e.txid == txChild.GetHash());
+            BOOST_CHECK(e.wtxid == CTransaction(txChild).GetWitnessHash());
+            BOOST_CHECK_EQUAL(e.nCountWithAncestors, 2);
+            BOOST_CHECK_EQUAL(e.nFee, 2000LL);
+            BOOST_REQUIRE_EQUAL(e.vDepends.size(), 1);
+            BOOST_CHECK(e.vDepends[0] == txParent.GetHash());
+        }
+    }
+
+    pool.PrioritiseTransaction(txChild.GetHash(), 500LL);
+    BOOST_CHECK(pool.GetSnapshot() != snapshot2);
+    pool.ClearPrioritisation(txChild.GetHash());
+}
+
+// A chain of transactions, each spending the first output of the previous one.
+static std::vector<CMutableTransaction> CreateSpendChain(CTransactionRef prev, const CKey& key, int length)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    std::vector<CMutableTransaction> chain(length);
+    for (int i = 0; i < length; i++) {
+        chain[i].nVersion = 1;
+        chain[i].vin.resize(1);
+        chain[i].vin[0].prevout = COutPoint(prev->GetHash(), 0);
+        chain[i].vout.resize(1);
+        chain[i].vout[0].nValue = prev->vout[0].nValue - 10000;
+        chain[i].vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, chain[i], 0, SIGHASH_ALL | SIGHASH_FORKID, prev->vout[0].nValue, SIGVERSION_BASE);
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)(SIGHASH_ALL | SIGHASH_FORKID));
+        chain[i].vin[0].scriptSig << vchSig;
+        prev = MakeTransactionRef(chain[i]);
+    }
+    return chain;
+}
+
+BOOST_FIXTURE_TEST_CASE(package_acceptance, TestChain100Setup)
+{
+    std::vector<CMutableTransaction> chain = CreateSpendChain(MakeTransactionRef(coinbaseTxns[0]), coinbaseKey, 3);
+
+    LOCK(cs_main);
+    std::vector<PackageTxResult> results;
+
+    // Children first is fine, duplicates are not.
+    std::vector<CTransactionRef> package = {MakeTransactionRef(chain[2]), MakeTransactionRef(chain[1]), MakeTransactionRef(chain[0]), MakeTransactionRef(chain[2])};
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, package, results, nullptr, false, 0));
+    BOOST_REQUIRE_EQUAL(results.size(), 4);
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK(results[i].fAccepted);
+        BOOST_CHECK(mempool.exists(package[i]->GetHash()));
+    }
+    BOOST_CHECK(!results[3].fAccepted);
+    BOOST_CHECK_EQUAL(results[3].state.GetRejectReason(), "package-duplicate-tx");
+    BOOST_CHECK_EQUAL(mempool.size(), 3);
+    mempool.clear();
+
+    // The descendants of a rejected transaction are missing their inputs.
+    CMutableTransaction broken = chain[0];
+    broken.vout[0].nValue -= 1;
+    package = {MakeTransactionRef(chain[1]), MakeTransactionRef(broken)};
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, package, results, nullptr, false, 0));
+    BOOST_CHECK(!results[0].fAccepted);
+    BOOST_CHECK(results[0].fMissingInputs);
+    BOOST_CHECK(!results[1].fAccepted);
+    BOOST_CHECK(results[1].state.IsInvalid());
+    BOOST_CHECK_EQUAL(mempool.size(), 0);
+}
+
+struct MempoolAddedRecorder : public CValidationInterface
+{
+    std::vector<uint256> vAdded;
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override
+    {
+        vAdded.push_back(ptx->GetHash());
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(package_acceptance_notifications, TestChain100Setup)
+{
+    std::vector<CMutableTransaction> chain = CreateSpendChain(MakeTransactionRef(coinbaseTxns[0]), coinbaseKey, 3);
+    std::vector<CTransactionRef> package = {MakeTransactionRef(chain[2]), MakeTransactionRef(chain[1]), MakeTransactionRef(chain[0])};
+    std::vector<PackageTxResult> results;
+    MempoolAddedRecorder recorder;
+    RegisterValidationInterface(&recorder);
+
+    // The package is announced parents first.
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(AcceptPackageToMemoryPool(mempool, package, results, nullptr, false, 0));
+    }
+    SyncWithValidationInterfaceQueue();
+    BOOST_REQUIRE_EQUAL(recorder.vAdded.size(), 3);
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK(recorder.vAdded[i] == chain[i].GetHash());
+    }
+    mempool.clear();
+    recorder.vAdded.clear();
+
+    // A package that does not fit into -maxmempool is trimmed before it
+    // is announced, so none of it is.
+    gArgs.ForceSetArg("-maxmempool", "0");
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, package, results, nullptr, false, 0));
+    }
+    SyncWithValidationInterfaceQueue();
+    for (const PackageTxResult& result : results) {
+        BOOST_CHECK(!result.fAccepted);
+        BOOST_CHECK_EQUAL(result.state.GetRejectReason(), "mempool full");
+    }
+    BOOST_CHECK_EQUAL(mempool.size(), 0);
+    BOOST_CHECK(recorder.vAdded.empty());
+
+    UnregisterValidationInterface(&recorder);
+    gArgs.ForceSetArg("-maxmempool", std::to_string(DEFAULT_MAX_MEMPOOL_SIZE));
+    mempool.clear();
+}
+
+BOOST_FIXTURE_TEST_CASE(mempool_dump_load, TestChain100Setup)
+{
+    std::vector<CMutableTransaction> chain = CreateSpendChain(MakeTransactionRef(coinbaseTxns[0]), coinbaseKey, 3);
+    std::vector<CTransactionRef> package;
+    for (const CMutableTransaction& tx : chain) {
+        package.push_back(MakeTransactionRef(tx));
+    }
+    {
+        LOCK(cs_main);
+        std::vector<PackageTxResult> results;
+        BOOST_CHECK(AcceptPackageToMemoryPool(mempool, package, results, nullptr, false, 0));
+    }
+    mempool.PrioritiseTransaction(package[1]->GetHash(), 1000);
+    std::vector<TxMempoolInfo> vinfo = mempool.infoAll();
+    BOOST_REQUIRE_EQUAL(vinfo.size(), 3);
+
+    BOOST_CHECK(DumpMempool());
+    mempool.clear();
+    mempool.ClearPrioritisation(package[1]->GetHash());
+    BOOST_CHECK(LoadMempool());
+
+    // Everything comes back, with the same times and fee deltas.
+    BOOST_CHECK_EQUAL(mempool.size(), 3);
+    for (const TxMempoolInfo& info : vinfo) {
+        TxMempoolInfo loaded = mempool.info(info.tx->GetHash());
+        BOOST_REQUIRE(loaded.tx);
+        BOOST_CHECK_EQUAL(loaded.nTime, info.nTime);
+        BOOST_CHECK_EQUAL(loaded.nFeeDelta, info.nFeeDelta);
+    }
+    mempool.clear();
+    mempool.ClearPrioritisation(package[1]->GetHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -17,6 +17,7 @@
 #include <uint256.h>
 #include <util.h>
 #include <utilstrencodings.h>
+#include <utiltime.h>
 
 #include <test/test_bitcoin.h>
 
@@ -520,4 +521,67 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+//! Wait until the builder has a template on top of the current tip, newer than the given one.
+static BlockTemplateBuilder::Snapshot WaitForTemplate(BlockTemplateBuilder& builder, uint64_t sequence)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    const int64_t time_start = GetTimeMillis();
+    while (true) {
+        const BlockTemplateBuilder::Snapshot snapshot = builder.GetSnapshot();
+        {
+            LOCK(cs_main);
+            if (snapshot.block_template && snapshot.sequence > sequence &&
+                snapshot.block_template->block.hashPrevBlock == chainActive.Tip()->GetBlockHash()) {
+                return snapshot;
+            }
+        }
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(10);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(block_template_builder, TestChain100Setup)
+{
+    BlockTemplateBuilder builder(Params(), std::chrono::milliseconds(10));
+    builder.Start();
+
+    // Nothing is built until a template is asked for.
+    BOOST_CHECK(!builder.GetSnapshot().block_template);
+    BlockTemplateBuilder::Snapshot snapshot = WaitForTemplate(builder, 0);
+    BOOST_CHECK_EQUAL(snapshot.block_template->block.vtx.size(), 1);
+    BOOST_CHECK_EQUAL(snapshot.fees, 0);
+
+    // A new tip gets a new template.
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+    snapshot = WaitForTemplate(builder, snapshot.sequence);
+
+    // So does a transaction entering the mempool.
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - 10000;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    const uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL | SIGHASH_FORKID, coinbaseTxns[0].vout[0].nValue, SIGVERSION_BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)(SIGHASH_ALL | SIGHASH_FORKID));
+    tx.vin[0].scriptSig << vchSig;
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_REQUIRE(AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr /* pfMissingInputs */,
+                                         nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */));
+    }
+    snapshot = WaitForTemplate(builder, snapshot.sequence);
+    BOOST_CHECK_EQUAL(snapshot.block_template->block.vtx.size(), 2);
+    BOOST_CHECK_EQUAL(snapshot.fees, 10000);
+
+    builder.Interrupt();
+    builder.Stop();
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,8 @@
 
 #include <policy/policy.h>
 #include <policy/fees.h>
+#include <clientversion.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <uint256.h>
 #include <util.h>
@@ -179,4 +181,91 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesCache)
+{
+    // Two estimators see the same transactions, but only the first is queried
+    // along the way, so any estimate it keeps past a change shows up as a
+    // difference at the end.
+    CBlockPolicyEstimator feeEst, freshEst;
+    CTxMemPool mpool(&feeEst), freshPool(&freshEst);
+    TestMemPoolEntryHelper entry;
+    FastRandomContext rand(true);
+
+    CScript garbage;
+    for (unsigned int i = 0; i < 128; i++)
+        garbage.push_back('X');
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = garbage;
+    tx.vout.resize(1);
+    tx.vout[0].nValue=0LL;
+
+    std::vector<CTransactionRef> waiting;
+    for (int blocknum = 0; blocknum < 120; blocknum++) {
+        for (int k = 0; k < 20; k++) {
+            tx.vin[0].prevout.n = 10000*blocknum+k;
+            CAmount fee = 2000 * (1 + rand.randrange(20));
+            mpool.addUnchecked(tx.GetHash(), entry.Fee(fee).Height(blocknum).FromTx(tx));
+            freshPool.addUnchecked(tx.GetHash(), entry.Fee(fee).Height(blocknum).FromTx(tx));
+            waiting.push_back(MakeTransactionRef(tx));
+        }
+        for (int target = 1; target <= 48; target++) {
+            feeEst.estimateSmartFee(target, nullptr, target % 2);
+        }
+        // Evicting transactions that waited a while counts as failures
+        std::vector<CTransactionRef> block, left;
+        for (const auto& ptx : waiting) {
+            uint64_t r = rand.randrange(10);
+            if (r < 4) {
+                block.push_back(ptx);
+            } else if (r == 4) {
+                mpool.removeRecursive(*ptx);
+                freshPool.removeRecursive(*ptx);
+                feeEst.estimateSmartFee(12, nullptr, false);
+            } else {
+                left.push_back(ptx);
+            }
+        }
+        waiting.swap(left);
+        mpool.removeForBlock(block, blocknum + 1);
+        freshPool.removeForBlock(block, blocknum + 1);
+    }
+
+    // Evictions between blocks change the estimates too
+    for (int target = 1; target <= 60; target++) {
+        feeEst.estimateSmartFee(target, nullptr, target % 2);
+        feeEst.estimateRawFee(target, 0.85, FeeEstimateHorizon::MED_HALFLIFE);
+    }
+    for (size_t i = 0; i < waiting.size() / 2; i++) {
+        mpool.removeRecursive(*waiting[i]);
+        freshPool.removeRecursive(*waiting[i]);
+    }
+
+    for (int target = 1; target <= 60; target++) {
+        for (bool conservative : {false, true}) {
+            FeeCalculation feeCalc, freshCalc;
+            BOOST_CHECK(feeEst.estimateSmartFee(target, &feeCalc, conservative) == freshEst.estimateSmartFee(target, &freshCalc, conservative));
+            BOOST_CHECK_EQUAL(feeCalc.returnedTarget, freshCalc.returnedTarget);
+            BOOST_CHECK(feeCalc.reason == freshCalc.reason);
+        }
+        EstimationResult result, freshResult;
+        BOOST_CHECK(feeEst.estimateRawFee(target, 0.85, FeeEstimateHorizon::MED_HALFLIFE, &result) == freshEst.estimateRawFee(target, 0.85, FeeEstimateHorizon::MED_HALFLIFE, &freshResult));
+        BOOST_CHECK_EQUAL(result.pass.inMempool + result.fail.inMempool, freshResult.pass.inMempool + freshResult.fail.inMempool);
+        BOOST_CHECK_EQUAL(result.pass.leftMempool + result.fail.leftMempool, freshResult.pass.leftMempool + freshResult.fail.leftMempool);
+    }
+
+    // What is left in the mempool is recorded as failures on shutdown, after
+    // which the estimates must survive a round trip through the file.
+    feeEst.FlushUnconfirmed(mpool);
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(feeEst.Write(file));
+    rewind(file.Get());
+    CBlockPolicyEstimator readEst;
+    BOOST_CHECK(readEst.Read(file));
+    for (int target = 1; target <= 1008; target++) {
+        BOOST_CHECK(feeEst.estimateSmartFee(target, nullptr, false) == readEst.estimateSmartFee(target, nullptr, false));
+        BOOST_CHECK(feeEst.estimateRawFee(target, 0.85, FeeEstimateHorizon::LONG_HALFLIFE) == readEst.estimateRawFee(target, 0.85, FeeEstimateHorizon::LONG_HALFLIFE));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
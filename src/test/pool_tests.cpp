@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/test_bitcoin.h>
+#include <memusage.h>
+#include <support/allocators/pool.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(basic_allocating)
+{
+    PoolResource<8, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024U);
+
+    // Freed blocks are handed out again, most recently freed first.
+    void* block = resource.Allocate(8, 8);
+    resource.Deallocate(block, 8, 8);
+    BOOST_CHECK(block == resource.Allocate(8, 8));
+
+    void* a = resource.Allocate(8, 8);
+    void* b = resource.Allocate(8, 8);
+    BOOST_CHECK(a != b);
+    resource.Deallocate(a, 8, 8);
+    resource.Deallocate(b, 8, 8);
+    BOOST_CHECK(b == resource.Allocate(8, 8));
+    BOOST_CHECK(a == resource.Allocate(8, 8));
+
+    // Blocks too large or too strictly aligned for the pool come from the heap.
+    void* large = resource.Allocate(16, 8);
+    void* aligned = resource.Allocate(8, 16);
+    resource.Deallocate(large, 16, 8);
+    resource.Deallocate(aligned, 8, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // Using up the first chunk allocates another one.
+    std::vector<void*> blocks;
+    for (int i = 0; i < 1024 / 8; ++i) {
+        blocks.push_back(resource.Allocate(8, 8));
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    for (void* p : blocks) {
+        resource.Deallocate(p, 8, 8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(leftover_goes_to_freelist)
+{
+    PoolResource<16, 8> resource(24);
+
+    // A 16 byte block leaves 8 bytes of the chunk, which are too little for
+    // the next 16 byte block and end up in the 8 byte freelist.
+    void* first = resource.Allocate(16, 8);
+    void* second = resource.Allocate(16, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    void* leftover = resource.Allocate(8, 8);
+    BOOST_CHECK(static_cast<char*>(leftover) == static_cast<char*>(first) + 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+
+    resource.Deallocate(first, 16, 8);
+    resource.Deallocate(second, 16, 8);
+    resource.Deallocate(leftover, 8, 8);
+}
+
+BOOST_AUTO_TEST_CASE(unordered_map_usage)
+{
+    typedef std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                               PoolAllocator<std::pair<const uint64_t, uint64_t>, sizeof(std::pair<const uint64_t, uint64_t>) + sizeof(void*) * 4>>
+        Map;
+
+    Map::allocator_type::ResourceType resource(4096);
+    {
+        Map map(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(), &resource);
+        for (uint64_t i = 0; i < 10000; ++i) {
+            map[i] = i * 2;
+        }
+        for (uint64_t i = 0; i < 10000; i += 2) {
+            map.erase(i);
+        }
+        BOOST_CHECK_EQUAL(map.size(), 5000U);
+        for (uint64_t i = 1; i < 10000; i += 2) {
+            BOOST_CHECK_EQUAL(map.at(i), i * 2);
+        }
+
+        // The nodes came from the pool; the memory estimate counts its chunks.
+        BOOST_CHECK(resource.NumAllocatedChunks() > 1);
+        BOOST_CHECK(memusage::DynamicUsage(map) >= resource.NumAllocatedChunks() * resource.ChunkSizeBytes());
+
+        // Erased nodes are reused before new chunks are allocated.
+        const size_t chunks = resource.NumAllocatedChunks();
+        for (uint64_t i = 0; i < 10000; i += 2) {
+            map[i] = i;
+        }
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), chunks);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
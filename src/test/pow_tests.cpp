@@ -5,6 +5,7 @@
 #include <chain.h>
 #include <rpc/blockchain.h>
 #include <chainparams.h>
+#include <miner.h>
 #include <pow.h>
 #include <random.h>
 #include <util.h>
@@ -84,4 +85,42 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(GrindProofOfWork_test)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    for (int i = 0; i < 40; i++) {
+        CBlockHeader header;
+        header.nVersion = 4;
+        header.hashPrevBlock = InsecureRand256();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = InsecureRand32();
+        // About one in 4096 hashes meets the target, so the search usually
+        // goes on past the first batch, and sometimes runs out of nonces.
+        header.nBits = 0x1f0fffff;
+        header.nNonce = i % 4 == 0 ? InsecureRandRange(0x8000) : 0;
+        const uint64_t nMaxTries = i % 3 == 0 ? InsecureRandRange(0x4000) : 0x10000;
+
+        // The nonce found one by one
+        CBlockHeader expected = header;
+        uint64_t nExpectedTries = nMaxTries;
+        while (nExpectedTries > 0 && expected.nNonce < 0x8000 && !CheckProofOfWork(expected.GetHash(), expected.nBits, params)) {
+            ++expected.nNonce;
+            --nExpectedTries;
+        }
+        const bool fExpected = nExpectedTries > 0 && expected.nNonce < 0x8000;
+
+        for (int nThreads : {1, 4}) {
+            CBlockHeader ground = header;
+            uint64_t nTries = nMaxTries;
+            BOOST_CHECK_EQUAL(GrindProofOfWork(ground, 0x8000, nTries, params, nThreads), fExpected);
+            BOOST_CHECK_EQUAL(nTries, nExpectedTries);
+            BOOST_CHECK_EQUAL(ground.nNonce, expected.nNonce);
+            if (fExpected) {
+                BOOST_CHECK(CheckProofOfWork(ground.GetHash(), ground.nBits, params));
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
 #include <crypto/sha256.h>
+#include <index/txindex.h>
 #include <validation.h>
 #include <miner.h>
 #include <net_processing.h>
@@ -88,8 +89,10 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
             }
         }
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
+        for (int i=0; i < nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadPrevalidationCheck);
+        }
         g_connman = std::unique_ptr<CConnman>(new CConnman(0x1337, 0x1337)); // Deterministic randomness for tests.
         connman = g_connman.get();
         peerLogic.reset(new PeerLogicValidation(connman, scheduler));
@@ -116,7 +119,10 @@ TestChain100Setup::TestChain100Setup() : TestChain100Setup::TestChain100Setup(fa
 
 TestChain100Setup::TestChain100Setup(bool txIndex) : TestingSetup(CBaseChainParams::REGTEST)
 {
-    fTxIndex = txIndex;
+    if (txIndex) {
+        g_txindex = MakeUnique<TxIndex>();
+        g_txindex->Start();
+    }
     // CreateAndProcessBlock() does not support building SegWit blocks, so don't activate in these tests.
     // TODO: fix the code to support SegWit blocks.
     UpdateVersionBitsParameters(Consensus::DEPLOYMENT_SEGWIT, 0, Consensus::BIP9Deployment::NO_TIMEOUT);
@@ -129,6 +135,18 @@ TestChain100Setup::TestChain100Setup(bool txIndex) : TestingSetup(CBaseChainPara
         CBlock b = CreateAndProcessBlock(noTxns, scriptPubKey);
         coinbaseTxns.push_back(*b.vtx[0]);
     }
+
+    if (g_txindex) {
+        // Allow the transaction index to catch up with the chain.
+        constexpr int64_t timeout_ms = 10 * 1000;
+        int64_t time_start = GetTimeMillis();
+        while (!g_txindex->BlockUntilSyncedToCurrentChain()) {
+            if (time_start + timeout_ms < GetTimeMillis()) {
+                throw std::runtime_error("Transaction index did not sync.");
+            }
+            MilliSleep(100);
+        }
+    }
 }
 
 //
@@ -164,6 +182,10 @@ TestChain100Setup::CreateAndProcessBlock(const std::vector<CMutableTransaction>&
 
 TestChain100Setup::~TestChain100Setup()
 {
+    if (g_txindex) {
+        g_txindex->Stop();
+        g_txindex.reset();
+    }
 }
 
 
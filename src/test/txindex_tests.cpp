@@ -0,0 +1,170 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/txindex.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <test/test_bitcoin.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+static bool ReadTxAtPosition(const CDiskTxPos& pos, CTransactionRef& tx)
+{
+    CAutoFile file(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) return false;
+    CBlockHeader header;
+    file >> header;
+    fseek(file.Get(), pos.nTxOffset, SEEK_CUR);
+    file >> tx;
+    return true;
+}
+
+BOOST_AUTO_TEST_SUITE(txindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup)
+{
+    TxIndex txindex;
+
+    CDiskTxPos pos;
+    for (const auto& txn : coinbaseTxns) {
+        BOOST_CHECK(!txindex.FindTx(txn.GetHash(), pos));
+    }
+
+    // BlockUntilSyncedToCurrentChain should return false before txindex is started.
+    BOOST_CHECK(!txindex.BlockUntilSyncedToCurrentChain());
+    BOOST_CHECK_EQUAL(txindex.GetCommittedHeight(), -1);
+
+    txindex.Start();
+
+    // Allow tx index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!txindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // Check that txindex has all txs that were in the chain before it started.
+    for (const auto& txn : coinbaseTxns) {
+        CTransactionRef tx;
+        BOOST_REQUIRE(txindex.FindTx(txn.GetHash(), pos));
+        BOOST_REQUIRE(ReadTxAtPosition(pos, tx));
+        BOOST_CHECK(tx->GetHash() == txn.GetHash());
+    }
+
+    // Check that new transactions in new blocks make it into the index.
+    for (int i = 0; i < 10; i++) {
+        CScript coinbase_script_pub_key = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+        std::vector<CMutableTransaction> no_txns;
+        const CBlock& block = CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+        const CTransaction& txn = *block.vtx[0];
+
+        BOOST_CHECK(txindex.BlockUntilSyncedToCurrentChain());
+        BOOST_CHECK(txindex.FindTx(txn.GetHash(), pos));
+    }
+
+    // Stopping commits the buffered entries together with the best block.
+    txindex.Stop();
+    CBlockLocator locator;
+    BOOST_REQUIRE(pblocktree->ReadTxIndexBestBlock(locator));
+    BOOST_REQUIRE(!locator.IsNull());
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(locator.vHave[0] == chainActive.Tip()->GetBlockHash());
+        // Pruning may now remove every block the index has seen.
+        BOOST_CHECK_EQUAL(txindex.GetCommittedHeight(), chainActive.Height());
+    }
+    BOOST_CHECK(pblocktree->ReadTxIndex(coinbaseTxns.front().GetHash(), pos));
+
+    // Resetting the index makes it start over on the next run.
+    BOOST_CHECK(TxIndex::Reset());
+    BOOST_CHECK(!pblocktree->ReadTxIndexBestBlock(locator));
+}
+
+BOOST_FIXTURE_TEST_CASE(find_tx_position_without_index, TestChain100Setup)
+{
+    BOOST_REQUIRE(!g_txindex);
+
+    LOCK(cs_main);
+    const CBlockIndex* tip = chainActive.Tip();
+    for (size_t i = 0; i < coinbaseTxns.size(); i++) {
+        const uint256& txid = coinbaseTxns[i].GetHash();
+        const int height = i + 1;
+
+        CDiskTxPos pos;
+        CTransactionRef tx;
+        BOOST_REQUIRE(FindTxPosition(txid, tip, height, pos));
+        BOOST_REQUIRE(ReadTxAtPosition(pos, tx));
+        BOOST_CHECK(tx->GetHash() == txid);
+
+        // Wrong or unknown heights do not find the transaction.
+        BOOST_CHECK(!FindTxPosition(txid, tip, height == 1 ? 2 : 1, pos));
+        BOOST_CHECK(!FindTxPosition(txid, tip, -1, pos));
+        BOOST_CHECK(!FindTxPosition(txid, tip, tip->nHeight + 1, pos));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(find_tx_position_after_reorg, TestChain100Setup)
+{
+    BOOST_REQUIRE(!g_txindex);
+    g_txindex = MakeUnique<TxIndex>();
+    g_txindex->Start();
+
+    CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = coinbase_script;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL | SIGHASH_FORKID, coinbaseTxns[0].vout[0].nValue, SIGVERSION_BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)(SIGHASH_ALL | SIGHASH_FORKID));
+    spend.vin[0].scriptSig << vchSig;
+    const uint256 txid = spend.GetHash();
+
+    CreateAndProcessBlock({spend}, coinbase_script);
+    BOOST_REQUIRE(g_txindex->BlockUntilSyncedToCurrentChain());
+    CDiskTxPos stale_pos;
+    BOOST_REQUIRE(g_txindex->FindTx(txid, stale_pos));
+
+    // Stop the index, so that it lags behind the reorg below and keeps
+    // pointing into the disconnected block.
+    g_txindex->Stop();
+    {
+        CValidationState state;
+        LOCK(cs_main);
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    // A different coinbase makes a different block at the same height.
+    const CBlock block = CreateAndProcessBlock({spend}, CScript() << OP_TRUE);
+
+    LOCK(cs_main);
+    const CBlockIndex* tip = chainActive.Tip();
+    BOOST_REQUIRE(tip->GetBlockHash() == block.GetHash());
+    const CDiskBlockPos blockpos = tip->GetBlockPos();
+
+    CDiskTxPos pos;
+    BOOST_REQUIRE(g_txindex->FindTx(txid, pos));
+    BOOST_CHECK(pos == stale_pos);
+    BOOST_CHECK(!(pos == blockpos));
+
+    // The stale index entry is ignored in favor of the active chain's block.
+    CTransactionRef tx;
+    BOOST_REQUIRE(FindTxPosition(txid, tip, tip->nHeight, pos));
+    BOOST_CHECK(pos.nFile == blockpos.nFile && pos.nPos == blockpos.nPos);
+    BOOST_REQUIRE(ReadTxAtPosition(pos, tx));
+    BOOST_CHECK(tx->GetHash() == txid);
+
+    g_txindex.reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -16,6 +16,7 @@
 #include <core_io.h>
 #include <keystore.h>
 #include <policy/policy.h>
+#include <policy/rbf.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -368,4 +369,93 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(prevalidate_transaction, TestChain100Setup)
+{
+    // Verifying the scripts ahead of AcceptToMemoryPool leaves its outcome
+    // untouched, whether the transaction is valid or not.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    std::vector<CMutableTransaction> spends(2);
+    for (int i = 0; i < 2; i++) {
+        spends[i].nVersion = 1;
+        spends[i].vin.resize(1);
+        spends[i].vin[0].prevout.hash = coinbaseTxns[i].GetHash();
+        spends[i].vin[0].prevout.n = 0;
+        spends[i].vout.resize(1);
+        spends[i].vout[0].nValue = 11*CENT;
+        spends[i].vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, spends[i], 0, SIGHASH_ALL | SIGHASH_FORKID, coinbaseTxns[i].vout[0].nValue, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)(SIGHASH_ALL | SIGHASH_FORKID));
+        spends[i].vin[0].scriptSig << vchSig;
+    }
+    // Break the second signature.
+    spends[1].vout[0].nValue = 12*CENT;
+
+    PrevalidateTransaction(MakeTransactionRef(spends[0]));
+    BOOST_CHECK(ToMemPool(spends[0]));
+    PrevalidateTransaction(MakeTransactionRef(spends[1]));
+    BOOST_CHECK(!ToMemPool(spends[1]));
+
+    // Transactions already in the mempool, and ones with missing inputs,
+    // are left alone, without pulling anything into the coins cache.
+    PrevalidateTransaction(MakeTransactionRef(spends[0]));
+    CMutableTransaction orphan = spends[0];
+    orphan.vin[0].prevout.hash = InsecureRand256();
+    PrevalidateTransaction(MakeTransactionRef(orphan));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!pcoinsTip->HaveCoinInCache(orphan.vin[0].prevout));
+    }
+
+    mempool.clear();
+}
+
+BOOST_FIXTURE_TEST_CASE(prevalidate_mempool_conflict, TestChain100Setup)
+{
+    // Double-spends of mempool transactions only get their scripts verified
+    // when they could replace them.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    auto spend = [&](int n, CAmount nValue, uint32_t nSequence) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.hash = coinbaseTxns[n].GetHash();
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].nSequence = nSequence;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = nValue;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL | SIGHASH_FORKID, coinbaseTxns[n].vout[0].nValue, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)(SIGHASH_ALL | SIGHASH_FORKID));
+        tx.vin[0].scriptSig << vchSig;
+        return tx;
+    };
+
+    // Let the outputs of the second and third coinbase mature.
+    CreateAndProcessBlock({}, scriptPubKey);
+    CreateAndProcessBlock({}, scriptPubKey);
+
+    // A conflict that does not signal replacement is never replaced.
+    CMutableTransaction final_tx = spend(0, 11*CENT, CTxIn::SEQUENCE_FINAL);
+    BOOST_CHECK(ToMemPool(final_tx));
+    BOOST_CHECK(!PrevalidateTransaction(MakeTransactionRef(spend(0, 10*CENT, CTxIn::SEQUENCE_FINAL))));
+
+    // One that does is replaced only by a transaction paying more.
+    CMutableTransaction rbf_tx = spend(1, 11*CENT, MAX_BIP125_RBF_SEQUENCE);
+    BOOST_CHECK(ToMemPool(rbf_tx));
+    BOOST_CHECK(!PrevalidateTransaction(MakeTransactionRef(spend(1, 12*CENT, CTxIn::SEQUENCE_FINAL))));
+    BOOST_CHECK(PrevalidateTransaction(MakeTransactionRef(spend(1, 10*CENT, CTxIn::SEQUENCE_FINAL))));
+
+    // Without conflicts the scripts are verified.
+    BOOST_CHECK(PrevalidateTransaction(MakeTransactionRef(spend(2, 11*CENT, CTxIn::SEQUENCE_FINAL))));
+
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,62 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <test/test_bitcoin.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(verifydb_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(verifydb_levels)
+{
+    const int nScriptCheckThreadsBefore = nScriptCheckThreads;
+    for (int nThreads : {0, 1, 4}) {
+        nScriptCheckThreads = nThreads;
+        for (int nCheckLevel = 0; nCheckLevel <= 4; ++nCheckLevel) {
+            BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), nCheckLevel, 50));
+        }
+        // A depth beyond the chain verifies all of it.
+        BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), 3, 1000));
+    }
+    nScriptCheckThreads = nScriptCheckThreadsBefore;
+
+    LOCK(cs_main);
+    BOOST_CHECK(pcoinsTip->GetBestBlock() == chainActive.Tip()->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_bad_block)
+{
+    // Corrupt the headers of a block a few blocks below the tip and of one
+    // further down, so that reading them fails at every level.
+    std::vector<const CBlockIndex*> vBad;
+    {
+        LOCK(cs_main);
+        vBad = {chainActive[chainActive.Height() - 5], chainActive[chainActive.Height() - 30]};
+    }
+    for (const CBlockIndex* pindex : vBad) {
+        FILE* file = OpenBlockFile(pindex->GetBlockPos(), false);
+        BOOST_REQUIRE(file);
+        const unsigned char junk[8] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+        BOOST_REQUIRE_EQUAL(fwrite(junk, 1, sizeof(junk), file), sizeof(junk));
+        fclose(file);
+    }
+
+    // VerifyDB gives up at the first bad block, while the workers are still
+    // busy with the blocks below it, and has to wait for them.
+    const int nScriptCheckThreadsBefore = nScriptCheckThreads;
+    nScriptCheckThreads = 4;
+    for (int nCheckLevel = 0; nCheckLevel <= 4; ++nCheckLevel) {
+        BOOST_CHECK(!CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), nCheckLevel, 50));
+    }
+    // The blocks above them are fine.
+    BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), 4, 4));
+    nScriptCheckThreads = nScriptCheckThreadsBefore;
+
+    LOCK(cs_main);
+    BOOST_CHECK(pcoinsTip->GetBestBlock() == chainActive.Tip()->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
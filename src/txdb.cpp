@@ -16,12 +16,16 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <thread>
+
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
+static const char DB_TXINDEX_BEST_BLOCK = 'T';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -81,12 +85,24 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
+/** Serialize the coins of entries[begin, end) into batch. */
+static void SerializeCoins(CDBBatch& batch, const std::vector<CCoinsMap::iterator>& entries, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i) {
+        CoinEntry entry(&entries[i]->first);
+        if (entries[i]->second.coin.IsSpent())
+            batch.Erase(entry);
+        else
+            batch.Write(entry, entries[i]->second.coin);
+    }
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CDBBatch batch(db);
     size_t count = 0;
-    size_t changed = 0;
     size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
     int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
+    int threads = std::max(1, std::min((int)gArgs.GetArg("-dbflushthreads", nDefaultDbFlushThreads), GetNumCores()));
     assert(!hashBlock.IsNull());
 
     uint256 old_tip = GetBestBlock();
@@ -99,37 +115,82 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
     }
 
-    // In the first batch, mark the database as being in the middle of a
-    // transition from old_tip to hashBlock.
-    // A vector is used for future extensibility, as we may want to support
-    // interrupting after partial writes from multiple independent reorgs.
-    batch.Erase(DB_BEST_BLOCK);
-    batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
-
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    // Only dirty entries are written; drop the others right away.
+    std::vector<CCoinsMap::iterator> dirty;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); count++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            CoinEntry entry(&it->first);
-            if (it->second.coin.IsSpent())
-                batch.Erase(entry);
-            else
-                batch.Write(entry, it->second.coin);
-            changed++;
+            dirty.push_back(it++);
+        } else {
+            it = mapCoins.erase(it);
         }
-        count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
-        if (batch.SizeEstimate() > batch_size) {
-            LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
-            db.WriteBatch(batch);
-            batch.Clear();
-            if (crash_simulate) {
-                static FastRandomContext rng;
-                if (rng.randrange(crash_simulate) == 0) {
-                    LogPrintf("Simulating a crash. Goodbye.\n");
-                    _Exit(0);
+    }
+
+    // Write the coins in key order. Each partial batch then covers a narrow
+    // key range, so LevelDB flushes it into few, non-overlapping files instead
+    // of compacting the same files again for every batch.
+    std::sort(dirty.begin(), dirty.end(), [](const CCoinsMap::iterator& a, const CCoinsMap::iterator& b) {
+        return a->first < b->first;
+    });
+
+    if (!dirty.empty()) {
+        // Before any coin is written, mark the database as being in the
+        // middle of a transition from old_tip to hashBlock.
+        // A vector is used for future extensibility, as we may want to support
+        // interrupting after partial writes from multiple independent reorgs.
+        batch.Erase(DB_BEST_BLOCK);
+        batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
+        db.WriteBatch(batch);
+        batch.Clear();
+    }
+
+    // Coins are serialized in rounds, by one thread per shard of sorted
+    // entries, while the batches of the previous round are written. Shards
+    // start with a guess of 64 bytes per coin and are resized after every
+    // round so that a round adds up to about -dbbatchsize.
+    size_t shard_size = std::max<size_t>(1, batch_size / threads / 64);
+    size_t serialized = 0;
+    size_t erased = 0;
+    std::vector<std::unique_ptr<CDBBatch>> ready;
+    while (erased < dirty.size()) {
+        const size_t round_begin = serialized;
+        std::vector<std::unique_ptr<CDBBatch>> next;
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads && serialized < dirty.size(); ++i) {
+            const size_t shard_end = std::min(dirty.size(), serialized + shard_size);
+            next.emplace_back(MakeUnique<CDBBatch>(db));
+            workers.emplace_back(SerializeCoins, std::ref(*next.back()), std::cref(dirty), serialized, shard_end);
+            serialized = shard_end;
+        }
+
+        try {
+            for (const auto& shard : ready) {
+                LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", shard->SizeEstimate() * (1.0 / 1048576.0));
+                db.WriteBatch(*shard);
+                if (crash_simulate) {
+                    static FastRandomContext rng;
+                    if (rng.randrange(crash_simulate) == 0) {
+                        LogPrintf("Simulating a crash. Goodbye.\n");
+                        _Exit(0);
+                    }
                 }
             }
+        } catch (...) {
+            for (std::thread& worker : workers) worker.join();
+            throw;
+        }
+        for (std::thread& worker : workers) worker.join();
+
+        // The entries of the previous round are on disk now.
+        for (; erased < round_begin; ++erased) {
+            mapCoins.erase(dirty[erased]);
+        }
+
+        if (!next.empty()) {
+            size_t round_bytes = 0;
+            for (const auto& shard : next) round_bytes += shard->SizeEstimate();
+            shard_size = std::max<size_t>(1, (serialized - round_begin) * batch_size / threads / std::max<size_t>(round_bytes, 1));
         }
+        ready = std::move(next);
     }
 
     // In the last batch, mark the database as consistent with hashBlock again.
@@ -138,7 +199,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
     bool ret = db.WriteBatch(batch);
-    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)dirty.size(), (unsigned int)count);
     return ret;
 }
 
@@ -240,13 +301,22 @@ bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(std::make_pair(DB_TXINDEX, txid), pos);
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect, const CBlockLocator& locator) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
+    batch.Write(DB_TXINDEX_BEST_BLOCK, locator);
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadTxIndexBestBlock(CBlockLocator& locator) {
+    return Read(DB_TXINDEX_BEST_BLOCK, locator);
+}
+
+bool CBlockTreeDB::EraseTxIndexBestBlock() {
+    return Erase(DB_TXINDEX_BEST_BLOCK);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
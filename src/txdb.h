@@ -25,6 +25,8 @@ static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -dbflushthreads default, capped at the number of cores
+static const int nDefaultDbFlushThreads = 4;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -37,6 +39,12 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to the -addressindex and -spentindex databases together (MiB)
+static const int64_t nMaxAddressIndexCache = 1024;
+//! Max memory allocated to the -blockfilterindex database (MiB)
+static const int64_t nMaxBlockFilterIndexCache = 1024;
+//! Max memory allocated to the -coinstatsindex database (MiB)
+static const int64_t nMaxCoinStatsIndexCache = 64;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -120,7 +128,10 @@ public:
     bool WriteReindexing(bool fReindexing);
     bool ReadReindexing(bool &fReindexing);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
+    /** Write transaction index entries together with the locator of the last block they cover. */
+    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect, const CBlockLocator& locator);
+    bool ReadTxIndexBestBlock(CBlockLocator& locator);
+    bool EraseTxIndexBestBlock();
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <map>
@@ -128,6 +129,7 @@ public:
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t m_epoch; //!< Last epoch the entry was visited in, see CTxMemPool::visited
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -335,6 +337,29 @@ struct TxMempoolInfo
     int64_t nFeeDelta;
 };
 
+/**
+ * The state of a mempool entry, copied out of the mempool so that it can be
+ * read without holding its lock.
+ */
+struct TxMempoolEntryStats
+{
+    uint256 txid;
+    uint256 wtxid;
+    size_t nTxSize;
+    CAmount nFee;
+    CAmount nModifiedFee;
+    int64_t nTime;
+    unsigned int nHeight;
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nModFeesWithDescendants;
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    /** The transactions in the mempool it spends outputs of. */
+    std::vector<uint256> vDepends;
+};
+
 /** Reason why a transaction was removed from the mempool,
  * this is passed to the notification signal.
  */
@@ -447,6 +472,12 @@ private:
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
 
+    mutable uint64_t m_epoch;          //!< Current traversal epoch, see visited()
+    mutable bool m_has_epoch_guard;    //!< Whether a traversal is under way
+
+    mutable std::shared_ptr<const std::vector<TxMempoolEntryStats>> m_snapshot; //!< Last result of GetSnapshot()
+    mutable unsigned int m_snapshot_updated; //!< nTransactionsUpdated when m_snapshot was taken
+
     void trackPackageRemoved(const CFeeRate& rate);
 
 public:
@@ -495,7 +526,7 @@ public:
     const setEntries & GetMemPoolParents(txiter entry) const;
     const setEntries & GetMemPoolChildren(txiter entry) const;
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
         setEntries parents;
@@ -596,7 +627,31 @@ public:
     /** Populate setDescendants with all in-mempool descendants of hash.
      *  Assumes that setDescendants includes all in-mempool descendants of anything
      *  already in it.  */
-    void CalculateDescendants(txiter it, setEntries &setDescendants);
+    void CalculateDescendants(txiter it, setEntries &setDescendants) const;
+
+    /**
+     * Traversals of the mempool graph mark the entries they visit with the
+     * current epoch, instead of collecting them in a temporary set. An
+     * EpochGuard starts a new epoch for the duration of one traversal;
+     * traversals can't be nested. Requires cs to be held.
+     */
+    class EpochGuard {
+        const CTxMemPool& pool;
+    public:
+        explicit EpochGuard(const CTxMemPool& in);
+        ~EpochGuard();
+        EpochGuard(const EpochGuard&) = delete;
+        EpochGuard& operator=(const EpochGuard&) = delete;
+    };
+
+    /** Mark an entry visited in the current epoch; returns whether it was already. */
+    bool visited(txiter it) const
+    {
+        assert(m_has_epoch_guard);
+        bool ret = it->m_epoch >= m_epoch;
+        it->m_epoch = std::max(it->m_epoch, m_epoch);
+        return ret;
+    }
 
     /** The minimum fee to get into the mempool, which may itself not be enough
       *  for larger-sized transactions.
@@ -640,6 +695,16 @@ public:
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
 
+    /** Copy out the state of an entry. Requires cs. */
+    TxMempoolEntryStats GetEntryStats(txiter it) const;
+
+    /**
+     * The state of all entries, in no particular order. The snapshot is taken
+     * while holding cs, then shared by all callers until the mempool changes;
+     * it can be read without the lock.
+     */
+    std::shared_ptr<const std::vector<TxMempoolEntryStats>> GetSnapshot() const;
+
     size_t DynamicMemoryUsage() const;
 
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
@@ -658,6 +723,7 @@ private:
      *  cachedDescendants will be updated with the descendants of the transaction
      *  being updated, so that future invocations don't need to walk the
      *  same transaction again, if encountered in another transaction chain.
+     *  Starts an epoch of its own.
      */
     void UpdateForDescendants(txiter updateIt,
             cacheMap &cachedDescendants,
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_UNDO_H
 #define BITCOIN_UNDO_H
 
+#include <coins.h>
 #include <compressor.h>
 #include <consensus/consensus.h>
 #include <primitives/transaction.h>
@@ -109,4 +110,174 @@ public:
     }
 };
 
+/** Script compressor for compact undo records.
+ *
+ *  On top of the special cases of CScriptCompressor, it encodes version 0
+ *  witness programs (P2WPKH and P2WSH) as just their 20 or 32 byte program.
+ *  It can't be used for the UTXO database, whose format it would change.
+ */
+class UndoScriptCompressor : public CScriptCompressor
+{
+private:
+    static const unsigned int nSpecialScripts = 8;
+    static const unsigned int WITNESS_V0_KEYHASH = 6;
+    static const unsigned int WITNESS_V0_SCRIPTHASH = 7;
+
+    CScript &script;
+
+public:
+    explicit UndoScriptCompressor(CScript &scriptIn) : CScriptCompressor(scriptIn), script(scriptIn) { }
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        std::vector<unsigned char> compr;
+        if (Compress(compr)) {
+            s << CFlatData(compr);
+            return;
+        }
+        int witnessversion;
+        std::vector<unsigned char> witnessprogram;
+        if (script.IsWitnessProgram(witnessversion, witnessprogram) && witnessversion == 0 &&
+            (witnessprogram.size() == 20 || witnessprogram.size() == 32)) {
+            unsigned int nSize = witnessprogram.size() == 20 ? WITNESS_V0_KEYHASH : WITNESS_V0_SCRIPTHASH;
+            s << VARINT(nSize);
+            s << CFlatData(witnessprogram);
+            return;
+        }
+        unsigned int nSize = script.size() + nSpecialScripts;
+        s << VARINT(nSize);
+        s << CFlatData(script);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned int nSize = 0;
+        s >> VARINT(nSize);
+        if (nSize < WITNESS_V0_KEYHASH) {
+            std::vector<unsigned char> vch(GetSpecialSize(nSize), 0x00);
+            s >> REF(CFlatData(vch));
+            Decompress(nSize, vch);
+            return;
+        }
+        if (nSize < nSpecialScripts) {
+            std::vector<unsigned char> witnessprogram(nSize == WITNESS_V0_KEYHASH ? 20 : 32);
+            s >> REF(CFlatData(witnessprogram));
+            script = CScript() << OP_0 << witnessprogram;
+            return;
+        }
+        nSize -= nSpecialScripts;
+        if (nSize > MAX_SCRIPT_SIZE) {
+            // Overly long script, replace with a short invalid one
+            script << OP_RETURN;
+            s.ignore(nSize);
+        } else {
+            script.resize(nSize);
+            s >> REF(CFlatData(script));
+        }
+    }
+};
+
+/** Compact undo information for a CTxIn
+ *
+ *  Used for blocks with BLOCK_UNDO_COMPACT. Compared to TxInUndoSerializer,
+ *  the height is stored as the distance to the height of the spending block,
+ *  which is usually small, the dummy version is gone, and scripts are
+ *  compressed with UndoScriptCompressor.
+ */
+class CompactTxInUndoSerializer
+{
+    const Coin* txout;
+    const int nBlockHeight;
+
+public:
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        if ((int)txout->nHeight > nBlockHeight) {
+            throw std::ios_base::failure("Undo record spends a coin from a later block");
+        }
+        ::Serialize(s, VARINT((uint32_t)(nBlockHeight - txout->nHeight) * 2 + (txout->fCoinBase ? 1 : 0)));
+        ::Serialize(s, VARINT(CTxOutCompressor::CompressAmount(txout->out.nValue)));
+        ::Serialize(s, UndoScriptCompressor(REF(txout->out.scriptPubKey)));
+    }
+
+    CompactTxInUndoSerializer(const Coin* coin, int nBlockHeightIn) : txout(coin), nBlockHeight(nBlockHeightIn) {}
+};
+
+class CompactTxInUndoDeserializer
+{
+    Coin* txout;
+    const int nBlockHeight;
+
+public:
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        uint32_t nCode = 0;
+        ::Unserialize(s, VARINT(nCode));
+        if (nCode / 2 > (uint32_t)nBlockHeight) {
+            throw std::ios_base::failure("Undo record height out of range");
+        }
+        txout->nHeight = nBlockHeight - nCode / 2;
+        txout->fCoinBase = nCode & 1;
+        uint64_t nVal = 0;
+        ::Unserialize(s, VARINT(nVal));
+        txout->out.nValue = CTxOutCompressor::DecompressAmount(nVal);
+        UndoScriptCompressor script(txout->out.scriptPubKey);
+        ::Unserialize(s, script);
+    }
+
+    CompactTxInUndoDeserializer(Coin* coin, int nBlockHeightIn) : txout(coin), nBlockHeight(nBlockHeightIn) {}
+};
+
+/** Compact undo information for a CBlock at height nBlockHeight, see CompactTxInUndoSerializer */
+class CompactBlockUndoSerializer
+{
+    const CBlockUndo& blockundo;
+    const int nBlockHeight;
+
+public:
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        ::Serialize(s, COMPACTSIZE((uint64_t)blockundo.vtxundo.size()));
+        for (const CTxUndo& txundo : blockundo.vtxundo) {
+            ::Serialize(s, COMPACTSIZE((uint64_t)txundo.vprevout.size()));
+            for (const Coin& prevout : txundo.vprevout) {
+                ::Serialize(s, CompactTxInUndoSerializer(&prevout, nBlockHeight));
+            }
+        }
+    }
+
+    CompactBlockUndoSerializer(const CBlockUndo& blockundoIn, int nBlockHeightIn) : blockundo(blockundoIn), nBlockHeight(nBlockHeightIn) {}
+};
+
+class CompactBlockUndoDeserializer
+{
+    CBlockUndo& blockundo;
+    const int nBlockHeight;
+
+public:
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        uint64_t nTxCount = 0;
+        ::Unserialize(s, COMPACTSIZE(nTxCount));
+        if (nTxCount > MAX_INPUTS_PER_BLOCK) {
+            throw std::ios_base::failure("Too many transaction undo records");
+        }
+        blockundo.vtxundo.resize(nTxCount);
+        for (CTxUndo& txundo : blockundo.vtxundo) {
+            uint64_t count = 0;
+            ::Unserialize(s, COMPACTSIZE(count));
+            if (count > MAX_INPUTS_PER_BLOCK) {
+                throw std::ios_base::failure("Too many input undo records");
+            }
+            txundo.vprevout.resize(count);
+            for (Coin& prevout : txundo.vprevout) {
+                CompactTxInUndoDeserializer deserializer(&prevout, nBlockHeight);
+                ::Unserialize(s, deserializer);
+            }
+        }
+    }
+
+    CompactBlockUndoDeserializer(CBlockUndo& blockundoIn, int nBlockHeightIn) : blockundo(blockundoIn), nBlockHeight(nBlockHeightIn) {}
+};
+
 #endif // BITCOIN_UNDO_H
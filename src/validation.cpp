@@ -14,12 +14,15 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 #include <cuckoocache.h>
 #include <hash.h>
+#include <index/txindex.h>
 #include <init.h>
 #include <netbase.h>
 #include <kernel.h>
 #include <keystore.h>
+#include <mappedfile.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -82,6 +85,23 @@ namespace {
             return false;
         }
     };
+
+    /**
+     * A block whose script checks were queued, as deferred checks, while its
+     * parent was connected. Owns everything the checks point to.
+     */
+    struct PipelinedBlock
+    {
+        std::shared_ptr<const CBlock> block;
+        const CBlockIndex* pindex;
+        //! Whether all of the block's script checks could be queued
+        bool fQueued;
+        //! Set by a failing script check
+        std::atomic<bool> fFailed;
+        std::vector<PrecomputedTransactionData> txdata;
+
+        PipelinedBlock(const std::shared_ptr<const CBlock>& blockIn, const CBlockIndex* pindexIn) : block(blockIn), pindex(pindexIn), fQueued(false), fFailed(false) {}
+    };
 } // anon namespace
 
 enum DisconnectResult
@@ -148,6 +168,16 @@ private:
       */
     std::set<CBlockIndex*> g_failed_blocks;
 
+    /**
+     * With -pipelineconnect, the next block to connect is read while its
+     * parent is connected, and its script checks are queued to run while
+     * the parent's coins are written. m_pipeline_next_block is that block,
+     * and m_pipeline the state of its checks, which the next ConnectBlock()
+     * call waits for.
+     */
+    std::shared_ptr<const CBlock> m_pipeline_next_block;
+    std::unique_ptr<PipelinedBlock> m_pipeline;
+
 public:
     CChain chainActive;
     BlockMap mapBlockIndex;
@@ -164,7 +194,8 @@ public:
     // Block (dis)connection on a given view:
     DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
     bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false);
+                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false,
+                    const std::shared_ptr<const CBlock>& pblockNext = nullptr, const CBlockIndex* pindexNext = nullptr);
 
     // Block disconnection on our pcoinsTip:
     bool DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool);
@@ -184,7 +215,8 @@ public:
 
 private:
     bool ActivateBestChainStep(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace);
-    bool ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool);
+    bool ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool,
+                    const CBlockIndex* pindexNext = nullptr, const std::shared_ptr<const CBlock>& pblockNext = nullptr);
 
     CBlockIndex* AddToBlockIndex(const CBlockHeader& block);
     /** Create a new block index entry for a given block hash */
@@ -211,12 +243,19 @@ CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
-bool fTxIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
+bool fPipelineConnect = DEFAULT_PIPELINE_CONNECT;
+bool fMapBlockFiles = DEFAULT_MMAP_BLOCKS;
+bool fBlockArena = DEFAULT_BLOCK_ARENA;
+bool fCompactUndo = DEFAULT_COMPACT_UNDO;
+bool fTxPrevalidation = DEFAULT_TX_PREVALIDATION;
+
+/** The block and undo files that are mapped, when fMapBlockFiles. */
+static MappedFileCache g_mapped_block_files(MAX_MAPPED_BLOCK_FILES);
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
@@ -288,6 +327,7 @@ enum FlushStateMode {
     FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
+    FLUSH_STATE_INDEX,
     FLUSH_STATE_ALWAYS
 };
 
@@ -297,6 +337,8 @@ static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPr
 static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
 static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
+static std::shared_ptr<const MappedFile> MapDiskRecord(const CDiskBlockPos& pos, const char* prefix, size_t nTrailer,
+                                                       const unsigned char*& begin, const unsigned char*& end);
 
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
@@ -563,7 +605,8 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
 
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
+                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache,
+                              bool fLimitMempool = true)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -979,14 +1022,17 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         pool.addUnchecked(hash, entry, setAncestors, validForFeeEstimation);
 
         // trim mempool and check if tx was trimmed
-        if (!bypass_limits) {
+        if (!bypass_limits && fLimitMempool) {
             LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
             if (!pool.exists(hash))
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
         }
     }
 
-    GetMainSignals().TransactionAddedToMempool(ptx);
+    // Without fLimitMempool the caller trims the mempool, and only announces
+    // the transactions that survive that.
+    if (fLimitMempool)
+        GetMainSignals().TransactionAddedToMempool(ptx);
 
     return true;
 }
@@ -1016,6 +1062,94 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, pfMissingInputs, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee);
 }
 
+/** AcceptPackageToMemoryPool, with the time each transaction is accepted at. */
+static bool AcceptPackageToMemoryPoolWithTimes(const CChainParams& chainparams, CTxMemPool& pool, const std::vector<CTransactionRef>& package,
+                                               const std::vector<int64_t>& vAcceptTime, std::vector<PackageTxResult>& results,
+                                               std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, const CAmount nAbsurdFee)
+{
+    AssertLockHeld(cs_main);
+    assert(vAcceptTime.size() == package.size());
+    results.assign(package.size(), PackageTxResult());
+
+    // Order the package so that parents come before their children, keeping
+    // the given order otherwise.
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < package.size(); i++) {
+        if (!mapIndex.emplace(package[i]->GetHash(), i).second) {
+            results[i].state.Invalid(false, REJECT_DUPLICATE, "package-duplicate-tx");
+        }
+    }
+    std::vector<size_t> vOrder;
+    vOrder.reserve(package.size());
+    std::vector<size_t> vParentsLeft(package.size(), 0);
+    std::vector<std::vector<size_t>> vChildren(package.size());
+    for (size_t i = 0; i < package.size(); i++) {
+        if (results[i].state.IsInvalid()) continue;
+        std::set<size_t> setParents;
+        for (const CTxIn& txin : package[i]->vin) {
+            auto it = mapIndex.find(txin.prevout.hash);
+            if (it != mapIndex.end() && it->second != i) setParents.insert(it->second);
+        }
+        vParentsLeft[i] = setParents.size();
+        for (size_t parent : setParents) {
+            vChildren[parent].push_back(i);
+        }
+        if (setParents.empty()) vOrder.push_back(i);
+    }
+    for (size_t n = 0; n < vOrder.size(); n++) {
+        for (size_t child : vChildren[vOrder[n]]) {
+            if (--vParentsLeft[child] == 0) vOrder.push_back(child);
+        }
+    }
+
+    std::vector<std::vector<COutPoint>> coins_to_uncache(package.size());
+    for (size_t i : vOrder) {
+        PackageTxResult& result = results[i];
+        result.fAccepted = AcceptToMemoryPoolWorker(chainparams, pool, result.state, package[i], &result.fMissingInputs, vAcceptTime[i],
+                                                    plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache[i], false /* fLimitMempool */);
+    }
+
+    {
+        // Trim the mempool once for the whole package, before announcing its
+        // transactions, so that none is announced and then evicted right away.
+        LOCK(pool.cs);
+        if (!bypass_limits) {
+            LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        }
+        for (size_t i : vOrder) {
+            if (results[i].fAccepted && pool.exists(package[i]->GetHash())) {
+                GetMainSignals().TransactionAddedToMempool(package[i]);
+            }
+        }
+    }
+    bool fAllAccepted = true;
+    for (size_t i = 0; i < package.size(); i++) {
+        PackageTxResult& result = results[i];
+        if (result.fAccepted && !pool.exists(package[i]->GetHash())) {
+            result.fAccepted = false;
+            result.state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+        }
+        if (!result.fAccepted) {
+            fAllAccepted = false;
+            for (const COutPoint& outpoint : coins_to_uncache[i]) {
+                pcoinsTip->Uncache(outpoint);
+            }
+        }
+    }
+
+    // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
+    CValidationState stateDummy;
+    FlushStateToDisk(chainparams, stateDummy, FLUSH_STATE_PERIODIC);
+    return fAllAccepted;
+}
+
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& package, std::vector<PackageTxResult>& results,
+                               std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, const CAmount nAbsurdFee)
+{
+    const std::vector<int64_t> vAcceptTime(package.size(), GetTime());
+    return AcceptPackageToMemoryPoolWithTimes(Params(), pool, package, vAcceptTime, results, plTxnReplaced, bypass_limits, nAbsurdFee);
+}
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
  * If blockIndex is provided, the transaction is fetched from the corresponding block.
@@ -1033,17 +1167,26 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
             return true;
         }
 
-        if (fTxIndex) {
+        if (g_txindex) {
             CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
+            if (g_txindex->FindTx(hash, postx)) {
                 CBlockHeader header;
+                const unsigned char *begin, *end;
+                std::shared_ptr<const MappedFile> mapped = MapDiskRecord(postx, "blk", 0, begin, end);
                 try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
+                    if (mapped) {
+                        SpanReader reader(SER_DISK, CLIENT_VERSION, begin, end);
+                        reader >> header;
+                        reader.ignore(postx.nTxOffset);
+                        reader >> txOut;
+                    } else {
+                        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+                        if (file.IsNull())
+                            return error("%s: OpenBlockFile failed", __func__);
+                        file >> header;
+                        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                        file >> txOut;
+                    }
                 } catch (const std::exception& e) {
                     return error("%s: Deserialize or I/O error - %s", __func__, e.what());
                 }
@@ -1114,17 +1257,32 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    ArenaResource arena;
+    ArenaScope arena_scope(fBlockArena ? &arena : nullptr);
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    const unsigned char *begin, *end;
+    std::shared_ptr<const MappedFile> mapped = MapDiskRecord(pos, "blk", 0, begin, end);
+    if (mapped) {
+        try {
+            SpanReader reader(SER_DISK, CLIENT_VERSION, begin, end);
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -1150,6 +1308,50 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(RawBlockData& raw, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetBlockPos();
+    }
+    if (pos.nPos < 8) {
+        return error("%s: Invalid block position %s", __func__, pos.ToString());
+    }
+
+    const unsigned char *begin, *end;
+    raw.file = MapDiskRecord(pos, "blk", 0, begin, end);
+    if (raw.file) {
+        raw.data = begin;
+        raw.size = end - begin;
+        return true;
+    }
+
+    // Read the storage header and the block the usual way.
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - 8), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    }
+    try {
+        CMessageHeader::MessageStartChars blk_start;
+        unsigned int blk_size;
+        filein >> FLATDATA(blk_start) >> blk_size;
+        if (memcmp(blk_start, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+            return error("%s: Block magic mismatch for %s", __func__, pos.ToString());
+        }
+        if (blk_size > MAX_SIZE) {
+            return error("%s: Block data is larger than maximum deserialization size for %s", __func__, pos.ToString());
+        }
+        raw.buffer.resize(blk_size);
+        filein.read((char*)raw.buffer.data(), blk_size);
+    } catch (const std::exception& e) {
+        return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
+    }
+    raw.data = raw.buffer.data();
+    raw.size = raw.buffer.size();
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nPowHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nPowHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1337,9 +1539,16 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight, u
 }
 
 bool CScriptCheck::operator()() {
+    if (pfSpeculativeFailed && *pfSpeculativeFailed)
+        return true;
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
-    return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
+    bool fOk = VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
+    if (!fOk && pfSpeculativeFailed) {
+        *pfSpeculativeFailed = true;
+        return true;
+    }
+    return fOk;
 }
 
 int GetSpendHeight(const CCoinsViewCache& inputs)
@@ -1461,7 +1670,8 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 namespace {
 
-bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+template <typename Undo>
+bool UndoWriteToDisk(const Undo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
@@ -1488,24 +1698,22 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
-{
-    CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull()) {
-        return error("%s: no undo data available", __func__);
-    }
-
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
+} // namespace
 
+template <typename Stream>
+static bool UndoReadFromStream(CBlockUndo& blockundo, const CBlockIndex *pindex, Stream& filein)
+{
     // Read block
     uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
+    CHashVerifier<Stream> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
     try {
         verifier << pindex->pprev->GetBlockHash();
-        verifier >> blockundo;
+        if (pindex->nStatus & BLOCK_UNDO_COMPACT) {
+            CompactBlockUndoDeserializer deserializer(blockundo, pindex->nHeight);
+            verifier >> deserializer;
+        } else {
+            verifier >> blockundo;
+        }
         filein >> hashChecksum;
     }
     catch (const std::exception& e) {
@@ -1519,6 +1727,30 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     return true;
 }
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+{
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull()) {
+        return error("%s: no undo data available", __func__);
+    }
+
+    // The checksum follows the undo data
+    const unsigned char *begin, *end;
+    std::shared_ptr<const MappedFile> mapped = MapDiskRecord(pos, "rev", sizeof(uint256), begin, end);
+    if (mapped) {
+        SpanReader reader(SER_DISK, CLIENT_VERSION, begin, end);
+        return UndoReadFromStream(blockundo, pindex, reader);
+    }
+
+    // Open history file to read
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenUndoFile failed", __func__);
+    return UndoReadFromStream(blockundo, pindex, filein);
+}
+
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1638,6 +1870,12 @@ void static FlushBlockFile(bool fFinalize = false)
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
+    if (fFinalize) {
+        // Mappings must not extend past the end of the files.
+        g_mapped_block_files.Release(GetBlockPosFilename(posOld, "blk"));
+        g_mapped_block_files.Release(GetBlockPosFilename(posOld, "rev"));
+    }
+
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
         if (fFinalize)
@@ -1662,45 +1900,166 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
         CDiskBlockPos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+        const CompactBlockUndoSerializer compact(blockundo, pindex->nHeight);
+        const unsigned int nUndoSize = fCompactUndo ? ::GetSerializeSize(compact, SER_DISK, CLIENT_VERSION) : ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION);
+        if (!FindUndoPos(state, pindex->nFile, _pos, nUndoSize + 40))
             return error("ConnectBlock(): FindUndoPos failed");
-        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+        if (fCompactUndo ? !UndoWriteToDisk(compact, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart())
+                         : !UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
             return AbortNode(state, "Failed to write undo data");
 
         // update nUndoPos in block index
         pindex->nUndoPos = _pos.nPos;
         pindex->nStatus |= BLOCK_HAVE_UNDO;
+        if (fCompactUndo) {
+            pindex->nStatus |= BLOCK_UNDO_COMPACT;
+        } else {
+            pindex->nStatus &= ~BLOCK_UNDO_COMPACT;
+        }
         setDirtyBlockIndex.insert(pindex);
     }
 
     return true;
 }
 
-static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex)
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+void ThreadScriptCheck() {
+    RenameThread("bitcoin-scriptch");
+    scriptcheckqueue.Thread();
+}
+
+static CCheckQueue<CScriptCheck> prevalidationcheckqueue(128);
+
+void ThreadPrevalidationCheck() {
+    RenameThread("bitcoin-txcheck");
+    prevalidationcheckqueue.Thread();
+}
+
+bool PrevalidateTransaction(const CTransactionRef& ptx)
 {
-    if (!fTxIndex) return true;
+    return PrevalidateTransactions({ptx}) > 0;
+}
 
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
-    for (const CTransactionRef& tx : block.vtx)
-    {
-        vPos.push_back(std::make_pair(tx->GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
-    }
+size_t PrevalidateTransactions(const std::vector<CTransactionRef>& txs)
+{
+    if (!fTxPrevalidation) return 0;
 
-    if (!pblocktree->WriteTxIndex(vPos)) {
-        return AbortNode(state, "Failed to write transaction index");
+    // Leave the transactions that fail the context-free checks, or can't go
+    // into the mempool anyway, to AcceptToMemoryPool.
+    std::vector<CTransactionRef> vTxs;
+    vTxs.reserve(txs.size());
+    for (const CTransactionRef& ptx : txs) {
+        CValidationState state;
+        if (!ptx->IsCoinBase() && CheckTransaction(*ptx, state)) {
+            vTxs.push_back(ptx);
+        }
     }
+    if (vTxs.empty()) return 0;
 
-    return true;
-}
+    // Only verify scripts for transactions that pass the policy checks of
+    // AcceptToMemoryPool that come before the script checks and cost next to
+    // nothing, so that nobody can fill the signature cache with transactions
+    // the mempool would turn down, or have them verified for free.
+    std::vector<std::vector<CTxOut>> vSpentOutputs(vTxs.size());
+    {
+        LOCK2(cs_main, mempool.cs);
+        const bool witnessEnabled = IsWitnessEnabled(chainActive.Tip(), Params().GetConsensus());
+        const CFeeRate mempoolMinFee = mempool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+        for (size_t i = 0; i < vTxs.size(); i++) {
+            const CTransaction& tx = *vTxs[i];
+            if (mempool.exists(tx.GetHash())) continue;
+            if (tx.HasWitness() && !witnessEnabled) continue;
+            std::string reason;
+            if (fRequireStandard && !IsStandardTx(tx, reason, witnessEnabled)) continue;
+
+            // A double-spend of mempool transactions only gets in as their
+            // replacement, which needs every one of them to opt in, and a
+            // higher fee than all of them together.
+            std::set<uint256> setConflicts;
+            CAmount nConflictingFees = 0;
+            bool fReplacementOptOut = false;
+            for (const CTxIn& txin : tx.vin) {
+                auto itConflicting = mempool.mapNextTx.find(txin.prevout);
+                if (itConflicting == mempool.mapNextTx.end()) continue;
+                const CTransaction* ptxConflicting = itConflicting->second;
+                if (!setConflicts.insert(ptxConflicting->GetHash()).second) continue;
+                if (!fEnableReplacement || !SignalsOptInRBF(*ptxConflicting)) {
+                    fReplacementOptOut = true;
+                    break;
+                }
+                nConflictingFees += mempool.mapTx.find(ptxConflicting->GetHash())->GetModifiedFee();
+            }
+            if (fReplacementOptOut) continue;
+
+            std::vector<CTxOut>& spent_outputs = vSpentOutputs[i];
+            spent_outputs.reserve(tx.vin.size());
+            CAmount nValueIn = 0;
+            for (const CTxIn& txin : tx.vin) {
+                // Don't let transactions that may never make it in fill the cache.
+                const bool fWasCached = pcoinsTip->HaveCoinInCache(txin.prevout);
+                Coin coin;
+                const bool fHaveCoin = viewMemPool.GetCoin(txin.prevout, coin);
+                if (!fWasCached) {
+                    pcoinsTip->Uncache(txin.prevout);
+                }
+                if (!fHaveCoin || coin.IsSpent()) break;
+                nValueIn += coin.out.nValue;
+                if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn)) break;
+                spent_outputs.push_back(std::move(coin.out));
+            }
+            if (spent_outputs.size() != tx.vin.size()) {
+                spent_outputs.clear();
+                continue;
+            }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+            CAmount nModifiedFees = nValueIn - tx.GetValueOut();
+            mempool.ApplyDelta(tx.GetHash(), nModifiedFees);
+            const unsigned int nSize = GetVirtualTransactionSize(tx);
+            if (nModifiedFees < ::minRelayTxFee.GetFee(nSize) || nModifiedFees < mempoolMinFee.GetFee(nSize) ||
+                (!setConflicts.empty() && nModifiedFees <= nConflictingFees)) {
+                spent_outputs.clear();
+            }
+        }
+    }
 
-void ThreadScriptCheck() {
-    RenameThread("bitcoin-scriptch");
-    scriptcheckqueue.Thread();
+    // The checks only fill the signature cache, so the flags only need to
+    // cover the signatures AcceptToMemoryPool verifies.
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(vTxs.size());
+    std::vector<std::vector<CScriptCheck>> vChecks(vTxs.size());
+    size_t nTxs = 0;
+    size_t nChecks = 0;
+    for (size_t i = 0; i < vTxs.size(); i++) {
+        if (vSpentOutputs[i].empty()) continue;
+        const CTransaction& tx = *vTxs[i];
+        nTxs++;
+        txdata.emplace_back(tx);
+        vChecks[i].reserve(tx.vin.size());
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            vChecks[i].emplace_back(vSpentOutputs[i][j], tx, j, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheStore */, &txdata.back());
+        }
+        nChecks += vChecks[i].size();
+    }
+    if (nScriptCheckThreads && nChecks > 1) {
+        // Use a queue of our own: the block script check queue is reserved
+        // for ConnectBlock, which must not wait behind relayed transactions.
+        // The queue gives up on the remaining checks after the first failure,
+        // which only costs cache misses later.
+        CCheckQueueControl<CScriptCheck> control(&prevalidationcheckqueue);
+        for (std::vector<CScriptCheck>& checks : vChecks) {
+            control.Add(checks);
+        }
+        control.Wait();
+    } else {
+        for (std::vector<CScriptCheck>& checks : vChecks) {
+            for (CScriptCheck& check : checks) {
+                if (!check()) break;
+            }
+        }
+    }
+    return nTxs;
 }
 
 // Protected by cs_main
@@ -1789,7 +2148,7 @@ static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consens
 }
 
 // these checks can only be done when all previous block have been added.
-bool PoSContextualBlockChecks(const CBlock& block, CValidationState& state, CBlockIndex* pindex, bool fJustCheck)
+bool PoSContextualBlockChecks(const CBlock& block, CValidationState& state, CBlockIndex* pindex, const CCoinsViewCache& view, bool fJustCheck)
 {
     uint256 hashProofOfStake;
     if (block.IsProofOfStake()) {
@@ -1802,7 +2161,7 @@ bool PoSContextualBlockChecks(const CBlock& block, CValidationState& state, CBlo
         }
 
         // pos: verify hash target and signature of coinstake tx
-        if (!CheckProofOfStake(state, block.vtx[1], block.nBits, hashProofOfStake, block.GetBlockTime())) {
+        if (!CheckProofOfStake(state, block.vtx[1], block.nBits, hashProofOfStake, block.GetBlockTime(), view, pindex->pprev)) {
             LogPrintf("WARNING: %s: check proof-of-stake failed for block %s\n", __func__, block.GetHash().ToString());
             return false; // do not error here as we expect this during initial block download
         }
@@ -1868,11 +2227,83 @@ static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 static int64_t nBlocksTotal = 0;
 
+/** Whether the scripts of a block need to be verified, or are below -assumevalid. */
+static bool ScriptChecksRequired(const CBlockIndex* pindex, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+    if (!hashAssumeValid.IsNull()) {
+        // We've been configured with the hash of a block which has been externally verified to have a valid history.
+        // A suitable default value is included with the software and updated from time to time.  Because validity
+        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
+        // This setting doesn't force the selection of any particular chain but makes validating some faster by
+        //  effectively caching the result of part of the verification.
+        BlockMap::const_iterator  it = mapBlockIndex.find(hashAssumeValid);
+        if (it != mapBlockIndex.end()) {
+            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
+                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
+                pindexBestHeader->nChainWork >= nMinimumChainWork) {
+                // This block is a member of the assumed verified chain and an ancestor of the best header.
+                // The equivalent time check discourages hash power from extorting the network via DOS attack
+                //  into accepting an invalid block through telling users they must manually set assumevalid.
+                //  Requiring a software change or burying the invalid block, regardless of the setting, makes
+                //  it hard to hide the implication of the demand.  This also avoids having release candidates
+                //  that are hardly doing any signature verification at all in testing without having to
+                //  artificially set the default assumed verified block further back.
+                // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
+                //  least as good as the expected chain.
+                return GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, chainparams.GetConsensus()) <= 60 * 60 * 24 * 7 * 2;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Queue the script checks of next, which is to be connected on top of the
+ * coins in view, as deferred checks on control. Failures are recorded in
+ * next.fFailed rather than in the result of the queue. Returns false if the
+ * block could not be queued in full, e.g. because it spends coins that
+ * don't exist.
+ */
+static bool QueueSpeculativeScriptChecks(PipelinedBlock& next, CCoinsViewCache& view, CCheckQueueControl<CScriptCheck>& control, const CChainParams& chainparams)
+{
+    const CBlock& block = *next.block;
+    const CBlockIndex* pindex = next.pindex;
+    std::vector<PrecomputedTransactionData>& txdata = next.txdata;
+    CCoinsViewCache viewNext(&view);
+    const unsigned int flags = GetBlockScriptFlags(pindex, chainparams.GetConsensus());
+    txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    try {
+        for (const CTransactionRef& ptx : block.vtx) {
+            const CTransaction& tx = *ptx;
+            if (!tx.IsCoinBase()) {
+                if (!viewNext.HaveInputs(tx))
+                    return false;
+                txdata.emplace_back(tx);
+                std::vector<CScriptCheck> vChecks;
+                CValidationState state;
+                if (!CheckInputs(tx, state, viewNext, true, flags, false, false, txdata.back(), &vChecks))
+                    return false;
+                for (CScriptCheck& check : vChecks)
+                    check.SetSpeculative(&next.fFailed);
+                control.AddDeferred(vChecks);
+            }
+            CTxUndo undoDummy;
+            UpdateCoins(tx, viewNext, undoDummy, pindex->nHeight, pindex->GetBlockTime());
+        }
+    } catch (const std::logic_error&) {
+        // The block overwrites unspent coins; leave it to ConnectBlock to reject.
+        return false;
+    }
+    return true;
+}
+
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck,
+                  const std::shared_ptr<const CBlock>& pblockNext, const CBlockIndex* pindexNext)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
@@ -1881,7 +2312,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
            (*pindex->phashBlock == block.GetHash()));
     int64_t nTimeStart = GetTimeMicros();
 
-    if (!PoSContextualBlockChecks(block, state, pindex, fJustCheck))
+    if (!PoSContextualBlockChecks(block, state, pindex, view, fJustCheck))
         return false;
 
     // Check it again in case a previous version let a bad block in
@@ -1914,31 +2345,16 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     nBlocksTotal++;
 
-    bool fScriptChecks = true;
-    if (!hashAssumeValid.IsNull()) {
-        // We've been configured with the hash of a block which has been externally verified to have a valid history.
-        // A suitable default value is included with the software and updated from time to time.  Because validity
-        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
-        // This setting doesn't force the selection of any particular chain but makes validating some faster by
-        //  effectively caching the result of part of the verification.
-        BlockMap::const_iterator  it = mapBlockIndex.find(hashAssumeValid);
-        if (it != mapBlockIndex.end()) {
-            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->nChainWork >= nMinimumChainWork) {
-                // This block is a member of the assumed verified chain and an ancestor of the best header.
-                // The equivalent time check discourages hash power from extorting the network via DOS attack
-                //  into accepting an invalid block through telling users they must manually set assumevalid.
-                //  Requiring a software change or burying the invalid block, regardless of the setting, makes
-                //  it hard to hide the implication of the demand.  This also avoids having release candidates
-                //  that are hardly doing any signature verification at all in testing without having to
-                //  artificially set the default assumed verified block further back.
-                // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
-                //  least as good as the expected chain.
-                fScriptChecks = (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, chainparams.GetConsensus()) <= 60 * 60 * 24 * 7 * 2);
-            }
-        }
-    }
+    bool fScriptChecks = ScriptChecksRequired(pindex, chainparams);
+
+    // The script checks of this block may have been queued already, while
+    // its parent was connected on top of the same coins. If so, we only
+    // need to wait for them.
+    const bool fPipelined = fScriptChecks && m_pipeline && m_pipeline->pindex == pindex && m_pipeline->fQueued;
+    if (fPipelined)
+        fScriptChecks = false;
+    // Likewise, queue the checks of the next block once ours are.
+    const bool fPipelineNext = pblockNext && nScriptCheckThreads && !fJustCheck && ScriptChecksRequired(pindexNext, chainparams);
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime1 - nTimeStart), nTimeCheck * MICRO, nTimeCheck * MILLI / nBlocksTotal);
@@ -1995,7 +2411,11 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    // Whatever checks were queued ahead of time are part of the next round
+    // of the queue, which control waits for, so they have to outlive it.
+    std::unique_ptr<PipelinedBlock> pipelined = std::move(m_pipeline);
+
+    CCheckQueueControl<CScriptCheck> control((fScriptChecks || fPipelineNext || pipelined) && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
@@ -2032,7 +2452,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 }
 
                 uint64_t nCoinAge;
-                if (!GetCoinAge(tx, view, nCoinAge, chainparams.GetConsensus(), block.GetBlockTime()))
+                if (!GetCoinAge(tx, view, pindex->pprev, nCoinAge, chainparams.GetConsensus(), block.GetBlockTime()))
                     return error("CheckInputs() : %s unable to get coin age for coinstake", tx.GetHash().ToString());
 
                 posReward = GetProofOfStakeReward(nCoinAge);
@@ -2096,7 +2516,16 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                                 REJECT_INVALID, "bad-cs-amount");
     }
 
-    if (!control.Wait())
+    // Keep the script check threads busy with the next block once they run
+    // out of ours, instead of letting them idle until this block's coins
+    // are written and the next one is connected.
+    if (fPipelineNext) {
+        assert(pindexNext->pprev == pindex);
+        m_pipeline.reset(new PipelinedBlock(pblockNext, pindexNext));
+        m_pipeline->fQueued = QueueSpeculativeScriptChecks(*m_pipeline, view, control, chainparams);
+    }
+
+    if (!control.Wait() || (fPipelined && pipelined->fFailed))
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
@@ -2112,9 +2541,6 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (!WriteTxIndexDataForBlock(block, state, pindex))
-        return false;
-
     assert(pindex->phashBlock);
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2128,7 +2554,40 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     return true;
 }
 
-bool GetCoinAge(const CTransaction& tx, const CCoinsViewCache& view, uint64_t& nCoinAge, const Consensus::Params& params, uint32_t nTime)
+bool FindTxPosition(const uint256& txid, const CBlockIndex* pindexPrev, int nHeight, CDiskTxPos& pos)
+{
+    if (!pindexPrev || nHeight < 0 || nHeight > pindexPrev->nHeight)
+        return false;
+
+    const CBlockIndex* pindex = pindexPrev->GetAncestor(nHeight);
+    if (!pindex)
+        return false;
+
+    // The transaction index is built in the background and keeps the entries
+    // of disconnected blocks, so after a reorg it may still point into a
+    // stale block while the one at nHeight has not been indexed yet. Only
+    // trust it when it points into the block at nHeight, and otherwise fall
+    // back to reading that block.
+    const CDiskBlockPos blockpos = pindex->GetBlockPos();
+    if (g_txindex && g_txindex->FindTx(txid, pos) && pos.nFile == blockpos.nFile && pos.nPos == blockpos.nPos)
+        return true;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+        return false;
+
+    CDiskTxPos txpos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    for (const CTransactionRef& tx : block.vtx) {
+        if (tx->GetHash() == txid) {
+            pos = txpos;
+            return true;
+        }
+        txpos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    }
+    return false;
+}
+
+bool GetCoinAge(const CTransaction& tx, const CCoinsViewCache& view, const CBlockIndex* pindexPrev, uint64_t& nCoinAge, const Consensus::Params& params, uint32_t nTime)
 {
     arith_uint256 bnCentSecond = 0;  // coin age in the unit of cent-seconds
     nCoinAge = 0;
@@ -2144,41 +2603,24 @@ bool GetCoinAge(const CTransaction& tx, const CCoinsViewCache& view, uint64_t& n
         if (!view.GetCoin(prevout, coin))
             continue;  // previous transaction not in main chain
 
-        // Transaction index is required to get to block header
-        if (!fTxIndex)
-            return false;  // Transaction index not available
+        // The coin carries the value and the block index the time of the
+        // block that created it, so no block data is read and this keeps
+        // working after the block files have been pruned.
+        if (!pindexPrev || coin.nHeight > (uint32_t)pindexPrev->nHeight)
+            return error("%s() : tx missing in main chain in GetCoinAge()", __PRETTY_FUNCTION__);
+        const CBlockIndex* pindexFrom = pindexPrev->GetAncestor(coin.nHeight);
+        const int64_t nTimeBlockFrom = pindexFrom->GetBlockTime();
 
-        CDiskTxPos postx;
-        CTransactionRef txPrev;
-        if (pblocktree->ReadTxIndex(prevout.hash, postx))
-        {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            CBlockHeader header;
-            try {
-                file >> header;
+        if (nTime < nTimeBlockFrom)
+            return false;  // timestamp violation
 
-                if (nTime < header.GetBlockTime())
-                    return false;  // timestamp violation
+        if (nTimeBlockFrom + params.nStakeMinAge > nTime)
+            continue; // only count coins meeting min age requirement
 
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txPrev;
-            } catch (std::exception &e) {
-                return error("%s() : deserialize or I/O error in GetCoinAge()", __PRETTY_FUNCTION__);
-            }
+        int64_t nValueIn = coin.out.nValue;
+        bnCentSecond += arith_uint256(nValueIn) * (nTime - nTimeBlockFrom) / CENT;
 
-            if (txPrev->GetHash() != prevout.hash)
-                return error("%s() : txid mismatch in GetCoinAge()", __PRETTY_FUNCTION__);
-
-            if (header.GetBlockTime() + params.nStakeMinAge > nTime)
-                continue; // only count coins meeting min age requirement
-
-            int64_t nValueIn = txPrev->vout[txin.prevout.n].nValue;
-            bnCentSecond += arith_uint256(nValueIn) * (nTime - header.GetBlockTime()) / CENT;
-
-            LogPrint(BCLog::COINAGE, "coin age nValueIn=%-12lld nTimeDiff=%d bnCentSecond=%s\n", nValueIn, nTime - header.GetBlockTime(), bnCentSecond.ToString());
-        }
-        else
-            return error("%s() : tx missing in tx index in GetCoinAge()", __PRETTY_FUNCTION__);
+        LogPrint(BCLog::COINAGE, "coin age nValueIn=%-12lld nTimeDiff=%d bnCentSecond=%s\n", nValueIn, nTime - nTimeBlockFrom, bnCentSecond.ToString());
     }
 
     arith_uint256 bnCoinDay = bnCentSecond * CENT / COIN / (24 * 60 * 60);
@@ -2246,7 +2688,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         // Combine all conditions that result in a full cache flush.
         fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
         // Write blocks and block index to disk.
-        if (fDoFullFlush || fPeriodicWrite) {
+        if (fDoFullFlush || fPeriodicWrite || mode == FLUSH_STATE_INDEX) {
             // Depend on nMinDiskSpace to ensure we can write block index
             if (!CheckDiskSpace(0))
                 return state.Error("out of disk space");
@@ -2307,6 +2749,31 @@ void FlushStateToDisk() {
     FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS);
 }
 
+void SyncCoinsToDisk() {
+    CValidationState state;
+    const CChainParams& chainparams = Params();
+    LOCK(cs_main);
+    if (pcoinsTip == nullptr || pcoinsTip->GetBestBlock().IsNull()) {
+        return;
+    }
+    // The coins refer to the best block, so its index entry goes to disk first.
+    if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_INDEX)) {
+        return;
+    }
+    if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize())) {
+        return;
+    }
+    try {
+        // Only the copy of the modified coins is made under cs_main; the
+        // write itself happens with it released.
+        if (!pcoinsTip->Sync(&cs_main)) {
+            AbortNode(state, "Failed to write to coin database");
+        }
+    } catch (const std::runtime_error& e) {
+        AbortNode(state, std::string("System error while syncing: ") + e.what());
+    }
+}
+
 void PruneAndFlush() {
     CValidationState state;
     fCheckForPruning = true;
@@ -2504,30 +2971,53 @@ public:
  * Connect a new block to chainActive. pblock is either nullptr or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
  *
+ * pindexNext is the block that will be connected after this one, if known.
+ * During initial block download its scripts are verified along with
+ * pindexNew's; pblockNext is either nullptr or the corresponding CBlock.
+ *
  * The block is added to connectTrace if connection succeeds.
  */
-bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool)
+bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool,
+                             const CBlockIndex* pindexNext, const std::shared_ptr<const CBlock>& pblockNext)
 {
     assert(pindexNew->pprev == chainActive.Tip());
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
-    if (!pblock) {
+    if (pblock) {
+        pthisBlock = pblock;
+    } else if (m_pipeline_next_block && m_pipeline_next_block->GetHash() == pindexNew->GetBlockHash()) {
+        // Read while connecting the previous block.
+        pthisBlock = std::move(m_pipeline_next_block);
+    } else {
         std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
         if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
             return AbortNode(state, "Failed to read block");
         pthisBlock = pblockNew;
-    } else {
-        pthisBlock = pblock;
     }
     const CBlock& blockConnecting = *pthisBlock;
+
+    m_pipeline_next_block.reset();
+    if (pindexNext && fPipelineConnect && nScriptCheckThreads && IsInitialBlockDownload()) {
+        assert(pindexNext->pprev == pindexNew);
+        if (pblockNext) {
+            m_pipeline_next_block = pblockNext;
+        } else if (pindexNext->nStatus & BLOCK_HAVE_DATA) {
+            // Failing to read the next block is not an error yet; it is
+            // reported when we get to connect it.
+            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockRead, pindexNext, chainparams.GetConsensus()))
+                m_pipeline_next_block = pblockRead;
+        }
+    }
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
         CCoinsViewCache view(pcoinsTip.get());
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams, false,
+                               m_pipeline_next_block, m_pipeline_next_block ? pindexNext : nullptr);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2673,7 +3163,9 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
 
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
+            const CBlockIndex* pindexNext = pindexConnect == pindexMostWork ? nullptr : pindexMostWork->GetAncestor(pindexConnect->nHeight + 1);
+            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool,
+                            pindexNext, pindexNext == pindexMostWork ? pblock : std::shared_ptr<const CBlock>())) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -3739,7 +4231,7 @@ void PruneOneBlockFile(const int fileNumber)
         CBlockIndex* pindex = entry.second;
         if (pindex->nFile == fileNumber) {
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
-            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nStatus &= ~(BLOCK_HAVE_UNDO | BLOCK_UNDO_COMPACT);
             pindex->nFile = 0;
             pindex->nDataPos = 0;
             pindex->nUndoPos = 0;
@@ -3769,12 +4261,34 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        g_mapped_block_files.Release(GetBlockPosFilename(pos, "blk"));
+        g_mapped_block_files.Release(GetBlockPosFilename(pos, "rev"));
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
     }
 }
 
+/**
+ * Lower the last prunable height so that the blocks the transaction index has
+ * not committed yet stay on disk. Proof-of-stake validation and staking take
+ * the kernel's offset in its block from the transaction index, so pruning
+ * nodes keep it, and after a restart it resumes from its last commit.
+ *
+ * @return false if nothing may be pruned at all
+ */
+static bool ApplyIndexPruneLock(unsigned int& nLastBlockWeCanPrune)
+{
+    if (g_txindex) {
+        const int nCommittedHeight = g_txindex->GetCommittedHeight();
+        if (nCommittedHeight < 0) {
+            return false;
+        }
+        nLastBlockWeCanPrune = std::min(nLastBlockWeCanPrune, (unsigned int)nCommittedHeight);
+    }
+    return true;
+}
+
 /* Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain */
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight)
 {
@@ -3786,6 +4300,8 @@ static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPr
 
     // last block to prune is the lesser of (user-specified height, MIN_BLOCKS_TO_KEEP from the tip)
     unsigned int nLastBlockWeCanPrune = std::min((unsigned)nManualPruneHeight, chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP);
+    if (!ApplyIndexPruneLock(nLastBlockWeCanPrune))
+        return;
     int count=0;
     for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
         if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
@@ -3831,6 +4347,9 @@ static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfte
     }
 
     unsigned int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP;
+    if (!ApplyIndexPruneLock(nLastBlockWeCanPrune)) {
+        return;
+    }
     uint64_t nCurrentUsage = CalculateCurrentUsage();
     // We don't check to prune until after we've allocated new space for files
     // So we should leave a buffer under our target to account for another allocation
@@ -3910,6 +4429,37 @@ static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly) {
     return OpenDiskFile(pos, "rev", fReadOnly);
 }
 
+/**
+ * With -mmapblocks, map the block or undo file of the record (block or undo
+ * data) at pos, and set begin and end to its data, followed by nTrailer more
+ * bytes. The size of the record is taken from the storage header in front of
+ * it. Returns nullptr if the file isn't mapped, in which case it should be
+ * read the usual way.
+ */
+static std::shared_ptr<const MappedFile> MapDiskRecord(const CDiskBlockPos& pos, const char* prefix, size_t nTrailer,
+                                                       const unsigned char*& begin, const unsigned char*& end)
+{
+    if (!fMapBlockFiles || pos.IsNull() || pos.nPos < 8)
+        return nullptr;
+    const fs::path path = GetBlockPosFilename(pos, prefix);
+    std::shared_ptr<const MappedFile> file = g_mapped_block_files.Get(path, pos.nPos);
+    if (!file)
+        return nullptr;
+    const unsigned char* header = file->data() + pos.nPos - 8;
+    if (memcmp(header, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+        return nullptr;
+    const size_t nEnd = (size_t)pos.nPos + ReadLE32(header + 4) + nTrailer;
+    if (file->size() < nEnd) {
+        // Written after the file was mapped.
+        file = g_mapped_block_files.Get(path, nEnd);
+        if (!file)
+            return nullptr;
+    }
+    begin = file->data() + pos.nPos;
+    end = file->data() + nEnd;
+    return file;
+}
+
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix)
 {
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
@@ -4041,10 +4591,6 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     pblocktree->ReadReindexing(fReindexing);
     if(fReindexing) fReindex = true;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
-
     return true;
 }
 
@@ -4087,6 +4633,144 @@ CVerifyDB::~CVerifyDB()
     uiInterface.ShowProgress("", 100, false);
 }
 
+namespace {
+
+/**
+ * Runs the checks of VerifyDB that look at one block at a time (levels 0 to
+ * 2) on worker threads, handing the blocks to the caller in chain order for
+ * the levels that have to walk the chain. Workers run at most a few blocks
+ * ahead of the caller, so that few blocks are held in memory at once.
+ */
+class BlockVerifier
+{
+private:
+    struct Job {
+        CBlockIndex* pindex;
+        CDiskBlockPos pos;
+        std::shared_ptr<const CBlock> block;
+        std::string strError;
+        bool fDone;
+    };
+
+    const CChainParams& chainparams;
+    const int nCheckLevel;
+    const bool fKeepBlocks;
+    const size_t nWindow;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::vector<Job> jobs;
+    //! The next job for a worker, the next job for the caller, and how many jobs are done.
+    size_t nNext;
+    size_t nConsumed;
+    size_t nDone;
+    bool fStop;
+    boost::thread_group threads;
+
+    void Check(Job& job) const
+    {
+        std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+        // check level 0: read from disk
+        if (!ReadBlockFromDisk(*block, job.pos, chainparams.GetConsensus()) || block->GetHash() != job.pindex->GetBlockHash()) {
+            job.strError = strprintf("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", job.pindex->nHeight, job.pindex->GetBlockHash().ToString());
+            return;
+        }
+        // check level 1: verify block validity
+        CValidationState state;
+        if (nCheckLevel >= 1 && !CheckBlock(*block, state, chainparams.GetConsensus())) {
+            job.strError = strprintf("%s: *** found bad block at %d, hash=%s (%s)\n", "VerifyDB",
+                                     job.pindex->nHeight, job.pindex->GetBlockHash().ToString(), FormatStateMessage(state));
+            return;
+        }
+        // check level 2: verify undo validity
+        if (nCheckLevel >= 2) {
+            CBlockUndo undo;
+            if (!job.pindex->GetUndoPos().IsNull()) {
+                if (!UndoReadFromDisk(undo, job.pindex)) {
+                    job.strError = strprintf("VerifyDB(): *** found bad undo data at %d, hash=%s\n", job.pindex->nHeight, job.pindex->GetBlockHash().ToString());
+                    return;
+                }
+            }
+        }
+        if (fKeepBlocks) {
+            job.block = std::move(block);
+        }
+    }
+
+    void Work()
+    {
+        while (true) {
+            size_t i;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && nNext < jobs.size() && nNext >= nConsumed + nWindow) {
+                    cond.wait(lock);
+                }
+                if (fStop || nNext >= jobs.size()) {
+                    return;
+                }
+                i = nNext++;
+            }
+            Check(jobs[i]);
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                jobs[i].fDone = true;
+                ++nDone;
+            }
+            cond.notify_all();
+        }
+    }
+
+public:
+    /** Check the blocks of vIndex, whose positions on disk are in vPos. */
+    BlockVerifier(const CChainParams& chainparamsIn, int nCheckLevelIn, const std::vector<CBlockIndex*>& vIndex, const std::vector<CDiskBlockPos>& vPos, int nThreads)
+        : chainparams(chainparamsIn), nCheckLevel(nCheckLevelIn), fKeepBlocks(nCheckLevelIn >= 3), nWindow(2 * nThreads),
+          nNext(0), nConsumed(0), nDone(0), fStop(false)
+    {
+        jobs.reserve(vIndex.size());
+        for (size_t i = 0; i < vIndex.size(); ++i) {
+            jobs.push_back(Job{vIndex[i], vPos[i], nullptr, std::string(), false});
+        }
+        for (int i = 0; i < nThreads; ++i) {
+            threads.create_thread([this] { Work(); });
+        }
+    }
+
+    ~BlockVerifier()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_all();
+        threads.join_all();
+    }
+
+    /**
+     * Wait until the i-th block is checked and take its result: the block if
+     * level 3 needs it, or an error. Blocks must be taken in order. nDoneOut
+     * is set to the number of blocks checked so far by all threads.
+     */
+    std::shared_ptr<const CBlock> Take(size_t i, std::string& strError, size_t& nDoneOut)
+    {
+        std::shared_ptr<const CBlock> block;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!jobs[i].fDone) {
+                cond.wait(lock);
+            }
+            strError = std::move(jobs[i].strError);
+            block = std::move(jobs[i].block);
+            nConsumed = i + 1;
+            nDoneOut = nDone;
+        }
+        cond.notify_all();
+        return block;
+    }
+};
+
+} // namespace
+
 bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
 {
     LOCK(cs_main);
@@ -4104,45 +4788,44 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     int nGoodTransactions = 0;
     CValidationState state;
     int reportDone = 0;
+
+    // Levels 0 to 2 only look at a single block, so they run in parallel.
+    std::vector<CBlockIndex*> vIndex;
+    std::vector<CDiskBlockPos> vPos;
+    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
+        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
+            break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
+        vIndex.push_back(pindex);
+        vPos.push_back(pindex->GetBlockPos());
+    }
+    BlockVerifier verifier(chainparams, nCheckLevel, vIndex, vPos, std::max(1, nScriptCheckThreads));
+
     LogPrintf("[0%%]...");
-    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
+    for (size_t i = 0; i < vIndex.size(); ++i)
     {
+        CBlockIndex* pindex = vIndex[i];
         boost::this_thread::interruption_point();
-        int percentageDone = std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
+        std::string strError;
+        size_t nDone;
+        std::shared_ptr<const CBlock> pblock = verifier.Take(i, strError, nDone);
+        int percentageDone = std::max(1, std::min(99, (int)((double)nDone / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
         if (reportDone < percentageDone/10) {
             // report every 10% step
             LogPrintf("[%d%%]...", percentageDone);
             reportDone = percentageDone/10;
         }
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone, false);
-        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
-            break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
-            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
-            break;
-        }
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
-            return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
-                         pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            if (!pindex->GetUndoPos().IsNull()) {
-                if (!UndoReadFromDisk(undo, pindex)) {
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-                }
-            }
-        }
+        if (!strError.empty())
+            return error("%s", strError);
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             assert(coins.GetBestBlock() == pindex->GetBlockHash());
-            DisconnectResult res = g_chainstate.DisconnectBlock(block, pindex, coins);
+            DisconnectResult res = g_chainstate.DisconnectBlock(*pblock, pindex, coins);
             if (res == DISCONNECT_FAILED) {
                 return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             }
@@ -4151,7 +4834,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
                 nGoodTransactions = 0;
                 pindexFailure = pindex;
             } else {
-                nGoodTransactions += block.vtx.size();
+                nGoodTransactions += pblock->vtx.size();
             }
         }
         if (ShutdownRequested())
@@ -4320,7 +5003,7 @@ bool CChainState::RewindBlockIndex(const CChainParams& params)
             // Reduce validity
             pindexIter->nStatus = std::min<unsigned int>(pindexIter->nStatus & BLOCK_VALID_MASK, BLOCK_VALID_TREE) | (pindexIter->nStatus & ~BLOCK_VALID_MASK);
             // Remove have-data flags.
-            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_UNDO_COMPACT);
             // Remove storage location.
             pindexIter->nFile = 0;
             pindexIter->nDataPos = 0;
@@ -4378,6 +5061,13 @@ bool RewindBlockIndex(const CChainParams& params) {
 void CChainState::UnloadBlockIndex() {
     nBlockSequenceId = 1;
     g_failed_blocks.clear();
+    m_pipeline_next_block.reset();
+    if (m_pipeline) {
+        // Wait for the checks that still point into it.
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Wait();
+        m_pipeline.reset();
+    }
     setBlockIndexCandidates.clear();
 }
 
@@ -4428,9 +5118,6 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
-        pblocktree->WriteFlag("txindex", fTxIndex);
     }
     return true;
 }
@@ -4510,7 +5197,11 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 blkdat.SetPos(nBlockPos);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
                 CBlock& block = *pblock;
-                blkdat >> block;
+                {
+                    ArenaResource arena;
+                    ArenaScope arena_scope(fBlockArena ? &arena : nullptr);
+                    blkdat >> block;
+                }
                 nRewind = blkdat.GetPos();
 
                 // detect out of order blocks, and store them for later
@@ -4653,6 +5344,7 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
             if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
         }
         if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
+        if (pindex->nStatus & BLOCK_UNDO_COMPACT) assert(pindex->nStatus & BLOCK_HAVE_UNDO);
         assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0)); // This is pruning-independent.
         // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
         assert((pindexFirstNeverProcessed != nullptr) == (pindex->nChainTx == 0)); // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
@@ -4798,7 +5490,22 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/**
+ * mempool.dat holds the transactions of the mempool, parents before their
+ * children, each with the time it entered the mempool and its fee delta,
+ * followed by the fee deltas of transactions that aren't in it. Since version
+ * 2 it starts with the hash of the tip it was dumped at: restarting on that
+ * tip with the signature cache that was dumped along with it, all the
+ * signatures of the transactions are cached already.
+ */
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_TIP = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+/** Number of transactions LoadMempool submits at once. */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+
+/** Whether LoadScriptCaches restored the caches dumped at the last shutdown. */
+static bool fScriptCachesLoaded = false;
 
 bool LoadMempool(void)
 {
@@ -4811,18 +5518,63 @@ bool LoadMempool(void)
         return false;
     }
 
+    int64_t start = GetTimeMicros();
     int64_t count = 0;
     int64_t expired = 0;
     int64_t failed = 0;
     int64_t already_there = 0;
     int64_t nNow = GetTime();
 
+    bool fPrevalidate = true;
+    std::vector<CTransactionRef> vBatch;
+    std::vector<int64_t> vBatchTime;
+    vBatch.reserve(MEMPOOL_LOAD_BATCH_SIZE);
+    vBatchTime.reserve(MEMPOOL_LOAD_BATCH_SIZE);
+    const auto submit_batch = [&]() {
+        if (fPrevalidate) {
+            PrevalidateTransactions(vBatch);
+        }
+        LOCK(cs_main);
+        // mempool may contain some transactions already, e.g. from wallet(s)
+        // having loaded them while we were processing mempool transactions;
+        // consider these as valid, instead of failed, but mark them as
+        // 'already there'
+        std::vector<CTransactionRef> package;
+        std::vector<int64_t> vAcceptTime;
+        for (size_t i = 0; i < vBatch.size(); i++) {
+            if (mempool.exists(vBatch[i]->GetHash())) {
+                ++already_there;
+            } else {
+                package.push_back(std::move(vBatch[i]));
+                vAcceptTime.push_back(vBatchTime[i]);
+            }
+        }
+        std::vector<PackageTxResult> results;
+        AcceptPackageToMemoryPoolWithTimes(chainparams, mempool, package, vAcceptTime, results,
+                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
+        for (const PackageTxResult& result : results) {
+            if (result.fAccepted) {
+                ++count;
+            } else {
+                ++failed;
+            }
+        }
+        vBatch.clear();
+        vBatchTime.clear();
+    };
+
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_NO_TIP) {
             return false;
         }
+        if (version == MEMPOOL_DUMP_VERSION) {
+            uint256 hashTip;
+            file >> hashTip;
+            LOCK(cs_main);
+            fPrevalidate = !fScriptCachesLoaded || chainActive.Tip()->GetBlockHash() != hashTip;
+        }
         uint64_t num;
         file >> num;
         while (num--) {
@@ -4837,27 +5589,15 @@ bool LoadMempool(void)
             if (amountdelta) {
                 mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
             }
-            CValidationState state;
             if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (mempool.exists(tx->GetHash())) {
-                        ++already_there;
-                    } else {
-                        ++failed;
-                    }
-                }
+                vBatch.push_back(std::move(tx));
+                vBatchTime.push_back(nTime);
             } else {
                 ++expired;
             }
+            if (vBatch.size() == MEMPOOL_LOAD_BATCH_SIZE || (num == 0 && !vBatch.empty())) {
+                submit_batch();
+            }
             if (ShutdownRequested())
                 return false;
         }
@@ -4872,7 +5612,8 @@ bool LoadMempool(void)
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
+    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there (%.2fs)\n",
+              count, failed, expired, already_there, (GetTimeMicros() - start) * MICRO);
     return true;
 }
 
@@ -4880,19 +5621,35 @@ bool DumpMempool(void)
 {
     int64_t start = GetTimeMicros();
 
+    struct DumpEntry {
+        CTransactionRef tx;
+        int64_t nTime;
+        int64_t nFeeDelta;
+        uint64_t nCountWithAncestors;
+    };
     std::map<uint256, CAmount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
+    std::vector<DumpEntry> entries;
+    uint256 hashTip;
 
     {
-        LOCK(mempool.cs);
-        for (const auto &i : mempool.mapDeltas) {
-            mapDeltas[i.first] = i.second;
+        // Only copy what has to be written while holding the locks, and do
+        // the sorting after.
+        LOCK2(cs_main, mempool.cs);
+        hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+        mapDeltas = mempool.mapDeltas;
+        entries.reserve(mempool.mapTx.size());
+        for (const CTxMemPoolEntry& entry : mempool.mapTx) {
+            entries.push_back(DumpEntry{entry.GetSharedTx(), entry.GetTime(), entry.GetModifiedFee() - entry.GetFee(), entry.GetCountWithAncestors()});
         }
-        vinfo = mempool.infoAll();
     }
 
     int64_t mid = GetTimeMicros();
 
+    // A transaction has more ancestors than any of its parents.
+    std::sort(entries.begin(), entries.end(), [](const DumpEntry& a, const DumpEntry& b) {
+        return a.nCountWithAncestors < b.nCountWithAncestors;
+    });
+
     try {
         FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
         if (!filestr) {
@@ -4903,12 +5660,13 @@ bool DumpMempool(void)
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
+        file << hashTip;
 
-        file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
+        file << (uint64_t)entries.size();
+        for (const auto& i : entries) {
             file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
+            file << i.nTime;
+            file << i.nFeeDelta;
             mapDeltas.erase(i.tx->GetHash());
         }
 
@@ -4925,6 +5683,104 @@ bool DumpMempool(void)
     return true;
 }
 
+/**
+ * The caches are stored in sigcache.dat with the nonces their entries were
+ * computed with, followed by a hash of everything before it. The file is
+ * only used by the version of the software that wrote it, as what a script
+ * execution cache entry means may change between versions. The hash only
+ * protects against corruption: whoever can write the data directory can
+ * modify the chainstate as well.
+ */
+static const uint64_t SCRIPT_CACHES_DUMP_VERSION = 1;
+
+bool DumpScriptCaches()
+{
+    int64_t start = GetTimeMicros();
+
+    uint256 sigcache_nonce, script_nonce;
+    std::vector<uint256> sigcache_entries, script_entries;
+    GetSignatureCacheEntries(sigcache_nonce, sigcache_entries);
+    {
+        LOCK(cs_main);
+        script_nonce = scriptExecutionCacheNonce;
+        scriptExecutionCache.for_each([&script_entries](const uint256& entry) { script_entries.push_back(entry); });
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = SCRIPT_CACHES_DUMP_VERSION;
+        int client_version = CLIENT_VERSION;
+        file << version << client_version << sigcache_nonce << sigcache_entries << script_nonce << script_entries;
+        hasher << version << client_version << sigcache_nonce << sigcache_entries << script_nonce << script_entries;
+        file << hasher.GetHash();
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped %u signature and %u script execution cache entries: %gs to copy, %gs to dump\n",
+                  sigcache_entries.size(), script_entries.size(), (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature caches: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadScriptCaches()
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 sigcache_nonce, script_nonce;
+    std::vector<uint256> sigcache_entries, script_entries;
+    try {
+        CHashVerifier<CAutoFile> verifier(&file);
+        uint64_t version;
+        int client_version;
+        verifier >> version >> client_version;
+        if (version != SCRIPT_CACHES_DUMP_VERSION || client_version != CLIENT_VERSION) {
+            LogPrintf("Ignoring signature cache file written by another version\n");
+            return false;
+        }
+        verifier >> sigcache_nonce >> sigcache_entries >> script_nonce >> script_entries;
+        uint256 hash;
+        file >> hash;
+        if (hash != verifier.GetHash()) {
+            LogPrintf("Signature cache file is corrupt. Continuing anyway.\n");
+            return false;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LoadSignatureCacheEntries(sigcache_nonce, sigcache_entries);
+    {
+        LOCK(cs_main);
+        scriptExecutionCacheNonce = script_nonce;
+        for (const uint256& entry : script_entries)
+            scriptExecutionCache.insert(entry);
+    }
+
+    LogPrintf("Imported %u signature and %u script execution cache entries from disk\n", sigcache_entries.size(), script_entries.size());
+    fScriptCachesLoaded = true;
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
     if (pindex == nullptr)
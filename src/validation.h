@@ -12,6 +12,7 @@
 
 #include <amount.h>
 #include <coins.h>
+#include <consensus/validation.h>
 #include <fs.h>
 #include <keystore.h>
 #include <protocol.h> // For CMessageHeader::MessageStartChars
@@ -23,6 +24,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -33,6 +35,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CChainParams;
 class CCoinsViewDB;
 class CInv;
@@ -42,7 +45,9 @@ class CBlockPolicyEstimator;
 class CTxMemPool;
 class CValidationState;
 class CKeyStore;
+class MappedFile;
 struct ChainTxData;
+struct CDiskTxPos;
 
 struct PrecomputedTransactionData;
 struct LockPoints;
@@ -82,6 +87,18 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Default for -pipelineconnect */
+static const bool DEFAULT_PIPELINE_CONNECT = true;
+/** Default for -mmapblocks; mapping block files takes a lot of address space */
+static const bool DEFAULT_MMAP_BLOCKS = sizeof(void*) >= 8;
+/** Default for -blockarena, allocating the transactions of a block read from disk or the network together */
+static const bool DEFAULT_BLOCK_ARENA = true;
+/** Default for -compactundo, writing undo data in the compact encoding */
+static const bool DEFAULT_COMPACT_UNDO = true;
+/** Default for -txprevalidation, verifying the scripts of relayed transactions before taking cs_main */
+static const bool DEFAULT_TX_PREVALIDATION = true;
+/** Maximum number of block and undo files that are kept mapped */
+static const size_t MAX_MAPPED_BLOCK_FILES = 64;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -103,6 +120,10 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Time to wait (in seconds) between writing modified coins to disk with -dbbackgroundflush. */
+static const unsigned int DATABASE_SYNC_INTERVAL = 60;
+/** Default for -dbbackgroundflush */
+static const bool DEFAULT_DB_BACKGROUND_FLUSH = false;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -132,9 +153,15 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = true;
+static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+static const bool DEFAULT_COINSTATSINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIGCACHE = false;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = true;
 /** Default for using fee filter */
@@ -147,6 +174,7 @@ static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 static const int MAX_UNCONNECTING_HEADERS = 10;
 
 static const bool DEFAULT_PEERBLOOMFILTERS = true;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
 
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
@@ -170,10 +198,19 @@ extern CConditionVariable cvBlockChange;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
-extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
+/** Whether to verify the scripts of the next block while connecting one during initial block download. */
+extern bool fPipelineConnect;
+/** Whether to read block and undo files through memory mappings. */
+extern bool fMapBlockFiles;
+/** Whether to allocate the transactions of a deserialized block from an ArenaResource. */
+extern bool fBlockArena;
+/** Whether to write undo data in the compact encoding, which older versions can't read. */
+extern bool fCompactUndo;
+/** Whether to verify the scripts of transactions submitted to the mempool before taking cs_main. */
+extern bool fTxPrevalidation;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
@@ -274,6 +311,8 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the thread checking the scripts of relayed transactions ahead of AcceptToMemoryPool */
+void ThreadPrevalidationCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -301,6 +340,8 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Write the modified coins to disk but keep them cached, without holding cs_main during the write. */
+void SyncCoinsToDisk();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 /** Prune block files up to a given height */
@@ -312,6 +353,47 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee);
 
+/** The outcome of AcceptPackageToMemoryPool for one transaction of the package. */
+struct PackageTxResult
+{
+    CValidationState state;
+    bool fMissingInputs = false;
+    bool fAccepted = false;
+};
+
+/**
+ * (Try to) add a set of transactions, which may spend each other's outputs,
+ * to the memory pool, in one go. They are submitted parents first, whatever
+ * their order in the package, the mempool is trimmed and the coins cache
+ * flushed once at the end. Only the transactions still in the mempool after
+ * the trim are announced to TransactionAddedToMempool subscribers, parents
+ * first. results receives the outcome of each transaction,
+ * in the order of the package; returns whether all of them were accepted.
+ */
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& package, std::vector<PackageTxResult>& results,
+                               std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, const CAmount nAbsurdFee);
+
+/**
+ * Verify the scripts of a transaction that is about to be passed to
+ * AcceptToMemoryPool, spread over their own check threads and without
+ * holding cs_main, so that AcceptToMemoryPool finds its signatures in the
+ * signature cache. cs_main is only taken to look up the spent coins; nothing
+ * is done if some are missing, or if the transaction fails the standardness,
+ * mempool conflict or fee checks AcceptToMemoryPool makes first. Returns
+ * whether the scripts were verified, not whether they are valid;
+ * AcceptToMemoryPool still checks everything. Must not be called with
+ * cs_main held.
+ */
+bool PrevalidateTransaction(const CTransactionRef& tx);
+
+/**
+ * PrevalidateTransaction for a batch of transactions, looking up all their
+ * coins under one lock and verifying all their scripts in parallel.
+ * Transactions spending outputs of others in the same batch are skipped.
+ * Returns the number of transactions whose scripts were verified.
+ */
+size_t PrevalidateTransactions(const std::vector<CTransactionRef>& txs);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -371,14 +453,22 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *txdata;
+    std::atomic<bool> *pfSpeculativeFailed;
 
 public:
-    CScriptCheck(): ptxTo(nullptr), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck(): ptxTo(nullptr), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), pfSpeculativeFailed(nullptr) {}
     CScriptCheck(const CTxOut& outIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
-        m_tx_out(outIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+        m_tx_out(outIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), pfSpeculativeFailed(nullptr) { }
 
     bool operator()();
 
+    /**
+     * Make this a check of a block that is verified ahead of time. A failure
+     * is then recorded in *pfFailed instead of failing the checks it is
+     * queued with.
+     */
+    void SetSpeculative(std::atomic<bool>* pfFailed) { pfSpeculativeFailed = pfFailed; }
+
     void swap(CScriptCheck &check) {
         std::swap(ptxTo, check.ptxTo);
         std::swap(m_tx_out, check.m_tx_out);
@@ -387,6 +477,7 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
+        std::swap(pfSpeculativeFailed, check.pfSpeculativeFailed);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -400,6 +491,23 @@ void InitScriptExecutionCache();
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 
+/**
+ * A block serialized as it is stored on disk, which is its network
+ * serialization with witness data. Points into the mapping of its block
+ * file, which it keeps alive, or into buffer if block files aren't mapped.
+ */
+struct RawBlockData
+{
+    std::shared_ptr<const MappedFile> file;
+    std::vector<unsigned char> buffer;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+/** Read the serialization of a block from disk, without deserializing it. */
+bool ReadRawBlockFromDisk(RawBlockData& raw, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
+
 /** Functions for validating blocks and updating the block tree */
 
 /** Context-independent validity checks */
@@ -487,9 +595,29 @@ CBlockFileInfo* GetBlockFileInfo(size_t n);
 /** Dump the mempool to disk. */
 bool DumpMempool();
 
-/** Load the mempool from disk. */
+/**
+ * Load the mempool from disk. The transactions are submitted in batches, each
+ * in one go with AcceptPackageToMemoryPool, after verifying their scripts in
+ * parallel unless the signature cache can be expected to hold them already.
+ */
 bool LoadMempool();
 
-bool GetCoinAge(const CTransaction& tx, const CCoinsViewCache& view, uint64_t& nCoinAge, const Consensus::Params& params, uint32_t nTime);
+/** Dump the signature and script execution caches to disk. */
+bool DumpScriptCaches();
+
+/**
+ * Load the signature and script execution caches from disk. Has to be called
+ * after they are initialized, but before anything is validated.
+ */
+bool LoadScriptCaches();
+
+/**
+ * Locate a confirmed transaction on disk, in the ancestor of pindexPrev at
+ * nHeight, the height of one of its outputs. The transaction index is
+ * consulted first, but only a position in that block is accepted; otherwise
+ * the block is searched.
+ */
+bool FindTxPosition(const uint256& txid, const CBlockIndex* pindexPrev, int nHeight, CDiskTxPos& pos);
+bool GetCoinAge(const CTransaction& tx, const CCoinsViewCache& view, const CBlockIndex* pindexPrev, uint64_t& nCoinAge, const Consensus::Params& params, uint32_t nTime);
 
 #endif // BITCOIN_VALIDATION_H
@@ -10,10 +10,12 @@
 #include <vector>
 
 #include <consensus/validation.h>
+#include <policy/policy.h>
 #include <rpc/server.h>
 #include <test/test_bitcoin.h>
 #include <validation.h>
 #include <wallet/coincontrol.h>
+#include <wallet/fees.h>
 #include <wallet/test/wallet_test_fixture.h>
 
 #include <boost/test/unit_test.hpp>
@@ -362,6 +364,97 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     empty_wallet();
 }
 
+// The coins of the wallet, sorted by decreasing value as SelectCoinsBnB wants them
+static std::vector<CInputCoin> SortedInputCoins()
+{
+    std::vector<CInputCoin> vUTXOs;
+    for (const COutput& output : vCoins)
+        vUTXOs.emplace_back(output.tx, output.i);
+    std::sort(vUTXOs.begin(), vUTXOs.end(), [](const CInputCoin& a, const CInputCoin& b) {
+        return a.txout.nValue > b.txout.nValue;
+    });
+    return vUTXOs;
+}
+
+BOOST_AUTO_TEST_CASE(SelectCoinsBnB_test)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+
+    LOCK(testWallet.cs_wallet);
+
+    empty_wallet();
+    add_coin(1 * CENT);
+    add_coin(2 * CENT);
+    add_coin(3 * CENT);
+    add_coin(4 * CENT);
+    std::vector<CInputCoin> vUTXOs = SortedInputCoins();
+
+    // exact matches
+    BOOST_CHECK(SelectCoinsBnB(vUTXOs, 10 * CENT, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 10 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 4U);
+    BOOST_CHECK(SelectCoinsBnB(vUTXOs, 5 * CENT, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // no exact match, but one below the cost of change
+    BOOST_CHECK(SelectCoinsBnB(vUTXOs, 35 * CENT / 10, CENT / 2 + 1, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 4 * CENT);
+
+    // an excess of exactly the cost of change would be change that is not
+    // dust; nothing below the cost of change, or not enough at all
+    BOOST_CHECK(!SelectCoinsBnB(vUTXOs, 35 * CENT / 10, CENT / 2, setCoinsRet, nValueRet));
+    BOOST_CHECK(setCoinsRet.empty());
+    BOOST_CHECK(!SelectCoinsBnB(vUTXOs, 35 * CENT / 10, CENT / 4, setCoinsRet, nValueRet));
+    BOOST_CHECK(!SelectCoinsBnB(vUTXOs, 11 * CENT, CENT, setCoinsRet, nValueRet));
+
+    // find the same excess as trying every subset, with many equal values
+    for (int i = 0; i < RUN_TESTS; i++)
+    {
+        empty_wallet();
+        for (int j = 0; j < 10; j++)
+            add_coin((1 + InsecureRandRange(20)) * CENT / 4);
+        vUTXOs = SortedInputCoins();
+        const CAmount nTarget = (1 + InsecureRandRange(40)) * CENT / 4;
+        const CAmount nCostOfChange = InsecureRandRange(3) * CENT / 8;
+
+        CAmount nBestExcess = -1;
+        for (unsigned int mask = 1; mask < (1U << vUTXOs.size()); mask++) {
+            CAmount nTotal = 0;
+            for (size_t j = 0; j < vUTXOs.size(); j++)
+                if (mask & (1U << j))
+                    nTotal += vUTXOs[j].txout.nValue;
+            if (nTotal >= nTarget && (nTotal == nTarget || nTotal - nTarget < nCostOfChange) && (nBestExcess < 0 || nTotal - nTarget < nBestExcess))
+                nBestExcess = nTotal - nTarget;
+        }
+
+        BOOST_CHECK_EQUAL(SelectCoinsBnB(vUTXOs, nTarget, nCostOfChange, setCoinsRet, nValueRet), nBestExcess >= 0);
+        if (nBestExcess >= 0) {
+            BOOST_CHECK_EQUAL(nValueRet - nTarget, nBestExcess);
+            CAmount nTotal = 0;
+            for (const CInputCoin& coin : setCoinsRet)
+                nTotal += coin.txout.nValue;
+            BOOST_CHECK_EQUAL(nTotal, nValueRet);
+        }
+    }
+
+    // Coins of 2^(n+i) and 2^(n+i) + 2^(n-1-i): only the first of each pair
+    // adds up to the target, which is found last. The search gives up first.
+    empty_wallet();
+    const int n = 17;
+    CAmount nTarget = 0;
+    for (int i = 0; i < n; i++) {
+        nTarget += CAmount(1) << (n + i);
+        add_coin(CAmount(1) << (n + i));
+        add_coin((CAmount(1) << (n + i)) + (CAmount(1) << (n - 1 - i)));
+    }
+    vUTXOs = SortedInputCoins();
+    BOOST_CHECK(!SelectCoinsBnB(vUTXOs, nTarget, 0, setCoinsRet, nValueRet));
+
+    empty_wallet();
+}
+
 static void AddKey(CWallet& wallet, const CKey& key)
 {
     LOCK(wallet.cs_wallet);
@@ -699,4 +792,49 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
 }
 
+BOOST_FIXTURE_TEST_CASE(CreateTransaction_change, ListCoinsTestingSetup)
+{
+    // Coins of assorted values, so that some amounts can be paid without change
+    const CScript scriptMine = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    for (CAmount nValue : {1 * CENT, 2 * CENT, 3 * CENT, 5 * CENT, 8 * CENT, 13 * CENT}) {
+        AddTx(CRecipient{scriptMine, nValue, false /* subtract fee */});
+    }
+
+    // Change outputs are no bigger than a P2PK one, so any change of this
+    // much is not dust.
+    const CAmount nCostOfChange = GetDustThreshold(CTxOut(0, scriptMine), GetDiscardRate(::feeEstimator));
+    const CScript scriptDest = GetScriptForRawPubKey({});
+    for (int i = 1; i <= 40; i++) {
+        const CAmount nValue = i * CENT / 2 - InsecureRandRange(CENT / 100);
+        CWalletTx wtx;
+        CReserveKey reservekey(wallet.get());
+        CAmount nFee;
+        int nChangePos = -1;
+        std::string strError;
+        CCoinControl coin_control;
+        BOOST_CHECK(wallet->CreateTransaction({CRecipient{scriptDest, nValue, false}}, wtx, reservekey, nFee, nChangePos, strError, coin_control));
+
+        CAmount nValueIn = 0;
+        {
+            LOCK(wallet->cs_wallet);
+            for (const CTxIn& txin : wtx.tx->vin)
+                nValueIn += wallet->mapWallet.at(txin.prevout.hash).tx->vout[txin.prevout.n].nValue;
+        }
+        BOOST_CHECK_EQUAL(nValueIn - wtx.tx->GetValueOut(), nFee);
+
+        // The fee is paid. Without change, it is overpaid by less than a
+        // change output would be worth, give or take the fee of that output
+        // and of the signatures being shorter than estimated.
+        const CAmount nFeeNeeded = GetMinimumFee(GetVirtualTransactionSize(*wtx.tx), coin_control, ::mempool, ::feeEstimator, nullptr);
+        BOOST_CHECK(nFee >= nFeeNeeded);
+        if (nChangePos == -1) {
+            BOOST_CHECK_EQUAL(wtx.tx->vout.size(), 1U);
+            const unsigned int nSlack = GetSerializeSize(CTxOut(0, scriptMine), SER_DISK, 0) + 2 + 2 * wtx.tx->vin.size();
+            BOOST_CHECK(nFee - nFeeNeeded <= nCostOfChange + GetMinimumFee(nSlack, coin_control, ::mempool, ::feeEstimator, nullptr));
+        } else {
+            BOOST_CHECK(!IsDust(wtx.tx->vout[nChangePos], GetDiscardRate(::feeEstimator)));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,7 @@
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
 #include <fs.h>
+#include <index/txindex.h>
 #include <wallet/init.h>
 #include <kernel.h>
 #include <key.h>
@@ -36,6 +37,7 @@
 
 #include <assert.h>
 #include <future>
+#include <tuple>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -77,15 +79,6 @@ const uint256 CMerkleTx::ABANDON_HASH(uint256S("00000000000000000000000000000000
  * @{
  */
 
-struct CompareValueOnly
-{
-    bool operator()(const CInputCoin& t1,
-                    const CInputCoin& t2) const
-    {
-        return t1.txout.nValue < t2.txout.nValue;
-    }
-};
-
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->tx->vout[i].nValue));
@@ -2428,19 +2421,116 @@ static void ApproximateBestSubset(const std::vector<CInputCoin>& vValue, const C
     }
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
-                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const
+bool SelectCoinsBnB(const std::vector<CInputCoin>& vUTXOs, const CAmount& nTargetValue, const CAmount& nCostOfChange, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet)
 {
     setCoinsRet.clear();
     nValueRet = 0;
 
-    // List of values less than target
-    boost::optional<CInputCoin> coinLowestLarger;
-    std::vector<CInputCoin> vValue;
-    CAmount nTotalLower = 0;
+    // The coins are decided on in order, each either included or not. At
+    // every step, nRemaining is the value of those not decided on yet.
+    CAmount nRemaining = 0;
+    for (const CInputCoin& coin : vUTXOs)
+        nRemaining += coin.txout.nValue;
+    if (nRemaining < nTargetValue)
+        return false;
+
+    // An excess of nCostOfChange is not dust at the discard rate, so it
+    // would get a change output after all.
+    const CAmount nMaxExcess = std::max<CAmount>(nCostOfChange - 1, 0);
+    std::vector<char> vfIncluded(vUTXOs.size(), false);
+    std::vector<char> vfBest;
+    CAmount nSelected = 0;
+    CAmount nBestExcess = nMaxExcess + 1;
+    size_t nDecided = 0;
+
+    for (size_t nTries = 0; nTries < BNB_MAX_TRIES; nTries++)
+    {
+        bool fBacktrack = false;
+        if (nSelected + nRemaining < nTargetValue || nSelected > nTargetValue + nMaxExcess) {
+            // The target can't be reached anymore, or has been overshot
+            fBacktrack = true;
+        } else if (nSelected >= nTargetValue) {
+            if (nSelected - nTargetValue < nBestExcess) {
+                nBestExcess = nSelected - nTargetValue;
+                vfBest = vfIncluded;
+                if (nBestExcess == 0)
+                    break;
+            }
+            // Adding more coins only adds to the excess
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Undecide up to the last coin included, and exclude it instead
+            while (nDecided > 0 && !vfIncluded[nDecided - 1]) {
+                nDecided--;
+                nRemaining += vUTXOs[nDecided].txout.nValue;
+            }
+            if (nDecided == 0)
+                break; // Every branch has been searched
+            vfIncluded[nDecided - 1] = false;
+            nSelected -= vUTXOs[nDecided - 1].txout.nValue;
+        } else {
+            const CAmount nValue = vUTXOs[nDecided].txout.nValue;
+            nRemaining -= nValue;
+            // Including a coin right after excluding one of the same value
+            // leads to the same sets as the branch already searched
+            if (nDecided > 0 && !vfIncluded[nDecided - 1] && nValue == vUTXOs[nDecided - 1].txout.nValue) {
+                vfIncluded[nDecided] = false;
+            } else {
+                vfIncluded[nDecided] = true;
+                nSelected += nValue;
+            }
+            nDecided++;
+        }
+    }
+
+    if (vfBest.empty())
+        return false;
+
+    for (size_t i = 0; i < vUTXOs.size(); i++) {
+        if (vfBest[i]) {
+            setCoinsRet.insert(vUTXOs[i]);
+            nValueRet += vUTXOs[i].txout.nValue;
+        }
+    }
+    return true;
+}
+
+// Sort the coins by decreasing value, in random order among those of the same
+// value, so that which of them gets picked is random. The keys are sorted
+// rather than the coins, whose values are behind two pointers each.
+static void SortCoinsByValue(std::vector<COutput>& vCoins)
+{
+    FastRandomContext insecure_rand;
+    std::vector<std::tuple<CAmount, uint64_t, size_t>> vKeys;
+    vKeys.reserve(vCoins.size());
+    for (size_t i = 0; i < vCoins.size(); i++)
+        vKeys.emplace_back(-vCoins[i].tx->tx->vout[vCoins[i].i].nValue, insecure_rand.rand64(), i);
+    std::sort(vKeys.begin(), vKeys.end());
+
+    std::vector<COutput> vSorted;
+    vSorted.reserve(vCoins.size());
+    for (const auto& key : vKeys)
+        vSorted.push_back(vCoins[std::get<2>(key)]);
+    vCoins.swap(vSorted);
+}
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
+                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const
+{
+    SortCoinsByValue(vCoins);
+    return SelectSortedCoinsMinConf(nTargetValue, nConfMine, nConfTheirs, nMaxAncestors, vCoins, setCoinsRet, nValueRet, false, 0);
+}
+
+bool CWallet::SelectSortedCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, const std::vector<COutput>& vCoins,
+                                       std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, bool fUseBnB, const CAmount& nCostOfChange) const
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
 
+    std::vector<CInputCoin> vEligible;
+    vEligible.reserve(vCoins.size());
     for (const COutput &output : vCoins)
     {
         if (!output.fSpendable)
@@ -2451,13 +2541,23 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
             continue;
 
-        if (!mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors))
+        // Only unconfirmed transactions have ancestors in the mempool
+        if (output.nDepth == 0 && !mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors))
             continue;
 
-        int i = output.i;
+        vEligible.emplace_back(pcoin, output.i);
+    }
+
+    if (fUseBnB && SelectCoinsBnB(vEligible, nTargetValue, nCostOfChange, setCoinsRet, nValueRet))
+        return true;
 
-        CInputCoin coin = CInputCoin(pcoin, i);
+    // List of values less than target
+    boost::optional<CInputCoin> coinLowestLarger;
+    std::vector<CInputCoin> vValue;
+    CAmount nTotalLower = 0;
 
+    for (const CInputCoin& coin : vEligible)
+    {
         if (coin.txout.nValue == nTargetValue)
         {
             setCoinsRet.insert(coin);
@@ -2469,8 +2569,9 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
             vValue.push_back(coin);
             nTotalLower += coin.txout.nValue;
         }
-        else if (!coinLowestLarger || coin.txout.nValue < coinLowestLarger->txout.nValue)
+        else
         {
+            // The coins come largest first, so this is the smallest so far
             coinLowestLarger = coin;
         }
     }
@@ -2494,15 +2595,16 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
-    std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
-    std::reverse(vValue.begin(), vValue.end());
+    // Solve subset sum by stochastic approximation, over the coins in
+    // decreasing order of value. Large wallets get fewer attempts, so that
+    // the work stays bounded.
     std::vector<char> vfBest;
     CAmount nBest;
+    const int nIterations = std::max<size_t>(1, std::min<size_t>(1000, KNAPSACK_MAX_WORK / std::max<size_t>(1, vValue.size())));
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
+    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, nIterations);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest);
+        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest, nIterations);
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
@@ -2534,7 +2636,7 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
     return true;
 }
 
-bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl) const
+bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, bool fUseBnB, const CAmount& nCostOfChange) const
 {
     std::vector<COutput> vCoins(vAvailableCoins);
 
@@ -2582,19 +2684,21 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
             ++it;
     }
 
+    SortCoinsByValue(vCoins);
+
     size_t nMaxChainLength = std::min(gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT), gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT));
     bool fRejectLongChains = gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
     bool res = nTargetValue <= nValueFromPresetInputs ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet) ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet));
-
-    // because SelectCoinsMinConf clears the setCoinsRet, we now add the possible inputs to the coinset
+        SelectSortedCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet, fUseBnB, nCostOfChange) ||
+        SelectSortedCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet, fUseBnB, nCostOfChange) ||
+        (bSpendZeroConfChange && SelectSortedCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet, fUseBnB, nCostOfChange)) ||
+        (bSpendZeroConfChange && SelectSortedCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet, fUseBnB, nCostOfChange)) ||
+        (bSpendZeroConfChange && SelectSortedCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet, fUseBnB, nCostOfChange)) ||
+        (bSpendZeroConfChange && SelectSortedCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet, fUseBnB, nCostOfChange)) ||
+        (bSpendZeroConfChange && !fRejectLongChains && SelectSortedCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet, fUseBnB, nCostOfChange));
+
+    // because SelectSortedCoinsMinConf clears the setCoinsRet, we now add the possible inputs to the coinset
     setCoinsRet.insert(setPresetCoins.begin(), setPresetCoins.end());
 
     // add preset inputs to the total value selected
@@ -2813,9 +2917,16 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
             size_t change_prototype_size = GetSerializeSize(change_prototype_txout, SER_DISK, 0);
 
             CFeeRate discard_rate = GetDiscardRate(::feeEstimator);
+            // Change below the dust threshold at the discard rate goes to the fee
+            // anyway, so inputs exceeding the target by less need no change output
+            const CAmount nCostOfChange = GetDustThreshold(change_prototype_txout, discard_rate);
             nFeeRet = 0;
             bool pick_new_inputs = true;
             CAmount nValueIn = 0;
+            // Branch and bound does not know the fee of the inputs it picks,
+            // so a set found for one fee may need another: only the first
+            // selections try it, so that the loop settles like the knapsack.
+            unsigned int nSelections = 0;
             // Start with no fee and loop until there is enough fee
             while (true)
             {
@@ -2865,7 +2976,8 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
                 if (pick_new_inputs) {
                     nValueIn = 0;
                     setCoins.clear();
-                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control))
+                    const bool fUseBnB = nSelections++ < BNB_MAX_SELECTIONS;
+                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control, fUseBnB, nCostOfChange))
                     {
                         strFailReason = _("Insufficient funds");
                         return false;
@@ -3070,35 +3182,33 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
     return true;
 }
 
-uint256HashMap<std::pair<CBlockHeader*, unsigned int> >::Data* TryGetBlockOffset(uint256HashMap<std::pair<CBlockHeader*, unsigned int> >& cache, const uint256& tx_hash)
+uint256HashMap<std::pair<const CBlockIndex*, unsigned int> >::Data* TryGetBlockOffset(uint256HashMap<std::pair<const CBlockIndex*, unsigned int> >& cache, const uint256& tx_hash)
 {
-    uint256HashMap<std::pair<CBlockHeader*, unsigned int> >::Data *pbo = cache.Search(UintToArith256(tx_hash));
+    AssertLockHeld(cs_main);
+
+    uint256HashMap<std::pair<const CBlockIndex*, unsigned int> >::Data *pbo = cache.Search(UintToArith256(tx_hash));
     // Try Load, if missing or temporary removed
     if (pbo == NULL || pbo->value.first == NULL) {
         CDiskTxPos postx;
-        CBlockHeader *cbh = (CBlockHeader *)0x1; // default=Error
-        if(pblocktree->ReadTxIndex(tx_hash, postx)) {
-            // Read block header
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            cbh = new CBlockHeader;
-            try {
-                file >> *cbh;
-            } catch (std::exception &e) {
-                delete cbh;
-                cbh = (CBlockHeader *)0x1; // Error
-            }
-        } // ReadTxIndex()
+        const CBlockIndex *pindexFrom = (const CBlockIndex *)0x1; // default=Error
+        // The block comes from the block index and only the offset from the
+        // transaction index, so staking works with pruned block files.
+        const Coin& coin = AccessByTxid(*pcoinsTip, tx_hash);
+        if (!coin.IsSpent() && FindTxPosition(tx_hash, chainActive.Tip(), coin.nHeight, postx)) {
+            pindexFrom = chainActive[coin.nHeight];
+        }
 
         if (pbo == NULL) {
-            std::pair<CBlockHeader*, unsigned int> bo(cbh, postx.nTxOffset + CBlockHeader::NORMAL_SERIALIZE_SIZE);
+            std::pair<const CBlockIndex*, unsigned int> bo(pindexFrom, postx.nTxOffset + CBlockHeader::NORMAL_SERIALIZE_SIZE);
             pbo = cache.Insert(UintToArith256(tx_hash), bo);
         } else {
-            pbo->value.first = cbh;
+            pbo->value.first = pindexFrom;
+            pbo->value.second = postx.nTxOffset + CBlockHeader::NORMAL_SERIALIZE_SIZE;
         }
     }
 
     // Don't work, if reaadErr=0x1, or temporary removed=NULL
-    if(pbo->value.first < (CBlock*)0x4)
+    if(pbo->value.first < (const CBlockIndex*)0x4)
         return nullptr;
 
     return pbo;
@@ -3117,9 +3227,11 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     arith_uint256 bnTargetPerCoinDay;
     bnTargetPerCoinDay.SetCompact(nBits);
 
-    // Transaction index is required to get to block header
-    if (!fTxIndex)
+    // Transaction index is required to get the kernel offsets
+    if (!g_txindex)
         return error("CreateCoinStake : transaction index unavailable");
+    if (!g_txindex->IsSynced())
+        return false; // transaction index is still catching up with the chain
 
     LOCK2(cs_main, cs_wallet);
     txNew.vin.clear();
@@ -3148,12 +3260,12 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
     // This is static cache for minimize block loads for each POS-attempt
     // Possible values of ->value.first
-    // Addr > 0x4 -- This is pointer to blockheader in the memory
+    // Addr > 0x4 -- This is pointer to the block index entry of the block
     // Addr = 0x1 -- Was read error, don't load this block anymore
     // NULL -- Block removed after mint, but maybe need reload again into same cell
-    static uint256HashMap<std::pair<CBlockHeader*, unsigned int> > CacheBlockOffset;
+    static uint256HashMap<std::pair<const CBlockIndex*, unsigned int> > CacheBlockOffset;
     CacheBlockOffset.Set(setCoins.size() << 1); // 2x pointers
-    uint256HashMap<std::pair<CBlockHeader*, unsigned int> >::Data *pbo = NULL;
+    uint256HashMap<std::pair<const CBlockIndex*, unsigned int> >::Data *pbo = NULL;
 
     std::vector<std::tuple<CInputCoin, uint64_t>> coinsWithAge;
     const int64_t DAY = 24 * 60 * 60;
@@ -3167,14 +3279,14 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
             continue;
         }
 
-        CBlockHeader& header = *(pbo->value.first);
+        const CBlockIndex* pindexFrom = pbo->value.first;
 
         static int nMaxStakeSearchInterval = 60;
-        if (header.GetBlockTime() + consensusParams.nStakeMinAge > nCoinStakeTime - nMaxStakeSearchInterval) {
+        if (pindexFrom->GetBlockTime() + consensusParams.nStakeMinAge > nCoinStakeTime - nMaxStakeSearchInterval) {
             continue; // only count coins meeting min age requirement
         }
 
-        int64_t nDayWeight = (std::min((nCoinStakeTime - header.GetBlockTime()), Params().GetConsensus().nStakeMaxAge) - Params().GetConsensus().nStakeMinAge) / DAY;
+        int64_t nDayWeight = (std::min((nCoinStakeTime - pindexFrom->GetBlockTime()), Params().GetConsensus().nStakeMaxAge) - Params().GetConsensus().nStakeMinAge) / DAY;
         uint64_t coinAge = std::max(coin.txout.nValue * nDayWeight / COIN, (int64_t)0);
 
         coinsWithAge.push_back(std::make_tuple(coin, coinAge));
@@ -3208,11 +3320,11 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
             continue;
         }
 
-        CBlockHeader& header = *(pbo->value.first);
+        const CBlockIndex* pindexFrom = pbo->value.first;
         unsigned int offset  = pbo->value.second;
 
         static int nMaxStakeSearchInterval = 60;
-        if (header.GetBlockTime() + consensusParams.nStakeMinAge > nCoinStakeTime - nMaxStakeSearchInterval) {
+        if (pindexFrom->GetBlockTime() + consensusParams.nStakeMinAge > nCoinStakeTime - nMaxStakeSearchInterval) {
             continue; // only count coins meeting min age requirement
         }
 
@@ -3224,7 +3336,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
             // Search backward in time from the given txNew timestamp
             // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
             uint256 hashProofOfStake;
-            if (CheckStakeKernelHash(nBits, header, offset, pcoin.txout, pcoin.outpoint, nCoinStakeTime - n, hashProofOfStake))
+            if (CheckStakeKernelHash(nBits, pindexFrom, offset, pcoin.txout, pcoin.outpoint, nCoinStakeTime - n, hashProofOfStake))
             {
                 LogPrint(BCLog::COINSTAKE, "CreateCoinStake : kernel found\n");
                 std::vector<std::vector<unsigned char> > vSolutions;
@@ -3292,7 +3404,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
                 // Try to add outStakeReward as input if it hasn't already been spent.
 #if 0
-                if (header.IsProofOfStake()) {
+                if (pindexFrom->IsProofOfStake()) {
                     const CWalletTx* wtx = GetWalletTx(pcoin.outpoint.hash);
                     const CBlockIndex* blockIndex;
                     wtx->GetDepthInMainChain(blockIndex);
@@ -3311,7 +3423,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 #endif
 
                 txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
-                if (header.GetBlockTime() + nStakeSplitAge > nCoinStakeTime && nCredit > nPoWReward && gArgs.GetBoolArg("-splitpos", true))
+                if (pindexFrom->GetBlockTime() + nStakeSplitAge > nCoinStakeTime && nCredit > nPoWReward && gArgs.GetBoolArg("-splitpos", true))
                     txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake if (age < 90 && value > POW)
                 LogPrint(BCLog::COINSTAKE, "CreateCoinStake : added kernel type=%d\n", whichType);
                 fKernelFound = true;
@@ -3358,16 +3470,15 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
             auto bo = TryGetBlockOffset(CacheBlockOffset, pcoin.outpoint.hash);
             if (bo == nullptr)
                 continue;
-            CBlockHeader& header = *(bo->value.first);
+            const CBlockIndex* pindexFrom = bo->value.first;
             // Do not add input that is still too young
-            if (header.GetBlockTime() + consensusParams.nStakeMaxAge > nCoinStakeTime)
+            if (pindexFrom->GetBlockTime() + consensusParams.nStakeMaxAge > nCoinStakeTime)
                 continue;
 
             txNew.vin.push_back(CTxIn(pcoin.outpoint.hash, pcoin.outpoint.n));
             nCredit += pcoin.txout.nValue;
             vCoinsPrev.push_back(pcoin);
 
-            delete bo->value.first;
             bo->value.first = NULL; // Set "temporary removed"
             CacheBlockOffset.MarkDel(bo);
         }
@@ -3377,7 +3488,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     {
         uint64_t nCoinAge;
         CCoinsViewCache view(pcoinsTip.get());
-        if (!GetCoinAge(txNew, view, nCoinAge, consensusParams, nCoinStakeTime))
+        if (!GetCoinAge(txNew, view, chainActive.Tip(), nCoinAge, consensusParams, nCoinStakeTime))
             return error("CreateCoinStake : failed to calculate coin age");
 
         nPosReward = GetProofOfStakeReward(nCoinAge);
@@ -3431,7 +3542,6 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
     // Successfully generated coinstake
     // Remove block reference from the cache
-    delete pbo->value.first;
     pbo->value.first = NULL; // Set "temporary removed"
     CacheBlockOffset.MarkDel(pbo);
     return true;
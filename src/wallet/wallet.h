@@ -55,6 +55,12 @@ static const CAmount WALLET_INCREMENTAL_RELAY_FEE = 5000;
 static const CAmount MIN_CHANGE = CENT;
 //! final minimum change amount after paying for fees
 static const CAmount MIN_FINAL_CHANGE = MIN_CHANGE/2;
+//! maximum number of steps of the branch and bound coin selection
+static const size_t BNB_MAX_TRIES = 100000;
+//! coin selections of the CreateTransaction fee loop that may use branch and bound, before only the knapsack is used
+static const unsigned int BNB_MAX_SELECTIONS = 2;
+//! the stochastic coin selection visits about this many coins, spread over up to 1000 attempts
+static const size_t KNAPSACK_MAX_WORK = 1000000;
 //! Default for -spendzeroconfchange
 static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
 //! Default for -walletrejectlongchains
@@ -549,7 +555,15 @@ public:
     std::string ToString() const;
 };
 
-
+/**
+ * Search, by branch and bound, for a subset of vUTXOs worth at least
+ * nTargetValue and less than nTargetValue + nCostOfChange, or exactly
+ * nTargetValue, which can be spent without a change output: a change of
+ * nCostOfChange would not be dust. vUTXOs must be sorted by decreasing value. Of the subsets
+ * found within BNB_MAX_TRIES steps, the one closest to nTargetValue is
+ * returned.
+ */
+bool SelectCoinsBnB(const std::vector<CInputCoin>& vUTXOs, const CAmount& nTargetValue, const CAmount& nCostOfChange, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet);
 
 
 /** Private key that includes an expiration date in case it never gets used. */
@@ -680,9 +694,16 @@ private:
     /**
      * Select a set of coins such that nValueRet >= nTargetValue and at least
      * all coins from coinControl are selected; Never select unconfirmed coins
-     * if they are not ours
+     * if they are not ours. If fUseBnB is set, a set needing no change, worth
+     * less than nCostOfChange more than nTargetValue, is preferred.
+     */
+    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr, bool fUseBnB = false, const CAmount& nCostOfChange = 0) const;
+
+    /**
+     * SelectCoinsMinConf for coins shuffled and then sorted by decreasing
+     * value, so that SelectCoins sorts them once for all its attempts.
      */
-    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr) const;
+    bool SelectSortedCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, const std::vector<COutput>& vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, bool fUseBnB, const CAmount& nCostOfChange) const;
 
     CWalletDB *pwalletdbEncryption;
 
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test pipelined block connection.
+
+With -pipelineconnect, a node in initial block download verifies the scripts
+of the next block while it connects the current one. Check that a script
+failure in the next block is blamed on that block and not on the one being
+connected, also during a reorg, and that the checks of a next block that is
+never connected don't affect the blocks connected after it.
+
+We build a chain that stays old enough to keep the node in initial block
+download:
+
+    0:        genesis block
+    1-3:      blocks whose coinbase outputs are spent later, 1 and 3 to a key
+              and 2 to OP_TRUE
+    4-102:    bury them so the coinbase outputs can be spent
+
+and on top of it branches in which blocks spend those outputs, either validly
+or with an invalid (null) signature. The blocks of a branch are sent in
+reverse order after its headers, so that the node connects them in one go,
+each block pipelined behind its parent.
+"""
+from test_framework.blocktools import (create_block, create_coinbase)
+from test_framework.key import CECKey
+from test_framework.mininode import (CBlockHeader,
+                                     COutPoint,
+                                     CTransaction,
+                                     CTxIn,
+                                     CTxOut,
+                                     network_thread_start,
+                                     P2PInterface,
+                                     msg_block,
+                                     msg_headers)
+from test_framework.script import (CScript, OP_TRUE)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, wait_until
+
+class BaseNode(P2PInterface):
+    def send_header_for_blocks(self, new_blocks):
+        headers_message = msg_headers()
+        headers_message.headers = [CBlockHeader(b) for b in new_blocks]
+        self.send_message(headers_message)
+
+class PipelineConnectTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        # Script check threads are needed for the pipeline, and whitelisting
+        # keeps our connection up when we send invalid blocks.
+        self.extra_args = [["-pipelineconnect=1", "-par=4", "-whitelist=127.0.0.1"]]
+
+    def build_block(self, parent, txs=(), pubkey=None):
+        """Build a block on top of parent, a (hash, height) pair."""
+        parent_hash, parent_height = parent
+        block = create_block(parent_hash, create_coinbase(parent_height + 1, pubkey), self.block_time)
+        self.block_time += 1
+        block.vtx.extend(txs)
+        block.hashMerkleRoot = block.calc_merkle_root()
+        block.rehash()
+        block.solve()
+        return block
+
+    def spend(self, block):
+        """Spend the coinbase output of block with an empty scriptSig, which
+        is only valid for the OP_TRUE outputs."""
+        tx = CTransaction()
+        tx.vin.append(CTxIn(COutPoint(block.vtx[0].sha256, 0), scriptSig=b""))
+        tx.vout.append(CTxOut(block.vtx[0].vout[0].nValue - 100000, CScript([OP_TRUE])))
+        tx.calc_sha256()
+        return tx
+
+    def build_branch(self, parent, txs_per_block):
+        blocks = []
+        for txs in txs_per_block:
+            blocks.append(self.build_block(parent, txs))
+            parent = (blocks[-1].sha256, parent[1] + 1)
+        return blocks
+
+    def send_branch(self, blocks):
+        """Send the headers of blocks, then the blocks themselves, children first."""
+        self.p2p.send_header_for_blocks(blocks)
+        for block in reversed(blocks):
+            self.p2p.send_message(msg_block(block))
+        self.p2p.sync_with_ping()
+
+    def assert_tip(self, block):
+        wait_until(lambda: self.node.getbestblockhash() == block.hash, timeout=10)
+
+    def assert_invalid(self, block):
+        tips = {tip['hash']: tip['status'] for tip in self.node.getchaintips()}
+        assert_equal(tips.get(block.hash), 'invalid')
+
+    def run_test(self):
+        self.node = self.nodes[0]
+        self.p2p = self.node.add_p2p_connection(BaseNode())
+        network_thread_start()
+        self.p2p.wait_for_verack()
+
+        genesis = self.node.getblock(self.node.getbestblockhash())
+        self.block_time = genesis['time'] + 1
+
+        coinbase_key = CECKey()
+        coinbase_key.set_secretbytes(b"horsebattery")
+        coinbase_pubkey = coinbase_key.get_pubkey()
+
+        # Blocks 1-3 with the coinbase outputs, buried up to height 102.
+        self.blocks = [self.build_block((int(genesis['hash'], 16), 0), pubkey=coinbase_pubkey)]
+        self.blocks.append(self.build_block((self.blocks[-1].sha256, 1)))
+        self.blocks.append(self.build_block((self.blocks[-1].sha256, 2), pubkey=coinbase_pubkey))
+        for height in range(3, 102):
+            self.blocks.append(self.build_block((self.blocks[-1].sha256, height)))
+        key_block1, true_block2, key_block3 = self.blocks[0:3]
+        tip102 = (self.blocks[-1].sha256, 102)
+
+        self.p2p.send_header_for_blocks(self.blocks)
+        for block in self.blocks:
+            self.p2p.send_message(msg_block(block))
+        self.p2p.sync_with_ping()
+        self.assert_tip(self.blocks[-1])
+        assert self.node.getblockchaininfo()['initialblockdownload']
+
+        self.log.info("A bad script in the pipelined block is blamed on that block")
+        # 103 spends block 2's output, 104 block 1's with an invalid signature.
+        branch_a = self.build_branch(tip102, [[self.spend(true_block2)], [self.spend(key_block1)]])
+        self.send_branch(branch_a)
+        self.assert_tip(branch_a[0])
+        self.assert_invalid(branch_a[1])
+
+        self.log.info("Likewise during a reorg")
+        # 103b is empty, 104b spends block 2's output and 105b block 1's with
+        # an invalid signature. The node moves over from 103 and stays at 104b.
+        branch_b = self.build_branch(tip102, [[], [self.spend(true_block2)], [self.spend(key_block1)]])
+        self.send_branch(branch_b)
+        self.assert_tip(branch_b[1])
+        self.assert_invalid(branch_b[2])
+
+        self.log.info("Checks of a pipelined block that is never connected don't leak into the next one")
+        # 105c spends block 1's output and 106c block 3's, both with invalid
+        # signatures. 106c's checks are queued while 105c is rejected, and
+        # must not fail 105d, which is connected next.
+        tip104b = (branch_b[1].sha256, 104)
+        branch_c = self.build_branch(tip104b, [[self.spend(key_block1)], [self.spend(key_block3)]])
+        self.send_branch(branch_c)
+        self.assert_tip(branch_b[1])
+        self.assert_invalid(branch_c[1])
+
+        branch_d = self.build_branch(tip104b, [[], []])
+        self.send_branch(branch_d)
+        self.assert_tip(branch_d[1])
+        assert_equal(self.node.getblockcount(), 106)
+
+if __name__ == '__main__':
+    PipelineConnectTest().main()